@@ -54,6 +54,7 @@ commands = [
     loom.generate.generate_init,
     loom.runner.tare,
     loom.runner.sparsify,
+    loom.runner.columnarize,
     loom.runner.shuffle,
     loom.runner.infer,
     loom.runner.posterior_enum,
@@ -193,6 +193,24 @@ def sparsify(name=None, debug=False, profile='time'):
     loom.store.provide(name, results, ['ingest.diffs'])
 
 
+@parsable.command
+def columnarize(name=None, debug=False, profile='time'):
+    '''
+    Convert sparsified dataset to columnar row blocks.
+    '''
+    loom.store.require(name, ['ingest.schema_row', 'ingest.diffs'])
+    inputs, results = get_paths(name, 'columnarize')
+
+    loom.runner.columnarize(
+        schema_row_in=inputs['ingest']['schema_row'],
+        rows_in=inputs['ingest']['diffs'],
+        blocks_out=results['ingest']['columnar'],
+        debug=debug,
+        profile=profile)
+
+    loom.store.provide(name, results, ['ingest.columnar'])
+
+
 @parsable.command
 def init(name=None):
     '''
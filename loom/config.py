@@ -34,6 +34,7 @@ import loom.documented
 DEFAULTS = {
     'seed': 0,
     'target_mem_bytes': 4e9,
+    'score_cache_precision': 'float32',
     'schedule': {
         'extra_passes': 500.0,
         'small_data_size': 4e3,
@@ -46,6 +47,14 @@ DEFAULTS = {
             'empty_group_count': 1,
             'row_queue_capacity': 255,
             'parser_threads': 6,
+            'readahead_capacity': 0,
+            'batch_size': 8,
+            'spin_limit': 1024,
+            'kind_threads': 0,
+            'score_threads': 1,
+            'score_min_features': 1000,
+            'numa_pinning': False,
+            'score_tile_size': 256,
         },
         'hyper': {
             'run': True,
@@ -57,11 +66,17 @@ DEFAULTS = {
             'row_queue_capacity': 255,
             'parser_threads': 6,
             'score_parallel': True,
+            'readahead_capacity': 0,
+            'batch_size': 8,
+            'spin_limit': 1024,
+            'kind_threads': 0,
+            'numa_pinning': False,
         },
     },
     'posterior_enum': {
         'sample_count': 100,
         'sample_skip': 10,
+        'chain_count': 1,
     },
     'generate': {
         'row_count': 100,
@@ -88,6 +103,7 @@ def fill_in_sequential(config):
     fill_in_defaults(config)
     kernels = config['kernels']
     kernels['cat']['row_queue_capacity'] = 0
+    kernels['cat']['score_threads'] = 1
     kernels['hyper']['parallel'] = False
     kernels['kind']['row_queue_capacity'] = 0
     kernels['kind']['parallel'] = False
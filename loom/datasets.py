@@ -159,6 +159,11 @@ def generate_one((name, sample_count, force, debug)):
         rows_in=paths['ingest']['rows'],
         rows_out=paths['ingest']['diffs'],
         debug=debug)
+    loom.runner.columnarize(
+        schema_row_in=paths['ingest']['schema_row'],
+        rows_in=paths['ingest']['diffs'],
+        blocks_out=paths['ingest']['columnar'],
+        debug=debug)
     loom.format.export_rows(
         encoding_in=paths['ingest']['encoding'],
         rows_in=paths['ingest']['rows'],
@@ -136,13 +136,15 @@ def tare(
         schema_row_in,
         rows_in,
         tares_out,
+        threads=0,
         debug=False,
         profile=None):
     '''
     Find tare rows for a datset, i.e., rows of per-column most-likely values.
+    Set threads=0 to use all cores.
     '''
     check_call_files(
-        command=['tare', schema_row_in, rows_in, tares_out],
+        command=['tare', schema_row_in, rows_in, tares_out, threads],
         debug=debug,
         profile=profile,
         infiles=[schema_row_in, rows_in],
@@ -158,19 +160,70 @@ def sparsify(
         tares_in,
         rows_in='-',
         rows_out='-',
+        threads=0,
         debug=False,
         profile=None):
     '''
-    Sparsify dataset WRT tare rows.
+    Sparsify dataset WRT tare rows. Set threads=0 to use all cores.
     '''
     check_call_files(
-        command=['sparsify', schema_row_in, tares_in, rows_in, rows_out],
+        command=[
+            'sparsify',
+            schema_row_in,
+            tares_in,
+            rows_in,
+            rows_out,
+            threads,
+        ],
         debug=debug,
         profile=profile,
         infiles=[schema_row_in, tares_in, rows_in],
         outfiles=[rows_out])
 
 
+@parsable.command
+@loom.documented.transform(
+    inputs=['ingest.schema_row', 'ingest.diffs'],
+    outputs=['ingest.columnar'])
+def columnarize(
+        schema_row_in,
+        rows_in,
+        blocks_out,
+        block_size=256,
+        debug=False,
+        profile=None):
+    '''
+    Convert a row stream to columnar row blocks for inference.
+    '''
+    check_call_files(
+        command=[
+            'columnarize', schema_row_in, rows_in, blocks_out, block_size,
+        ],
+        debug=debug,
+        profile=profile,
+        infiles=[schema_row_in, rows_in],
+        outfiles=[blocks_out])
+
+
+@parsable.command
+def slice_rows(
+        rows_in,
+        rows_out,
+        begin,
+        end,
+        debug=False,
+        profile=None):
+    '''
+    Copy rows in positions [begin, end) of a dataset.
+    '''
+    check_call_files(
+        command=['slice', rows_in, rows_out, begin, end],
+        debug=debug,
+        profile=profile,
+        infiles=[rows_in],
+        outfiles=[rows_out])
+
+
 @parsable.command
 @loom.documented.transform(
     inputs=['ingest.diffs', 'seed'],
@@ -296,21 +349,24 @@ def mix(config_in,
         model_out,
         groups_out,
         assign_out,
+        extra_outputs=(),
         debug=False,
         profile=None):
     '''
     Generate additional samples of a dataset.
+    Each (model_out, groups_out, assign_out) triple in extra_outputs
+    is mixed by an additional independent chain.
     '''
+    outputs = [(model_out, groups_out, assign_out)] + list(extra_outputs)
+    command = ['mix', config_in, rows_in, model_in, groups_in, assign_in]
+    for output in outputs:
+        command += output
     check_call_files(
-        command=[
-            'mix',
-            config_in, rows_in, model_in, groups_in, assign_in,
-            model_out, groups_out, assign_out,
-        ],
+        command=command,
         debug=debug,
         profile=profile,
         infiles=[config_in, rows_in, model_in, groups_in, assign_in],
-        outfiles=[model_out, groups_out, assign_out])
+        outfiles=[filename for output in outputs for filename in output])
 
 
 @parsable.command
@@ -35,6 +35,11 @@ else:
         os.path.dirname(os.path.dirname(os.path.abspath(__file__))),
         'data')
 
+# Streams read only by C++ tools are compressed with CODEC,
+# one of gz, bgz, or, when loom is built with zstd or lz4, zst or lz4.
+CODEC = os.environ.get('LOOM_CODEC', 'gz')
+assert CODEC in ['gz', 'bgz', 'zst', 'lz4'], CODEC
+
 BASENAMES = {
     'ingest': {
         'version': 'version.txt',
@@ -47,11 +52,12 @@ BASENAMES = {
         'schema_row': 'schema.pb.gz',
         'tares': 'tares.pbs.gz',
         'diffs': 'diffs.pbs.gz',
+        'columnar': 'diffs.pbc.' + CODEC,
     },
     'sample': {
         'config': 'config.pb.gz',
         'init': 'init.pb.gz',
-        'shuffled': 'shuffled.pbs.gz',
+        'shuffled': 'shuffled.pbs.' + CODEC,
         'model': 'model.pb.gz',
         'groups': 'groups',
         'assign': 'assign.pbs.gz',
@@ -77,6 +83,7 @@ ERRORS = {
     'rows': 'First generate or ingest dataset',
     'tares': 'First tare dataset',
     'diffs': 'First sparsify dataset',
+    'columnar': 'First columnarize dataset',
     'init': 'First init',
     'shuffled': 'First shuffle',
 }
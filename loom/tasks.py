@@ -166,6 +166,13 @@ def ingest(
         rows_in=paths['ingest']['rows'],
         rows_out=paths['ingest']['diffs'],
         debug=debug)
+
+    LOG('columnarizing rows')
+    loom.runner.columnarize(
+        schema_row_in=paths['ingest']['schema_row'],
+        rows_in=paths['ingest']['diffs'],
+        blocks_out=paths['ingest']['columnar'],
+        debug=debug)
     loom.config.config_dump({}, paths['query']['config'])
 
 
@@ -53,6 +53,10 @@ def test_sparsify():
     loom.benchmark.sparsify(DATASET, profile=None)
 
 
+def test_columnarize():
+    loom.benchmark.columnarize(DATASET, profile=None)
+
+
 def test_shuffle():
     loom.benchmark.shuffle(DATASET, profile=None)
 
@@ -25,13 +25,17 @@
 # TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
 # USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
+import os
+import shutil
 from itertools import izip
 from nose.tools import assert_true, assert_equal, assert_not_equal
+from nose.tools import assert_less_equal
 from distributions.dbg.random import sample_bernoulli
 from distributions.io.stream import open_compressed
 from distributions.fileutil import tempdir
-from loom.schema_pb2 import ProductValue, CrossCat, Query
-from loom.test.util import for_each_dataset
+from loom.schema_pb2 import ProductValue, CrossCat, Query, Config
+from loom.test.util import for_each_dataset, CLEANUP_ON_ERROR
+import loom.store
 import loom.query
 from loom.query import protobuf_to_data_row
 import loom.config
@@ -223,3 +227,47 @@ def test_seed(root, model, rows, **unused):
 
     assert_equal(responses1, responses2)
     assert_not_equal(responses1, responses3)
+
+
+# relative error of each cached score term, see compact_mixture.hpp
+CACHE_PRECISION_ERRORS = {'float16': 2.0 ** -11, 'bfloat16': 2.0 ** -8}
+
+# bound on |term| + |shift| of one cached DD256 or DPD score term
+CACHE_TERM_BOUND = 32.0
+
+
+def _set_score_cache_precision(root, precision):
+    paths = loom.store.get_paths(root, sample_count=None)
+    for sample in paths['samples']:
+        config = Config()
+        with open_compressed(sample['config'], 'rb') as f:
+            config.ParseFromString(f.read())
+        config.score_cache_precision = precision
+        with open_compressed(sample['config'], 'wb') as f:
+            f.write(config.SerializeToString())
+
+
+@for_each_dataset
+def test_score_cache_precision(root, model, rows, **unused):
+    requests = get_example_requests(model, rows, 'score')
+    data_rows = [protobuf_to_data_row(r.score.data) for r in requests]
+    with loom.query.get_server(root, debug=True) as server:
+        expected_scores = list(server.batch_score(data_rows))
+
+    for precision, error in sorted(CACHE_PRECISION_ERRORS.iteritems()):
+        with tempdir(cleanup_on_error=CLEANUP_ON_ERROR):
+            copied = os.path.abspath(precision)
+            shutil.copytree(root, copied)
+            _set_score_cache_precision(copied, precision)
+            with loom.query.get_server(copied, debug=True) as server:
+                actual_scores = list(server.batch_score(data_rows))
+        assert_equal(len(actual_scores), len(expected_scores))
+        for data_row, expected, actual in izip(
+                data_rows,
+                expected_scores,
+                actual_scores):
+            observed_count = sum(1 for value in data_row if value is not None)
+            bound = (
+                error * CACHE_TERM_BOUND * observed_count +
+                1e-3 * (1 + abs(expected)))
+            assert_less_equal(abs(actual - expected), bound, precision)
@@ -26,16 +26,23 @@
 # USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 import os
+import copy
+import glob
+import subprocess
+from nose import SkipTest
 from nose.tools import assert_equal
 from nose.tools import assert_true
 from loom.test.util import assert_found
 from loom.test.util import CLEANUP_ON_ERROR
 from loom.test.util import for_each_dataset
+from loom.test.util import load_rows_raw
 from distributions.fileutil import tempdir
 from distributions.io.stream import open_compressed
 from distributions.io.stream import protobuf_stream_load
+from loom.schema_pb2 import Assignment
 from loom.schema_pb2 import CrossCat
 from loom.schema_pb2 import ProductModel
+from loom.schema_pb2 import Row
 import loom.config
 import loom.runner
 
@@ -138,6 +145,18 @@ CONFIGS = [
             },
         },
     },
+    {
+        'schedule': {'extra_passes': 1.5},
+        'kernels': {
+            'cat': {
+                'empty_group_count': 1,
+                'row_queue_capacity': 8,
+                'score_threads': 3,
+                'score_min_features': 0,
+            },
+            'kind': {'iterations': 0},
+        },
+    },
 ]
 
 
@@ -185,6 +204,31 @@ def test_sparsify(rows, schema_row, **unused):
         assert_found(diffs)
 
 
+@for_each_dataset
+def test_sparsify_threads(rows, schema_row, **unused):
+    with tempdir(cleanup_on_error=CLEANUP_ON_ERROR):
+        outputs = {}
+        for threads in [1, 3]:
+            tares = os.path.abspath('tares.{}.pbs.gz'.format(threads))
+            diffs = os.path.abspath('diffs.{}.pbs.gz'.format(threads))
+            loom.runner.tare(
+                schema_row_in=schema_row,
+                rows_in=rows,
+                tares_out=tares,
+                threads=threads)
+            loom.runner.sparsify(
+                schema_row_in=schema_row,
+                tares_in=tares,
+                rows_in=rows,
+                rows_out=diffs,
+                threads=threads)
+            outputs[threads] = [
+                open_compressed(filename).read()
+                for filename in [tares, diffs]
+            ]
+        assert_true(outputs[1] == outputs[3], 'output depends on threads')
+
+
 @for_each_dataset
 def test_shuffle(diffs, **unused):
     with tempdir(cleanup_on_error=CLEANUP_ON_ERROR):
@@ -197,6 +241,189 @@ def test_shuffle(diffs, **unused):
         assert_found(rows_out)
 
 
+def _check_shuffle_codec(codec, diffs):
+    seed = 12345
+    with tempdir(cleanup_on_error=CLEANUP_ON_ERROR):
+        expected_out = os.path.abspath('shuffled.pbs.gz')
+        loom.runner.shuffle(rows_in=diffs, rows_out=expected_out, seed=seed)
+        expected = load_rows_raw(expected_out)
+
+        shuffled_out = os.path.abspath('shuffled.pbs.{}'.format(codec))
+        with open('shuffle.log', 'w+') as log:
+            try:
+                loom.runner.check_call(
+                    command=[
+                        'shuffle',
+                        diffs,
+                        shuffled_out,
+                        seed,
+                        loom.config.DEFAULTS['target_mem_bytes'],
+                    ],
+                    debug=True,
+                    profile=None,
+                    stderr=log)
+            except subprocess.CalledProcessError:
+                log.seek(0)
+                if 'loom was built without' in log.read():
+                    raise SkipTest('loom was built without {}'.format(codec))
+                raise
+
+        actual_out = os.path.abspath('sliced.pbs.gz')
+        loom.runner.slice_rows(
+            rows_in=shuffled_out,
+            rows_out=actual_out,
+            begin=0,
+            end=len(expected),
+            debug=True)
+        actual = load_rows_raw(actual_out)
+        assert_equal(len(actual), len(expected))
+        assert_true(actual == expected, 'round trip changed rows')
+
+
+@for_each_dataset
+def test_shuffle_zst(diffs, **unused):
+    _check_shuffle_codec('zst', diffs)
+
+
+@for_each_dataset
+def test_shuffle_lz4(diffs, **unused):
+    _check_shuffle_codec('lz4', diffs)
+
+
+def _infer_assignments(config, tares, rows_in, init):
+    config = copy.deepcopy(config)
+    loom.config.fill_in_defaults(config)
+    with tempdir(cleanup_on_error=CLEANUP_ON_ERROR):
+        config_in = os.path.abspath('config.pb.gz')
+        assign_out = os.path.abspath('assign.pbs.gz')
+        loom.config.config_dump(config, config_in)
+        loom.runner.infer(
+            config_in=config_in,
+            rows_in=rows_in,
+            tares_in=tares,
+            model_in=init,
+            assign_out=assign_out,
+            debug=True)
+        return list(protobuf_stream_load(assign_out))
+
+
+def _set_pipeline_option(config, key, value):
+    config = copy.deepcopy(config)
+    loom.config.fill_in_defaults(config)
+    config['kernels']['hyper']['parallel'] = False
+    for kernel in ['cat', 'kind']:
+        config['kernels'][kernel][key] = value
+    return config
+
+
+@for_each_dataset
+def test_columnarize(schema_row, diffs, tares, init, **unused):
+    with tempdir(cleanup_on_error=CLEANUP_ON_ERROR):
+        blocks = os.path.abspath('diffs.pbc.gz')
+        loom.runner.columnarize(
+            schema_row_in=schema_row,
+            rows_in=diffs,
+            blocks_out=blocks,
+            block_size=7,
+            debug=True)
+        assert_found(blocks)
+
+        assigns = [
+            _infer_assignments(CONFIGS[1], tares, rows_in, init)
+            for rows_in in [diffs, blocks]
+        ]
+        assert_equal(assigns[0], assigns[1])
+
+
+def _assert_option_invariant(option, values, configs, tares, rows, init):
+    for config in configs:
+        assigns = [
+            _infer_assignments(
+                _set_pipeline_option(config, option, value),
+                tares,
+                rows,
+                init)
+            for value in values
+        ]
+        for assign in assigns[1:]:
+            assert_equal(assigns[0], assign)
+
+
+def _numa_node_count():
+    return len(glob.glob('/sys/devices/system/node/node[0-9]*'))
+
+
+@for_each_dataset
+def test_readahead(tares, shuffled, init, **unused):
+    _assert_option_invariant(
+        'readahead_capacity',
+        [0, 3],
+        [CONFIGS[1], CONFIGS[3]],
+        tares,
+        shuffled,
+        init)
+
+
+@for_each_dataset
+def test_batch_size(tares, shuffled, init, **unused):
+    _assert_option_invariant(
+        'batch_size',
+        [1, 4],
+        [CONFIGS[2], CONFIGS[7]],
+        tares,
+        shuffled,
+        init)
+
+
+@for_each_dataset
+def test_kind_threads(tares, shuffled, init, **unused):
+    _assert_option_invariant(
+        'kind_threads',
+        [0, 1, 2],
+        [CONFIGS[2], CONFIGS[7]],
+        tares,
+        shuffled,
+        init)
+
+
+@for_each_dataset
+def test_numa_pinning(tares, shuffled, init, **unused):
+    if _numa_node_count() < 2:
+        raise SkipTest('numa pinning needs at least two numa nodes')
+    _assert_option_invariant(
+        'numa_pinning',
+        [False, True],
+        [CONFIGS[2], CONFIGS[7]],
+        tares,
+        shuffled,
+        init)
+
+
+@for_each_dataset
+def test_single_pass_parallel(tares, shuffled, init, **unused):
+    rowids = []
+    for raw in protobuf_stream_load(shuffled):
+        row = Row()
+        row.ParseFromString(raw)
+        rowids.append(row.id)
+    assigns = []
+    for kind_threads, batch_size in [(0, 1), (1, 8), (2, 3)]:
+        config = copy.deepcopy(CONFIGS[0])
+        loom.config.fill_in_defaults(config)
+        config['kernels']['cat']['row_queue_capacity'] = 8
+        config['kernels']['cat']['kind_threads'] = kind_threads
+        config['kernels']['cat']['batch_size'] = batch_size
+        assigns.append(_infer_assignments(config, tares, shuffled, init))
+    assert_equal(assigns[0], assigns[1])
+    assert_equal(assigns[0], assigns[2])
+    assigned_rowids = []
+    for raw in assigns[0]:
+        assignment = Assignment()
+        assignment.ParseFromString(raw)
+        assigned_rowids.append(assignment.rowid)
+    assert_equal(assigned_rowids, rowids)
+
+
 @for_each_dataset
 def test_infer(name, tares, shuffled, init, **unused):
     with tempdir(cleanup_on_error=CLEANUP_ON_ERROR):
@@ -252,33 +479,87 @@ def test_infer(name, tares, shuffled, init, **unused):
 
 @for_each_dataset
 def test_posterior_enum(name, tares, diffs, init, **unused):
-    with tempdir(cleanup_on_error=CLEANUP_ON_ERROR):
-        config_in = os.path.abspath('config.pb.gz')
-        config = {
-            'posterior_enum': {
-                'sample_count': 7,
-            },
-            'kernels': {
-                'kind': {
-                    'row_queue_capacity': 0,
-                    'score_parallel': False,
+    first_samples = []
+    for chain_count in [1, 3]:
+        with tempdir(cleanup_on_error=CLEANUP_ON_ERROR):
+            config_in = os.path.abspath('config.pb.gz')
+            config = {
+                'posterior_enum': {
+                    'sample_count': 7,
+                    'chain_count': chain_count,
                 },
-            },
-        }
-        loom.config.config_dump(config, config_in)
-        assert_found(config_in)
+                'kernels': {
+                    'kind': {
+                        'row_queue_capacity': 0,
+                        'score_parallel': False,
+                    },
+                },
+            }
+            loom.config.config_dump(config, config_in)
+            assert_found(config_in)
 
-        samples_out = os.path.abspath('samples.pbs.gz')
-        loom.runner.posterior_enum(
-            config_in=config_in,
-            model_in=init,
-            tares_in=tares,
-            rows_in=diffs,
-            samples_out=samples_out,
-            debug=True)
-        assert_found(samples_out)
-        actual_count = sum(1 for _ in protobuf_stream_load(samples_out))
-        assert_equal(actual_count, config['posterior_enum']['sample_count'])
+            samples_out = os.path.abspath('samples.pbs.gz')
+            loom.runner.posterior_enum(
+                config_in=config_in,
+                model_in=init,
+                tares_in=tares,
+                rows_in=diffs,
+                samples_out=samples_out,
+                debug=True)
+            assert_found(samples_out)
+            samples = list(protobuf_stream_load(samples_out))
+            sample_count = config['posterior_enum']['sample_count']
+            assert_equal(len(samples), sample_count)
+            first_samples.append(samples[0])
+
+    # the first chain is seeded as in the single-chain run
+    assert_equal(first_samples[0], first_samples[1])
+
+
+def _mix_assignments(rows_in, chain_count, **kwargs):
+    outputs = [
+        tuple(
+            os.path.abspath(os.path.join('chain.{}'.format(c), name))
+            for name in ['model.pb.gz', 'groups', 'assign.pbs.gz']
+        )
+        for c in xrange(chain_count)
+    ]
+    loom.runner.mix(
+        config_in=kwargs['config'],
+        rows_in=rows_in,
+        model_in=kwargs['model'],
+        groups_in=kwargs['groups'],
+        assign_in=kwargs['assign'],
+        model_out=outputs[0][0],
+        groups_out=outputs[0][1],
+        assign_out=outputs[0][2],
+        extra_outputs=outputs[1:],
+        debug=True)
+    return [
+        list(protobuf_stream_load(assign_out))
+        for _, _, assign_out in outputs
+    ]
+
+
+@for_each_dataset
+def test_mix(rows, schema_row, **kwargs):
+    with tempdir(cleanup_on_error=CLEANUP_ON_ERROR):
+        blocks = os.path.abspath('rows.pbc.gz')
+        loom.runner.columnarize(
+            schema_row_in=schema_row,
+            rows_in=rows,
+            blocks_out=blocks,
+            block_size=7)
+        with tempdir(cleanup_on_error=CLEANUP_ON_ERROR):
+            single = _mix_assignments(rows, 1, **kwargs)
+        with tempdir(cleanup_on_error=CLEANUP_ON_ERROR):
+            multi = _mix_assignments(rows, 3, **kwargs)
+        with tempdir(cleanup_on_error=CLEANUP_ON_ERROR):
+            columnar = _mix_assignments(blocks, 3, **kwargs)
+
+    # the first chain is seeded as in the single-chain run
+    assert_equal(multi[0], single[0])
+    assert_equal(columnar, multi)
 
 
 @for_each_dataset
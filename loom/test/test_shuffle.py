@@ -26,6 +26,8 @@
 # USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 import os
+import struct
+import zlib
 from nose.tools import assert_equal, assert_not_equal, assert_list_equal
 from loom.test.util import (
     for_each_dataset,
@@ -35,6 +37,8 @@ from loom.test.util import (
     load_rows_raw,
 )
 from distributions.fileutil import tempdir
+from distributions.io.stream import protobuf_stream_load, protobuf_stream_dump
+from loom.schema_pb2 import Row, StreamIndex
 import loom.runner
 
 
@@ -80,3 +84,148 @@ def test_chunking(rows, **unused):
         for i, actual in enumerate(results):
             for expected in results[:i]:
                 assert_list_equal(actual, expected)
+
+
+@for_each_dataset
+def test_external(rows, **unused):
+    with tempdir(cleanup_on_error=CLEANUP_ON_ERROR):
+        seed = 12345
+        rows_out = os.path.abspath('rows_out.pbs.gz')
+        loom.runner.shuffle(
+            rows_in=rows,
+            rows_out=rows_out,
+            seed=seed,
+            target_mem_bytes=1e4)
+        assert_found(rows_out)
+        for filename in os.listdir('.'):
+            assert 'bucket' not in filename, filename
+
+        original = load_rows(rows)
+        shuffled = load_rows(rows_out)
+        actual = sorted(shuffled, key=lambda row: row.id)
+        expected = sorted(original, key=lambda row: row.id)
+        assert_list_equal(expected, actual)
+
+
+@for_each_dataset
+def test_index(rows, **unused):
+    with tempdir(cleanup_on_error=CLEANUP_ON_ERROR):
+        seed = 12345
+        rows_out = os.path.abspath('rows_out.pbs.gz')
+        loom.runner.shuffle(
+            rows_in=rows,
+            rows_out=rows_out,
+            seed=seed)
+        index = rows_out + '.index.pbs.gz'
+        assert_found(index)
+
+        messages = list(protobuf_stream_load(index))
+        header = StreamIndex.Header()
+        header.ParseFromString(messages[0])
+        shuffled = load_rows_raw(rows_out)
+        assert_equal(header.message_count, len(shuffled))
+        assert_equal(header.max_message_size, max(map(len, shuffled)))
+        assert_equal(header.point_count, len(messages) - 1)
+        assert_equal(header.file_size, os.path.getsize(rows_out))
+        assert_equal(header.total_bytes, sum(4 + len(m) for m in shuffled))
+        checksum = 0
+        for message in shuffled:
+            checksum = zlib.crc32(struct.pack('<I', len(message)), checksum)
+            checksum = zlib.crc32(message, checksum)
+        assert_equal(header.checksum, checksum & 0xffffffff)
+        assert header.seekable
+
+
+def load_index_header(filename):
+    messages = list(protobuf_stream_load(filename + '.index.pbs.gz'))
+    header = StreamIndex.Header()
+    header.ParseFromString(messages[0])
+    return header
+
+
+# larger than a few gzip index spans, so that .gz indices have access points
+SEEK_BYTES = 5 << 22
+
+
+@for_each_dataset
+def test_index_seek(rows, **unused):
+    with tempdir(cleanup_on_error=CLEANUP_ON_ERROR):
+        seed = 12345
+        original = load_rows_raw(rows)
+        repeats = 1 + SEEK_BYTES // sum(4 + len(m) for m in original)
+        rows_in = os.path.abspath('rows_in.pbs')
+        protobuf_stream_dump(original * repeats, rows_in)
+        for suffix in ['.pbs', '.pbs.gz', '.pbs.bgz']:
+            rows_out = os.path.abspath('rows_out' + suffix)
+            loom.runner.shuffle(
+                rows_in=rows_in,
+                rows_out=rows_out,
+                seed=seed)
+            assert_found(rows_out)
+            header = load_index_header(rows_out)
+            assert header.point_count > 1, rows_out
+
+            shuffled = load_rows_raw(rows_out)
+            count = len(shuffled)
+            for begin in [count - 1, 0, count / 3, count / 2 + 7, 1]:
+                end = min(count, begin + 10)
+                sliced = os.path.abspath('sliced.pbs')
+                loom.runner.slice_rows(rows_out, sliced, begin, end)
+                expected = map(Row.FromString, shuffled[begin:end])
+                assert_list_equal(load_rows(sliced), expected)
+
+
+@for_each_dataset
+def test_old_index(rows, **unused):
+    with tempdir(cleanup_on_error=CLEANUP_ON_ERROR):
+        seed = 12345
+        rows_out = os.path.abspath('rows_out.pbs.gz')
+        loom.runner.shuffle(
+            rows_in=rows,
+            rows_out=rows_out,
+            seed=seed)
+        shuffled = load_rows(rows_out)
+        count = len(shuffled)
+        index = rows_out + '.index.pbs.gz'
+
+        # an index without stream stats, as written before they existed
+        header = load_index_header(rows_out)
+        old = StreamIndex.Header()
+        for field in ['file_size', 'file_mtime_nsec', 'message_count',
+                      'max_message_size']:
+            setattr(old, field, getattr(header, field))
+        old.point_count = 0
+        protobuf_stream_dump([old.SerializeToString()], index)
+
+        sliced = os.path.abspath('sliced.pbs')
+        loom.runner.slice_rows(rows_out, sliced, count / 2, count)
+        assert_list_equal(load_rows(sliced), shuffled[count / 2:])
+
+        # an unparsable index
+        protobuf_stream_dump(['not a header'], index)
+        loom.runner.slice_rows(rows_out, sliced, count / 2, count)
+        assert_list_equal(load_rows(sliced), shuffled[count / 2:])
+
+
+@for_each_dataset
+def test_block_gzip(rows, **unused):
+    with tempdir(cleanup_on_error=CLEANUP_ON_ERROR):
+        seed = 12345
+        blocked = os.path.abspath('rows_out.pbs.bgz')
+        rows_out = os.path.abspath('rows_out.pbs.gz')
+        loom.runner.shuffle(
+            rows_in=rows,
+            rows_out=blocked,
+            seed=seed)
+        assert_found(blocked)
+        loom.runner.shuffle(
+            rows_in=blocked,
+            rows_out=rows_out,
+            seed=seed)
+        assert_found(rows_out)
+
+        original = load_rows(rows)
+        shuffled = load_rows(rows_out)
+        actual = sorted(shuffled, key=lambda row: row.id)
+        expected = sorted(original, key=lambda row: row.id)
+        assert_list_equal(expected, actual)
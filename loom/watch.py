@@ -71,6 +71,25 @@ def pretty_timedelta(delta):
     return '{:d}:{:02d}:{:02d}'.format(hours, minutes, seconds)
 
 
+def pretty_pipeline(pipeline):
+    '''
+    Show the fraction of time each pipeline thread spent busy vs waiting.
+    A stage whose threads are all busy while others wait is the bottleneck.
+    '''
+    lines = []
+    for thread in pipeline.threads:
+        total = max(1, thread.busy_time + thread.wait_time)
+        lines.append('stage {}: busy {:5.1f}% wait {:5.1f}%'.format(
+            thread.stage,
+            100.0 * thread.busy_time / total,
+            100.0 * thread.wait_time / total))
+    lines.append('queue fill: mean {:.1f} max {} of {}'.format(
+        pipeline.queue_fill_mean,
+        pipeline.queue_fill_max,
+        pipeline.queue_size))
+    return '\n'.join(lines)
+
+
 @parsable.command
 def full(log_file):
     '''
@@ -110,6 +129,10 @@ def partial(log_file):
             'kernels:\n{}'.format(message.args.kernel_status),
             'rusage:\n{}'.format(message.rusage),
         ])
+        if message.args.kernel_status.HasField('pipeline'):
+            part = '{}pipeline:\n{}\n'.format(
+                part,
+                pretty_pipeline(message.args.kernel_status.pipeline))
         print_page(part)
 
 
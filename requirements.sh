@@ -7,6 +7,8 @@ sudo apt-get install -y \
     protobuf-compiler \
     libprotobuf-dev \
     libgoogle-perftools-dev \
+    libzstd-dev \
+    liblz4-dev \
     libboost-python-dev \
     libeigen3-dev \
     python-setuptools \
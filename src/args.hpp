@@ -93,6 +93,8 @@ public:
         }
     }
 
+    bool empty () const { return argc_ == 0; }
+
     void done ()
     {
         if (argc_ > 0) {
@@ -0,0 +1,182 @@
+// Copyright (c) 2014, Salesforce.com, Inc.  All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// - Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+// - Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+// - Neither the name of Salesforce.com nor the names of its contributors
+//   may be used to endorse or promote products derived from this
+//   software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+// FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+// COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+// BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+// OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+// TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <cstdio>
+#include <random>
+#include <loom/args.hpp>
+#include <loom/timer.hpp>
+#include <loom/simd_mixture.hpp>
+
+const char * help_message =
+"Usage: benchmark_mixture [GROUP_COUNT=256] [ROW_COUNT=10000] [REPEAT=10]"
+"\nArguments:"
+"\n  GROUP_COUNT   number of groups per mixture"
+"\n  ROW_COUNT     number of values to add and then score"
+"\n  REPEAT        number of passes over the scored values"
+"\nNotes:"
+"\n  Compares score_value of the distributions FastMixture against the"
+"\n  simd mixture for each supported feature type, reporting time per"
+"\n  call and the largest relative difference between scores."
+;
+
+namespace loom
+{
+
+template<class Model, class SimdMixture, class Sample>
+void benchmark (
+        const char * name,
+        const typename Model::Shared & shared,
+        Sample & sample,
+        size_t group_count,
+        size_t row_count,
+        size_t repeat,
+        rng_t & rng)
+{
+    typedef typename Model::Value Value;
+    typename Model::FastMixture fast;
+    SimdMixture simd;
+
+    fast.groups().resize(group_count);
+    for (auto & group : fast.groups()) {
+        group.init(shared, rng);
+    }
+    simd.groups() = fast.groups();
+    fast.init(shared, rng);
+    simd.init(shared, rng);
+
+    std::vector<Value> values;
+    std::uniform_int_distribution<size_t> random_group(0, group_count - 1);
+    for (size_t i = 0; i < row_count; ++i) {
+        const Value value = sample(rng);
+        const size_t groupid = random_group(rng);
+        fast.add_value(shared, groupid, value, rng);
+        simd.add_value(shared, groupid, value, rng);
+        values.push_back(value);
+    }
+
+    VectorFloat fast_scores(group_count);
+    VectorFloat simd_scores(group_count);
+    float max_error = 0;
+    for (const auto & value : values) {
+        std::fill(fast_scores.begin(), fast_scores.end(), 0.f);
+        std::fill(simd_scores.begin(), simd_scores.end(), 0.f);
+        fast.score_value(shared, value, fast_scores, rng);
+        simd.score_value(shared, value, simd_scores, rng);
+        for (size_t g = 0; g < group_count; ++g) {
+            const float error = std::fabs(simd_scores[g] - fast_scores[g])
+                              / (1.f + std::fabs(fast_scores[g]));
+            max_error = std::max(max_error, error);
+        }
+    }
+
+    Timer fast_timer;
+    Timer simd_timer;
+    for (size_t r = 0; r < repeat; ++r) {
+        {
+            Timer::Scope timer(fast_timer);
+            for (const auto & value : values) {
+                fast.score_value(shared, value, fast_scores, rng);
+            }
+        }
+        {
+            Timer::Scope timer(simd_timer);
+            for (const auto & value : values) {
+                simd.score_value(shared, value, simd_scores, rng);
+            }
+        }
+    }
+
+    const double call_count = repeat * values.size();
+    const double fast_ns = 1e3 * fast_timer.total() / call_count;
+    const double simd_ns = 1e3 * simd_timer.total() / call_count;
+    printf("%-6s %10.1f %10.1f %8.2fx %12.3g\n",
+        name, fast_ns, simd_ns, fast_ns / simd_ns, max_error);
+}
+
+} // namespace loom
+
+int main (int argc, char ** argv)
+{
+    Args args(argc, argv, help_message);
+    const int group_count = args.pop_default(256);
+    const int row_count = args.pop_default(10000);
+    const int repeat = args.pop_default(10);
+    args.done();
+    LOOM_ASSERT_LT(0, group_count);
+
+    using namespace loom;
+    rng_t rng;
+
+    printf("%-6s %10s %10s %9s %12s\n",
+        "model", "fast ns", "simd ns", "speedup", "max error");
+
+    {
+        typedef distributions::BetaBernoulli Model;
+        Model::Shared shared;
+        shared.alpha = 0.5;
+        shared.beta = 2.0;
+        std::bernoulli_distribution sample(0.3);
+        benchmark<Model, SimdBetaBernoulli>(
+            "BB", shared, sample, group_count, row_count, repeat, rng);
+    }
+
+    {
+        typedef distributions::DirichletDiscrete<16> Model;
+        Model::Shared shared;
+        shared.dim = 16;
+        for (int i = 0; i < shared.dim; ++i) {
+            shared.alphas[i] = 0.5 + 0.1 * i;
+        }
+        std::uniform_int_distribution<Model::Value> sample(0, shared.dim - 1);
+        benchmark<Model, SimdDirichletDiscrete<16>>(
+            "DD16", shared, sample, group_count, row_count, repeat, rng);
+    }
+
+    {
+        typedef distributions::GammaPoisson Model;
+        Model::Shared shared;
+        shared.alpha = 1.0;
+        shared.inv_beta = 2.0;
+        std::poisson_distribution<Model::Value> sample(4.0);
+        benchmark<Model, SimdGammaPoisson>(
+            "GP", shared, sample, group_count, row_count, repeat, rng);
+    }
+
+    {
+        typedef distributions::NormalInverseChiSq Model;
+        Model::Shared shared;
+        shared.mu = 0.0;
+        shared.kappa = 1.0;
+        shared.sigmasq = 1.0;
+        shared.nu = 1.0;
+        std::normal_distribution<Model::Value> sample(1.0, 3.0);
+        benchmark<Model, SimdNormalInverseChiSq>(
+            "NICH", shared, sample, group_count, row_count, repeat, rng);
+    }
+
+    return 0;
+}
@@ -0,0 +1,118 @@
+// Copyright (c) 2014, Salesforce.com, Inc.  All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// - Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+// - Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+// - Neither the name of Salesforce.com nor the names of its contributors
+//   may be used to endorse or promote products derived from this
+//   software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+// FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+// COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+// BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+// OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+// TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <cstdio>
+#include <random>
+#include <distributions/random.hpp>
+#include <loom/args.hpp>
+#include <loom/timer.hpp>
+#include <loom/float16.hpp>
+#include <loom/sampler.hpp>
+
+const char * help_message =
+"Usage: benchmark_sampler [GROUP_COUNT=256] [SAMPLE_COUNT=100000]"
+"\nArguments:"
+"\n  GROUP_COUNT   number of scores per sample"
+"\n  SAMPLE_COUNT  number of samples to draw"
+"\nNotes:"
+"\n  Times distributions::sample_from_scores_overwrite against the"
+"\n  simd sampler on float32 and float16 scores, reporting time per call."
+"\n  See loom_check_sampler for accuracy."
+;
+
+namespace loom
+{
+
+template<class Sample>
+void benchmark (
+        const char * name,
+        const VectorFloat & scores,
+        size_t sample_count,
+        Sample sample,
+        rng_t & rng)
+{
+    const size_t size = scores.size();
+    VectorFloat workspace(size);
+    size_t checksum = 0;
+    Timer timer;
+    {
+        Timer::Scope scope(timer);
+        for (size_t i = 0; i < sample_count; ++i) {
+            workspace = scores;
+            checksum += sample(rng, workspace);
+        }
+    }
+    const double ns = 1e3 * timer.total() / sample_count;
+    printf("%-8s %10.1f %12zu\n", name, ns, checksum);
+}
+
+} // namespace loom
+
+int main (int argc, char ** argv)
+{
+    Args args(argc, argv, help_message);
+    const int group_count = args.pop_default(256);
+    const int sample_count = args.pop_default(100000);
+    args.done();
+    LOOM_ASSERT_LT(1, group_count);
+    LOOM_ASSERT_LT(0, sample_count);
+
+    using namespace loom;
+    rng_t rng;
+
+    // scores spanning a few nats, as in a cat kernel pass
+    VectorFloat scores(group_count);
+    std::normal_distribution<float> random_score(-10.f, 1.f);
+    for (auto & score : scores) {
+        score = random_score(rng);
+    }
+    std::vector<uint16_t> half_scores(group_count);
+    for (int i = 0; i < group_count; ++i) {
+        half_scores[i] = float_to_half(scores[i]);
+        scores[i] = half_to_float(half_scores[i]);
+    }
+
+    printf("%-8s %10s %12s\n", "sampler", "ns", "checksum");
+
+    benchmark("dist", scores, sample_count,
+        [](rng_t & rng, VectorFloat & workspace) {
+            return distributions::sample_from_scores_overwrite(rng, workspace);
+        }, rng);
+
+    benchmark("simd32", scores, sample_count,
+        [](rng_t & rng, VectorFloat & workspace) {
+            return simd::sample_from_scores_overwrite(rng, workspace);
+        }, rng);
+
+    benchmark("simd16", scores, sample_count,
+        [&](rng_t & rng, VectorFloat & workspace) {
+            return simd::sample_from_scores(
+                rng, half_scores.data(), half_scores.size(), workspace);
+        }, rng);
+
+    return 0;
+}
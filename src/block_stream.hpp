@@ -0,0 +1,512 @@
+// Copyright (c) 2014, Salesforce.com, Inc.  All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// - Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+// - Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+// - Neither the name of Salesforce.com nor the names of its contributors
+//   may be used to endorse or promote products derived from this
+//   software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+// FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+// COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+// BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+// OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+// TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <unistd.h>
+#include <zlib.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <google/protobuf/io/zero_copy_stream.h>
+#include <loom/common.hpp>
+
+namespace loom
+{
+namespace protobuf
+{
+
+//----------------------------------------------------------------------------
+// Block Gzip Format
+//
+// A .bgz file is a concatenation of gzip members, each holding whole
+// messages, so it remains readable by any gzip reader.  Like BGZF, each
+// member's header carries its compressed size in an extra subfield
+// (here 'L','M'), so blocks can be located without inflating them,
+// then inflated independently.
+
+struct BlockFormat
+{
+    enum {
+        header_size = 20,
+        trailer_size = 8,
+        block_size = 1 << 20
+    };
+
+    static uint32_t load32 (const char * data)
+    {
+        const unsigned char * bytes =
+            reinterpret_cast<const unsigned char *>(data);
+        return uint32_t(bytes[0])
+            | (uint32_t(bytes[1]) << 8)
+            | (uint32_t(bytes[2]) << 16)
+            | (uint32_t(bytes[3]) << 24);
+    }
+
+    static void store32 (char * data, uint32_t value)
+    {
+        data[0] = value;
+        data[1] = value >> 8;
+        data[2] = value >> 16;
+        data[3] = value >> 24;
+    }
+
+    static size_t read_fully (int fid, char * data, size_t size)
+    {
+        size_t total = 0;
+        while (total < size) {
+            ssize_t count = read(fid, data + total, size - total);
+            LOOM_ASSERT(count != -1, "failed to read block");
+            if (count == 0) {
+                break;
+            }
+            total += count;
+        }
+        return total;
+    }
+
+    static void write_fully (int fid, const char * data, size_t size)
+    {
+        while (size) {
+            ssize_t count = write(fid, data, size);
+            LOOM_ASSERT(count > 0, "failed to write block");
+            data += count;
+            size -= count;
+        }
+    }
+
+    static bool read_block (int fid, std::string & block)
+    {
+        block.resize(header_size);
+        size_t size = read_fully(fid, & block[0], header_size);
+        if (size == 0) {
+            return false;
+        }
+        LOOM_ASSERT_EQ(size, header_size);
+        LOOM_ASSERT(
+            block[0] == '\x1f' and block[1] == '\x8b' and
+            block[3] == '\x04' and block[12] == 'L' and block[13] == 'M',
+            "not a block gzip stream");
+        const uint32_t block_size = load32(& block[16]);
+        LOOM_ASSERT_LE(header_size + trailer_size, block_size);
+        block.resize(block_size);
+        size = read_fully(fid, & block[header_size], block_size - header_size);
+        LOOM_ASSERT(size == block_size - header_size, "truncated block");
+        return true;
+    }
+
+    static void inflate_block (const std::string & block, std::string & data)
+    {
+        const char * trailer = block.data() + block.size() - trailer_size;
+        const uint32_t crc = load32(trailer);
+        const uint32_t data_size = load32(trailer + 4);
+        data.resize(data_size);
+
+        z_stream strm;
+        strm.zalloc = Z_NULL;
+        strm.zfree = Z_NULL;
+        strm.opaque = Z_NULL;
+        int status = inflateInit2(& strm, -15);
+        LOOM_ASSERT(status == Z_OK, "inflateInit2 failed");
+        strm.next_in = reinterpret_cast<Bytef *>(
+            const_cast<char *>(block.data() + header_size));
+        strm.avail_in = block.size() - header_size - trailer_size;
+        strm.next_out = reinterpret_cast<Bytef *>(& data[0]);
+        strm.avail_out = data_size;
+        status = inflate(& strm, Z_FINISH);
+        inflateEnd(& strm);
+        LOOM_ASSERT(
+            status == Z_STREAM_END and strm.avail_out == 0,
+            "failed to inflate block");
+        LOOM_ASSERT(
+            crc32(0, reinterpret_cast<const Bytef *>(data.data()), data_size)
+                == crc,
+            "block checksum mismatch");
+    }
+
+    static void deflate_block (
+            const char * data,
+            size_t data_size,
+            std::string & block)
+    {
+        z_stream strm;
+        strm.zalloc = Z_NULL;
+        strm.zfree = Z_NULL;
+        strm.opaque = Z_NULL;
+        int status = deflateInit2(
+            & strm,
+            Z_DEFAULT_COMPRESSION,
+            Z_DEFLATED,
+            -15,
+            8,
+            Z_DEFAULT_STRATEGY);
+        LOOM_ASSERT(status == Z_OK, "deflateInit2 failed");
+
+        const size_t bound = deflateBound(& strm, data_size);
+        block.resize(header_size + bound + trailer_size);
+        strm.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data));
+        strm.avail_in = data_size;
+        strm.next_out = reinterpret_cast<Bytef *>(& block[header_size]);
+        strm.avail_out = bound;
+        status = deflate(& strm, Z_FINISH);
+        LOOM_ASSERT(status == Z_STREAM_END, "failed to deflate block");
+        const size_t block_size = header_size + strm.total_out + trailer_size;
+        deflateEnd(& strm);
+
+        static const char header[header_size] = {
+            '\x1f', '\x8b', '\x08', '\x04',  // magic, deflate, FEXTRA
+            0, 0, 0, 0,                      // mtime
+            0, '\xff',                       // xfl, os
+            8, 0,                            // xlen
+            'L', 'M', 4, 0,                  // subfield id, length
+            0, 0, 0, 0                       // block size
+        };
+        std::copy(header, header + header_size, block.begin());
+        store32(& block[16], block_size);
+        block.resize(block_size);
+        char * trailer = & block[block_size - trailer_size];
+        store32(
+            trailer,
+            crc32(0, reinterpret_cast<const Bytef *>(data), data_size));
+        store32(trailer + 4, data_size);
+    }
+};
+
+//----------------------------------------------------------------------------
+// Block Output Stream
+//
+// OutFile calls end_message() after each message; a block is cut once
+// at least block_size bytes are buffered.  file_size() is the number of
+// compressed bytes written so far, i.e. the offset of the next block.
+
+class BlockOutputStream : public google::protobuf::io::ZeroCopyOutputStream
+{
+public:
+
+    enum { min_buffer_size = 1 << 13 };
+
+    explicit BlockOutputStream (int fid) :
+        fid_(fid),
+        used_(0),
+        byte_count_(0),
+        file_size_(0)
+    {
+    }
+
+    ~BlockOutputStream ()
+    {
+        flush();
+    }
+
+    bool Next (void ** data, int * size)
+    {
+        if (used_ == buffer_.size()) {
+            buffer_.resize(std::max<size_t>(
+                min_buffer_size,
+                2 * buffer_.size()));
+        }
+        * data = & buffer_[used_];
+        * size = buffer_.size() - used_;
+        used_ = buffer_.size();
+        byte_count_ += * size;
+        return true;
+    }
+
+    void BackUp (int count)
+    {
+        used_ -= count;
+        byte_count_ -= count;
+    }
+
+    google::protobuf::int64 ByteCount () const { return byte_count_; }
+
+    uint64_t file_size () const { return file_size_; }
+
+    // returns whether a block was cut
+    bool end_message ()
+    {
+        if (used_ >= BlockFormat::block_size) {
+            flush();
+            return true;
+        } else {
+            return false;
+        }
+    }
+
+    void flush ()
+    {
+        if (used_) {
+            BlockFormat::deflate_block(buffer_.data(), used_, block_);
+            BlockFormat::write_fully(fid_, block_.data(), block_.size());
+            file_size_ += block_.size();
+            used_ = 0;
+        }
+    }
+
+private:
+
+    const int fid_;
+    std::vector<char> buffer_;
+    size_t used_;
+    google::protobuf::int64 byte_count_;
+    uint64_t file_size_;
+    std::string block_;
+};
+
+//----------------------------------------------------------------------------
+// Block Input Stream
+//
+// The consumer thread reads compressed blocks ahead and a small pool of
+// worker threads inflates them.  In cyclic mode the reader wraps around
+// to the start of the file, so that prefetching continues across the wrap.
+// The end-of-stream in between persists until resume() is called,
+// so that a reader can count messages per pass.
+
+class BlockInputStream : public google::protobuf::io::ZeroCopyInputStream
+{
+public:
+
+    enum {
+        thread_count = 2,
+        readahead = 2 * thread_count + 2
+    };
+
+    explicit BlockInputStream (int fid) :
+        fid_(fid),
+        cyclic_(false),
+        eof_(false),
+        at_end_(false),
+        exit_(false),
+        current_(nullptr),
+        pos_(0),
+        byte_count_(0)
+    {
+        for (size_t i = 0; i < thread_count; ++i) {
+            workers_.push_back(std::thread(& BlockInputStream::_work, this));
+        }
+    }
+
+    ~BlockInputStream ()
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            exit_ = true;
+        }
+        work_cond_.notify_all();
+        for (auto & worker : workers_) {
+            worker.join();
+        }
+        delete current_;
+        for (auto * block : pending_) {
+            delete block;
+        }
+        for (auto * block : free_) {
+            delete block;
+        }
+    }
+
+    bool cyclic () const { return cyclic_; }
+
+    void set_cyclic ()
+    {
+        cyclic_ = true;
+        if (eof_) {
+            _wrap();
+        }
+    }
+
+    void resume () { at_end_ = false; }
+
+    bool Next (const void ** data, int * size)
+    {
+        if (LOOM_UNLIKELY(at_end_)) {
+            return false;
+        }
+        while (not current_ or pos_ == current_->data.size()) {
+            if (not _next_block()) {
+                return false;
+            }
+        }
+        * data = current_->data.data() + pos_;
+        * size = current_->data.size() - pos_;
+        pos_ = current_->data.size();
+        byte_count_ += * size;
+        return true;
+    }
+
+    void BackUp (int count)
+    {
+        pos_ -= count;
+        byte_count_ -= count;
+    }
+
+    bool Skip (int count)
+    {
+        while (count > 0) {
+            const void * data;
+            int size;
+            if (not Next(& data, & size)) {
+                return false;
+            }
+            if (size > count) {
+                BackUp(size - count);
+                size = count;
+            }
+            count -= size;
+        }
+        return true;
+    }
+
+    google::protobuf::int64 ByteCount () const { return byte_count_; }
+
+private:
+
+    struct Block
+    {
+        std::string compressed;
+        std::string data;
+        bool ready;
+        bool end;
+    };
+
+    Block * _alloc ()
+    {
+        if (free_.empty()) {
+            return new Block();
+        } else {
+            Block * block = free_.back();
+            free_.pop_back();
+            return block;
+        }
+    }
+
+    void _wrap ()
+    {
+        const off_t file_size = lseek(fid_, 0, SEEK_END);
+        LOOM_ASSERT(lseek(fid_, 0, SEEK_SET) == 0, "failed to rewind");
+        eof_ = (file_size == 0);
+        Block * block = _alloc();
+        block->ready = true;
+        block->end = true;
+        pending_.push_back(block);
+    }
+
+    void _load ()
+    {
+        while (pending_.size() < readahead and not eof_) {
+            Block * block = _alloc();
+            if (BlockFormat::read_block(fid_, block->compressed)) {
+                block->ready = false;
+                block->end = false;
+                pending_.push_back(block);
+                {
+                    std::unique_lock<std::mutex> lock(mutex_);
+                    todo_.push_back(block);
+                }
+                work_cond_.notify_one();
+            } else {
+                free_.push_back(block);
+                eof_ = true;
+                if (cyclic_) {
+                    _wrap();
+                }
+            }
+        }
+    }
+
+    bool _next_block ()
+    {
+        if (current_) {
+            free_.push_back(current_);
+            current_ = nullptr;
+            pos_ = 0;
+        }
+
+        _load();
+        if (pending_.empty()) {
+            return false;
+        }
+
+        Block * block = pending_.front();
+        pending_.pop_front();
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            done_cond_.wait(lock, [&]{ return block->ready; });
+        }
+        if (block->end) {
+            free_.push_back(block);
+            at_end_ = true;
+            return false;
+        }
+
+        current_ = block;
+        pos_ = 0;
+        return true;
+    }
+
+    void _work ()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true) {
+            work_cond_.wait(lock, [&]{ return exit_ or not todo_.empty(); });
+            if (exit_) {
+                return;
+            }
+            Block * block = todo_.front();
+            todo_.pop_front();
+            lock.unlock();
+            BlockFormat::inflate_block(block->compressed, block->data);
+            lock.lock();
+            block->ready = true;
+            done_cond_.notify_all();
+        }
+    }
+
+    const int fid_;
+    bool cyclic_;
+    bool eof_;
+    bool at_end_;
+
+    std::mutex mutex_;
+    std::condition_variable work_cond_;
+    std::condition_variable done_cond_;
+    std::deque<Block *> todo_;
+    bool exit_;
+    std::vector<std::thread> workers_;
+
+    std::deque<Block *> pending_;
+    std::vector<Block *> free_;
+    Block * current_;
+    size_t pos_;
+    google::protobuf::int64 byte_count_;
+};
+
+} // namespace protobuf
+} // namespace loom
@@ -28,15 +28,27 @@
 #pragma once
 
 #include <thread>
+#include <memory>
 #include <loom/cross_cat.hpp>
 #include <loom/assignments.hpp>
+#include <loom/parallel_scorer.hpp>
+#include <loom/sampler.hpp>
 #include <loom/timer.hpp>
 #include <loom/logger.hpp>
 
 namespace loom
 {
 
-using ::distributions::sample_from_scores_overwrite;
+// the cat and kind kernels sample every group assignment through here;
+// builds with -DLOOM_SIMD_SAMPLER use the vectorized sampler.hpp
+inline size_t sample_groupid (rng_t & rng, VectorFloat & scores)
+{
+#ifdef LOOM_SIMD_SAMPLER
+    return simd::sample_from_scores_overwrite(rng, scores);
+#else // LOOM_SIMD_SAMPLER
+    return distributions::sample_from_scores_overwrite(rng, scores);
+#endif // LOOM_SIMD_SAMPLER
+}
 
 class CatKernel : noncopyable
 {
@@ -48,11 +60,13 @@ public:
             const protobuf::Config::Kernels::Cat & config,
             CrossCat & cross_cat) :
         cross_cat_(cross_cat),
+        scorers_(cross_cat.kinds.size()),
         partial_diffs_(),
         scores_(),
         timer_()
     {
         LOOM_ASSERT_LT(0, config.empty_group_count());
+        init_scorers(config);
     }
 
     void add_row_noassign (
@@ -69,9 +83,17 @@ public:
             const protobuf::Row & row,
             Assignments & assignments);
 
+    template<class Diff>
+    size_t add_to_kind (
+            size_t kindid,
+            const Diff & partial_diff,
+            VectorFloat & scores,
+            rng_t & rng);
+
+    template<class Diff>
     void process_add_task (
-            CrossCat::Kind & kind,
-            const ProductValue::Diff & partial_diff,
+            size_t kindid,
+            const Diff & partial_diff,
             VectorFloat & scores,
             Groupids & groupids,
             rng_t & rng);
@@ -86,9 +108,10 @@ public:
             const protobuf::Row & row,
             Assignments & assignments);
 
+    template<class Diff>
     void process_remove_task (
             CrossCat::Kind & kind,
-            const ProductValue::Diff & partial_diff,
+            const Diff & partial_diff,
             Groupids & groupids,
             rng_t & rng);
 
@@ -96,7 +119,24 @@ public:
 
 private:
 
+    void init_scorers (const protobuf::Config::Kernels::Cat & config);
+
+    template<class ValueType>
+    void score_value (
+            size_t kindid,
+            const ValueType & value,
+            VectorFloat & scores,
+            rng_t & rng);
+
+    template<class Diff>
+    void score_diff (
+            size_t kindid,
+            const Diff & diff,
+            VectorFloat & scores,
+            rng_t & rng);
+
     CrossCat & cross_cat_;
+    std::vector<std::unique_ptr<ParallelScorer>> scorers_;
     std::vector<ProductValue::Diff> partial_diffs_;
     VectorFloat scores_;
     Timer timer_;
@@ -109,6 +149,53 @@ inline void CatKernel::log_metrics (Logger::Message & message)
     timer_.clear();
 }
 
+// Kinds with at least score_min_features features are scored in
+// score_threads blocks on the shared TaskPool; this is off by default.
+inline void CatKernel::init_scorers (
+        const protobuf::Config::Kernels::Cat & config)
+{
+    const size_t thread_count = config.score_threads();
+    if (thread_count > 1) {
+        const size_t kind_count = cross_cat_.kinds.size();
+        for (size_t i = 0; i < kind_count; ++i) {
+            const auto & kind = cross_cat_.kinds[i];
+            if (kind.featureids.size() >= config.score_min_features()) {
+                scorers_[i].reset(new ParallelScorer(thread_count));
+            }
+        }
+    }
+}
+
+template<class ValueType>
+inline void CatKernel::score_value (
+        size_t kindid,
+        const ValueType & value,
+        VectorFloat & scores,
+        rng_t & rng)
+{
+    const auto & kind = cross_cat_.kinds[kindid];
+    if (LOOM_UNLIKELY(scorers_[kindid])) {
+        scorers_[kindid]->score_value(kind, value, scores, rng);
+    } else {
+        kind.mixture.score_value(kind.model, value, scores, rng);
+    }
+}
+
+template<class Diff>
+inline void CatKernel::score_diff (
+        size_t kindid,
+        const Diff & diff,
+        VectorFloat & scores,
+        rng_t & rng)
+{
+    const auto & kind = cross_cat_.kinds[kindid];
+    if (LOOM_UNLIKELY(scorers_[kindid])) {
+        scorers_[kindid]->score_diff(kind, diff, scores, rng);
+    } else {
+        kind.mixture.score_diff(kind.model, diff, scores, rng);
+    }
+}
+
 inline void CatKernel::add_row_noassign (
         rng_t & rng,
         const protobuf::Row & row)
@@ -119,23 +206,7 @@ inline void CatKernel::add_row_noassign (
 
     const size_t kind_count = cross_cat_.kinds.size();
     for (size_t i = 0; i < kind_count; ++i) {
-        const auto & partial_diff = partial_diffs_[i];
-        auto & kind = cross_cat_.kinds[i];
-        ProductModel & model = kind.model;
-        auto & mixture = kind.mixture;
-
-        if (cross_cat_.tares.empty()) {
-            auto & value = partial_diff.pos();
-            model.add_value(value, rng);
-            mixture.score_value(model, value, scores_, rng);
-            size_t groupid = sample_from_scores_overwrite(rng, scores_);
-            mixture.add_value(model, groupid, value, rng);
-        } else {
-            model.add_diff(partial_diff, rng);
-            mixture.score_diff(model, partial_diff, scores_, rng);
-            size_t groupid = sample_from_scores_overwrite(rng, scores_);
-            mixture.add_diff(model, groupid, partial_diff, rng);
-        }
+        add_to_kind(i, partial_diffs_[i], scores_, rng);
     }
 }
 
@@ -152,24 +223,7 @@ inline void CatKernel::add_row (
 
     const size_t kind_count = cross_cat_.kinds.size();
     for (size_t i = 0; i < kind_count; ++i) {
-        const auto & partial_diff = partial_diffs_[i];
-        auto & kind = cross_cat_.kinds[i];
-        ProductModel & model = kind.model;
-        auto & mixture = kind.mixture;
-
-        size_t groupid;
-        if (cross_cat_.tares.empty()) {
-            auto & value = partial_diff.pos();
-            model.add_value(value, rng);
-            mixture.score_value(model, value, scores_, rng);
-            groupid = sample_from_scores_overwrite(rng, scores_);
-            mixture.add_value(model, groupid, value, rng);
-        } else {
-            model.add_diff(partial_diff, rng);
-            mixture.score_diff(model, partial_diff, scores_, rng);
-            groupid = sample_from_scores_overwrite(rng, scores_);
-            mixture.add_diff(model, groupid, partial_diff, rng);
-        }
+        size_t groupid = add_to_kind(i, partial_diffs_[i], scores_, rng);
         packed_assignment_out.add_groupids(groupid);
     }
 }
@@ -188,7 +242,7 @@ inline void CatKernel::add_row (
     const size_t kind_count = cross_cat_.kinds.size();
     for (size_t i = 0; i < kind_count; ++i) {
         process_add_task(
-            cross_cat_.kinds[i],
+            i,
             partial_diffs_[i],
             scores_,
             assignments.groupids(i),
@@ -196,13 +250,15 @@ inline void CatKernel::add_row (
     }
 }
 
-inline void CatKernel::process_add_task (
-        CrossCat::Kind & kind,
-        const ProductValue::Diff & partial_diff,
+// returns the packed groupid
+template<class Diff>
+inline size_t CatKernel::add_to_kind (
+        size_t kindid,
+        const Diff & partial_diff,
         VectorFloat & scores,
-        Groupids & groupids,
         rng_t & rng)
 {
+    auto & kind = cross_cat_.kinds[kindid];
     ProductModel & model = kind.model;
     auto & mixture = kind.mixture;
 
@@ -210,17 +266,29 @@ inline void CatKernel::process_add_task (
     if (cross_cat_.tares.empty()) {
         auto & value = partial_diff.pos();
         model.add_value(value, rng);
-        mixture.score_value(model, value, scores, rng);
-        groupid = sample_from_scores_overwrite(rng, scores);
+        score_value(kindid, value, scores, rng);
+        groupid = sample_groupid(rng, scores);
         mixture.add_value(model, groupid, value, rng);
     } else {
         model.add_diff(partial_diff, rng);
-        mixture.score_diff(model, partial_diff, scores, rng);
-        groupid = sample_from_scores_overwrite(rng, scores);
+        score_diff(kindid, partial_diff, scores, rng);
+        groupid = sample_groupid(rng, scores);
         mixture.add_diff(model, groupid, partial_diff, rng);
     }
-    size_t global_groupid = mixture.id_tracker.packed_to_global(groupid);
-    groupids.push(global_groupid);
+    return groupid;
+}
+
+template<class Diff>
+inline void CatKernel::process_add_task (
+        size_t kindid,
+        const Diff & partial_diff,
+        VectorFloat & scores,
+        Groupids & groupids,
+        rng_t & rng)
+{
+    size_t groupid = add_to_kind(kindid, partial_diff, scores, rng);
+    const auto & mixture = cross_cat_.kinds[kindid].mixture;
+    groupids.push(mixture.id_tracker.packed_to_global(groupid));
 }
 
 inline void CatKernel::remove_row (
@@ -277,9 +345,10 @@ inline void CatKernel::remove_row (
     }
 }
 
+template<class Diff>
 inline void CatKernel::process_remove_task (
         CrossCat::Kind & kind,
-        const ProductValue::Diff & partial_diff,
+        const Diff & partial_diff,
         Groupids & groupids,
         rng_t & rng)
 {
@@ -37,14 +37,20 @@ CatPipeline::CatPipeline (
         Assignments & assignments,
         CatKernel & cat_kernel,
         rng_t & rng) :
-    pipeline_(config.row_queue_capacity(), stage_count),
+    batch_size_(std::max<size_t>(1, config.batch_size())),
+    pending_(),
+    numa_(config.numa_pinning() ? new NumaTopology() : nullptr),
+    pipeline_(config.row_queue_capacity(), stage_count, config.spin_limit()),
+    scheduler_(),
+    kind_rngs_(),
+    kind_nodes_(cross_cat.kinds.size(), -1),
     cross_cat_(cross_cat),
     rows_(rows),
     assignments_(assignments),
     cat_kernel_(cat_kernel),
     rng_(rng)
 {
-    start_threads(config.parser_threads());
+    start_threads(config.parser_threads(), config.kind_threads());
 }
 
 template<class Fun>
@@ -54,22 +60,52 @@ inline void CatPipeline::add_thread (
 {
     ThreadState thread;
     thread.rng.seed(rng_());
-    pipeline_.unsafe_add_thread(stage_number, thread, fun);
+    int cpu;
+    place_thread(cpu);
+    pipeline_.unsafe_add_thread(stage_number, thread, fun, cpu);
 }
 
-void CatPipeline::start_threads (size_t parser_threads)
+// returns the thread's NUMA node, or -1 if threads are not pinned
+inline int CatPipeline::place_thread (int & cpu)
 {
-    // unzip
-    add_thread(0, [this](Task & task, const ThreadState &){
-        if (task.add) {
-            task.parsed.clear();
-            rows_.read_unassigned(task.raw);
+    cpu = -1;
+    return numa_ ? static_cast<int>(numa_->place_thread(cpu)) : -1;
+}
+
+// Called by the kind's owning thread, so that its memory becomes local.
+// The model schema is read by parser threads, so only features move.
+void CatPipeline::relocate_kind (size_t kindid)
+{
+    auto & kind = cross_cat_.kinds[kindid];
+    relocate_to_current_node(kind.model.features);
+    relocate_to_current_node(kind.mixture);
+    relocate_to_current_node(assignments_.groupids(kindid));
+}
+
+void CatPipeline::start_threads (size_t parser_threads, size_t kind_threads)
+{
+    // unzip, and decode columnar rows
+    const bool columnar = rows_.is_columnar();
+    add_thread(0, [this, columnar](Task & task, const ThreadState &){
+        for (auto & item : task.items) {
+            if (item.add) {
+                if (columnar) {
+                    rows_.read_unassigned(item.row);
+                } else {
+                    rows_.read_unassigned(item.raw);
+                }
+            }
         }
     });
-    add_thread(0, [this](Task & task, const ThreadState &){
-        if (not task.add) {
-            task.parsed.clear();
-            rows_.read_assigned(task.raw);
+    add_thread(0, [this, columnar](Task & task, const ThreadState &){
+        for (auto & item : task.items) {
+            if (not item.add) {
+                if (columnar) {
+                    rows_.read_assigned(item.row);
+                } else {
+                    rows_.read_assigned(item.raw);
+                }
+            }
         }
     });
 
@@ -77,11 +113,20 @@ void CatPipeline::start_threads (size_t parser_threads)
     LOOM_ASSERT_LT(0, parser_threads);
     for (size_t i = 0; i < parser_threads; ++i) {
         add_thread(1,
-            [i, this, parser_threads](Task & task, ThreadState &){
+            [i, this, columnar](Task & task, ThreadState &){
             if (not task.parsed.test_and_set()) {
-                task.row.ParseFromArray(task.raw.data(), task.raw.size());
-                cross_cat_.splitter.split(task.row.diff(), task.partial_diffs);
-                cross_cat_.simplify(task.partial_diffs);
+                for (auto & item : task.items) {
+                    if (not columnar) {
+                        bool ok = item.row.ParseFromArray(
+                            item.raw.data(),
+                            item.raw.size());
+                        LOOM_ASSERT(ok, "failed to parse row");
+                    }
+                    cross_cat_.splitter.split(
+                        item.row.diff(),
+                        item.partial_diffs);
+                    cross_cat_.simplify(item.partial_diffs);
+                }
             }
         });
     }
@@ -89,39 +134,62 @@ void CatPipeline::start_threads (size_t parser_threads)
     // add/remove
     auto & rowids = assignments_.rowids();
     add_thread(2, [&rowids](const Task & task, ThreadState &){
-        if (task.add) {
-            bool ok = rowids.try_push(task.row.id());
-            LOOM_ASSERT1(ok, "duplicate row: " << task.row.id());
-        } else {
-            const auto rowid = rowids.pop();
-            if (LOOM_DEBUG_LEVEL >= 1) {
-                LOOM_ASSERT_EQ(rowid, task.row.id());
+        for (const auto & item : task.items) {
+            if (item.add) {
+                bool ok = rowids.try_push(item.row.id());
+                LOOM_ASSERT1(ok, "duplicate row: " << item.row.id());
+            } else {
+                const auto rowid = rowids.pop();
+                if (LOOM_DEBUG_LEVEL >= 1) {
+                    LOOM_ASSERT_EQ(rowid, item.row.id());
+                }
             }
         }
     });
     LOOM_ASSERT(not cross_cat_.kinds.empty(), "no kinds");
-    for (size_t i = 0; i < cross_cat_.kinds.size(); ++i) {
-        auto & kind = cross_cat_.kinds[i];
-        auto & groupids = assignments_.groupids(i);
-        add_thread(2,
-            [i, this, &kind, &groupids]
-            (const Task & task, ThreadState & thread)
+    const size_t kind_count = cross_cat_.kinds.size();
+    for (size_t i = 0; i < kind_count; ++i) {
+        kind_rngs_.push_back(rng_t(rng_()));
+    }
+
+    // kinds are packed into kind_threads threads, defaulting to one per kind
+    if (kind_threads == 0 or kind_threads > kind_count) {
+        kind_threads = kind_count;
+    }
+    scheduler_.set_thread_count(kind_threads);
+    scheduler_.schedule(cross_cat_);
+    for (size_t t = 0; t < kind_threads; ++t) {
+        int cpu;
+        const int node = place_thread(cpu);
+        pipeline_.unsafe_add_thread(2, ThreadState(),
+            [t, node, this](const Task & task, ThreadState & thread)
         {
-            if (task.add) {
-                cat_kernel_.process_add_task(
-                    kind,
-                    task.partial_diffs[i],
-                    thread.scores,
-                    groupids,
-                    thread.rng);
-            } else {
-                cat_kernel_.process_remove_task(
-                    kind,
-                    task.partial_diffs[i],
-                    groupids,
-                    thread.rng);
+            for (size_t i : scheduler_.kindids(t)) {
+                if (LOOM_UNLIKELY(kind_nodes_[i] != node)) {
+                    relocate_kind(i);
+                    kind_nodes_[i] = node;
+                }
+                auto & kind = cross_cat_.kinds[i];
+                auto & groupids = assignments_.groupids(i);
+                auto & rng = kind_rngs_[i];
+                for (const auto & item : task.items) {
+                    if (item.add) {
+                        cat_kernel_.process_add_task(
+                            i,
+                            item.partial_diffs[i],
+                            thread.scores,
+                            groupids,
+                            rng);
+                    } else {
+                        cat_kernel_.process_remove_task(
+                            kind,
+                            item.partial_diffs[i],
+                            groupids,
+                            rng);
+                    }
+                }
             }
-        });
+        }, cpu);
     }
 
     pipeline_.validate();
@@ -28,12 +28,16 @@
 #pragma once
 
 #include <thread>
+#include <memory>
 #include <loom/common.hpp>
 #include <loom/cross_cat.hpp>
 #include <loom/assignments.hpp>
 #include <loom/stream_interval.hpp>
 #include <loom/cat_kernel.hpp>
 #include <loom/pipeline.hpp>
+#include <loom/kind_scheduler.hpp>
+#include <loom/numa.hpp>
+#include <loom/logger.hpp>
 
 namespace loom
 {
@@ -52,27 +56,54 @@ public:
             CatKernel & cat_kernel,
             rng_t & rng);
 
+    ~CatPipeline () { _flush(); }
+
     void add_row ()
     {
-        pipeline_.start([](Task & task){ task.add = true; });
+        pending_.push_back(true);
+        if (LOOM_UNLIKELY(pending_.size() >= batch_size_)) {
+            _flush();
+        }
     }
 
     void remove_row ()
     {
-        pipeline_.start([](Task & task){ task.add = false; });
+        pending_.push_back(false);
+        if (LOOM_UNLIKELY(pending_.size() >= batch_size_)) {
+            _flush();
+        }
+    }
+
+    void wait ()
+    {
+        _flush();
+        pipeline_.wait();
+        scheduler_.schedule(cross_cat_);
     }
 
-    void wait () { pipeline_.wait(); }
+    void log_metrics (Logger::Message & message)
+    {
+        auto & status = * message.mutable_kernel_status();
+        pipeline_.log_metrics(status);
+        if (numa_) {
+            numa_->log_metrics(* status.mutable_numa());
+        }
+    }
 
 private:
 
+    struct Item
+    {
+        bool add;
+        protobuf::RawMessage raw;
+        FlatRow row;
+        std::vector<FlatDiff> partial_diffs;
+    };
+
     struct Task
     {
         std::atomic_flag parsed;
-        bool add;
-        std::vector<char> raw;
-        protobuf::Row row;
-        std::vector<ProductValue::Diff> partial_diffs;
+        PipelineBatch<Item> items;
 
         Task () : parsed(ATOMIC_FLAG_INIT) {}
     };
@@ -86,9 +117,33 @@ private:
     template<class Fun>
     void add_thread (size_t stage_number, const Fun & fun);
 
-    void start_threads (size_t parser_threads);
+    int place_thread (int & cpu);
+    void relocate_kind (size_t kindid);
+
+    void start_threads (size_t parser_threads, size_t kind_threads);
+
+    // batches end at schedule boundaries, since the schedule calls wait()
+    void _flush ()
+    {
+        if (not pending_.empty()) {
+            pipeline_.start([this](Task & task){
+                task.parsed.clear();
+                task.items.clear();
+                for (bool add : pending_) {
+                    task.items.push_back().add = add;
+                }
+            });
+            pending_.clear();
+        }
+    }
 
+    const size_t batch_size_;
+    std::vector<bool> pending_;
+    std::unique_ptr<NumaTopology> numa_;
     Pipeline<Task, ThreadState> pipeline_;
+    KindScheduler scheduler_;
+    std::vector<rng_t> kind_rngs_;
+    std::vector<int> kind_nodes_;
     CrossCat & cross_cat_;
     StreamInterval & rows_;
     Assignments & assignments_;
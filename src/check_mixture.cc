@@ -0,0 +1,189 @@
+// Copyright (c) 2014, Salesforce.com, Inc.  All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// - Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+// - Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+// - Neither the name of Salesforce.com nor the names of its contributors
+//   may be used to endorse or promote products derived from this
+//   software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+// FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+// COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+// BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+// OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+// TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <cstdio>
+#include <cmath>
+#include <random>
+#include <loom/args.hpp>
+#include <loom/simd_mixture.hpp>
+
+const char * help_message =
+"Usage: check_mixture [GROUP_COUNT=64] [VALUE_COUNT=1000]"
+"\nArguments:"
+"\n  GROUP_COUNT   number of groups per mixture"
+"\n  VALUE_COUNT   number of values to score"
+"\nNotes:"
+"\n  Checks score_value of each simd mixture against the score of each"
+"\n  group, as computed by reference_score (score_value_group, or a double"
+"\n  precision score for GP), on groups holding from 0 to 2^20 values."
+"\n  Also checks that scoring groups in tiles of 16, 64 and 256 groups is"
+"\n  bitwise identical to scoring all groups at once."
+"\n  Fails if any score differs by more than 1e-3 (1 + |expected|)."
+;
+
+namespace loom
+{
+
+template<class SimdMixture, class Sample>
+void check (
+        const char * name,
+        const typename SimdMixture::Shared & shared,
+        Sample & sample,
+        size_t group_count,
+        size_t value_count,
+        rng_t & rng)
+{
+    typedef typename SimdMixture::Value Value;
+    enum { max_log2_count = 20 };
+
+    // tile sizes are whole simd::GroupTable blocks, as in product_mixture
+    const size_t tile_sizes[] = {16, 64, 256};
+
+    // group g holds 2^(g % 21) - 1 values, so that some groups are large
+    SimdMixture mixture;
+    mixture.groups().resize(group_count);
+    for (size_t g = 0; g < group_count; ++g) {
+        auto & group = mixture.groups(g);
+        group.init(shared, rng);
+        const size_t count = (1UL << (g % (max_log2_count + 1))) - 1;
+        for (size_t i = 0; i < count; ++i) {
+            group.add_value(shared, sample(rng), rng);
+        }
+    }
+    mixture.init(shared, rng);
+
+    // exercise incremental updates of the table
+    std::uniform_int_distribution<size_t> random_group(0, group_count - 1);
+    for (size_t i = 0; i < value_count; ++i) {
+        const Value value = sample(rng);
+        const size_t groupid = random_group(rng);
+        mixture.add_value(shared, groupid, value, rng);
+        mixture.remove_value(shared, groupid, value, rng);
+        mixture.add_value(shared, groupid, value, rng);
+    }
+    mixture.add_group(shared, rng);
+    mixture.remove_group(shared, 0);
+    const size_t size = mixture.groups().size();
+    LOOM_ASSERT_EQ(size, group_count);
+
+    VectorFloat scores(size);
+    VectorFloat tiled_scores(size);
+    float max_error = 0;
+    for (size_t i = 0; i < value_count; ++i) {
+        const Value value = sample(rng);
+        std::fill(scores.begin(), scores.end(), 0.f);
+        mixture.score_value(shared, value, scores, rng);
+
+        for (size_t tile_size : tile_sizes) {
+            std::fill(tiled_scores.begin(), tiled_scores.end(), 0.f);
+            for (size_t begin = 0; begin < size; begin += tile_size) {
+                const size_t end = std::min(size, begin + tile_size);
+                mixture.score_value_range(
+                    shared, value, begin, end, tiled_scores.data(), rng);
+            }
+            LOOM_ASSERT(
+                tiled_scores == scores,
+                name << " tiles of " << tile_size << " groups differ");
+        }
+
+        for (size_t g = 0; g < size; ++g) {
+            const float expected =
+                mixture.reference_score(shared, g, value, rng);
+            const float error = std::fabs(scores[g] - expected)
+                              / (1.f + std::fabs(expected));
+            LOOM_ASSERT(
+                error <= 1e-3f,
+                name << " score mismatch at group " << g << ": "
+                << scores[g] << " vs " << expected);
+            max_error = std::max(max_error, error);
+        }
+    }
+    printf("%-6s %12.3g\n", name, max_error);
+}
+
+} // namespace loom
+
+int main (int argc, char ** argv)
+{
+    Args args(argc, argv, help_message);
+    const int group_count = args.pop_default(64);
+    const int value_count = args.pop_default(1000);
+    args.done();
+    LOOM_ASSERT_LT(0, group_count);
+
+    using namespace loom;
+    rng_t rng;
+
+    printf("%-6s %12s\n", "model", "max error");
+
+    {
+        typedef distributions::BetaBernoulli Model;
+        Model::Shared shared;
+        shared.alpha = 0.5;
+        shared.beta = 2.0;
+        std::bernoulli_distribution sample(0.3);
+        check<SimdBetaBernoulli>(
+            "BB", shared, sample, group_count, value_count, rng);
+    }
+
+    {
+        typedef distributions::DirichletDiscrete<16> Model;
+        Model::Shared shared;
+        shared.dim = 16;
+        for (int i = 0; i < shared.dim; ++i) {
+            shared.alphas[i] = 0.5 + 0.1 * i;
+        }
+        std::uniform_int_distribution<Model::Value> sample(0, shared.dim - 1);
+        check<SimdDirichletDiscrete<16>>(
+            "DD16", shared, sample, group_count, value_count, rng);
+    }
+
+    {
+        // a long tail of counts, so that both alpha' and x get large
+        typedef distributions::GammaPoisson Model;
+        Model::Shared shared;
+        shared.alpha = 1.0;
+        shared.inv_beta = 2.0;
+        std::geometric_distribution<Model::Value> sample(0.01);
+        check<SimdGammaPoisson>(
+            "GP", shared, sample, group_count, value_count, rng);
+    }
+
+    {
+        typedef distributions::NormalInverseChiSq Model;
+        Model::Shared shared;
+        shared.mu = 0.0;
+        shared.kappa = 1.0;
+        shared.sigmasq = 1.0;
+        shared.nu = 1.0;
+        std::normal_distribution<Model::Value> sample(1.0, 3.0);
+        check<SimdNormalInverseChiSq>(
+            "NICH", shared, sample, group_count, value_count, rng);
+    }
+
+    return 0;
+}
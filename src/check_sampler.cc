@@ -0,0 +1,254 @@
+// Copyright (c) 2014, Salesforce.com, Inc.  All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// - Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+// - Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+// - Neither the name of Salesforce.com nor the names of its contributors
+//   may be used to endorse or promote products derived from this
+//   software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+// FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+// COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+// BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+// OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+// TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <cstdio>
+#include <cmath>
+#include <algorithm>
+#include <random>
+#include <distributions/random.hpp>
+#include <loom/args.hpp>
+#include <loom/float16.hpp>
+#include <loom/sampler.hpp>
+
+const char * help_message =
+"Usage: check_sampler [GROUP_COUNT=256] [SAMPLE_COUNT=100000] [SPREAD=10]"
+"\nArguments:"
+"\n  GROUP_COUNT   number of scores per sample"
+"\n  SAMPLE_COUNT  number of samples to draw per sampler"
+"\n  SPREAD        scores are drawn uniformly from [-SPREAD, 0]"
+"\nNotes:"
+"\n  Checks the simd sampler on float32 and float16 scores against both"
+"\n  exact probabilities and the empirical distribution of"
+"\n  distributions::sample_from_scores_overwrite, with chi-squared tests."
+"\n  Groups expected to be sampled fewer than 5 times share one bin."
+"\n  Fails if any test statistic exceeds its mean by ten standard"
+"\n  deviations."
+;
+
+namespace loom
+{
+
+typedef std::vector<double> Probs;
+typedef std::vector<size_t> Counts;
+
+Probs exact_probs (const VectorFloat & scores)
+{
+    const double shift = *std::max_element(scores.begin(), scores.end());
+    Probs probs;
+    double total = 0;
+    for (float score : scores) {
+        probs.push_back(std::exp(double(score) - shift));
+        total += probs.back();
+    }
+    for (auto & prob : probs) {
+        prob /= total;
+    }
+    return probs;
+}
+
+struct Bins
+{
+    std::vector<size_t> bins;
+    size_t bin_count;
+
+    Bins (const Probs & probs, size_t sample_count) : bin_count(1)
+    {
+        // bin 0 collects the tail of rarely sampled groups
+        for (double prob : probs) {
+            bins.push_back(prob * sample_count < 5 ? 0 : bin_count++);
+        }
+    }
+
+    Counts operator() (const Counts & counts) const
+    {
+        Counts binned(bin_count, 0);
+        for (size_t i = 0; i < counts.size(); ++i) {
+            binned[bins[i]] += counts[i];
+        }
+        return binned;
+    }
+
+    Probs operator() (const Probs & probs) const
+    {
+        Probs binned(bin_count, 0);
+        for (size_t i = 0; i < probs.size(); ++i) {
+            binned[bins[i]] += probs[i];
+        }
+        return binned;
+    }
+};
+
+// the statistic has dof degrees of freedom, whose mean and variance are
+// dof and 2 dof; allow ten standard deviations
+void check_chi2 (const char * name, double chi2, size_t dof)
+{
+    const double bound = dof + 10 * std::sqrt(2.0 * dof);
+    printf("%-16s %12.1f %12.1f\n", name, chi2, bound);
+    LOOM_ASSERT(chi2 <= bound, name << " is biased: chi2 = " << chi2);
+}
+
+// goodness of fit of counts to exact probs
+void check_fit (
+        const char * name,
+        const Bins & bins,
+        const Probs & probs,
+        const Counts & counts)
+{
+    const Probs binned_probs = bins(probs);
+    const Counts binned_counts = bins(counts);
+    size_t total = 0;
+    for (size_t count : binned_counts) {
+        total += count;
+    }
+    double chi2 = 0;
+    size_t dof = 0;
+    for (size_t i = 0; i < bins.bin_count; ++i) {
+        const double expected = total * binned_probs[i];
+        if (expected > 0) {
+            const double diff = binned_counts[i] - expected;
+            chi2 += diff * diff / expected;
+            ++dof;
+        } else {
+            LOOM_ASSERT_EQ(binned_counts[i], 0);
+        }
+    }
+    check_chi2(name, chi2, dof - 1);
+}
+
+// homogeneity of two samples of equal size
+void check_same (
+        const char * name,
+        const Bins & bins,
+        const Counts & counts,
+        const Counts & expected_counts)
+{
+    const Counts binned_counts = bins(counts);
+    const Counts binned_expected = bins(expected_counts);
+    double chi2 = 0;
+    size_t dof = 0;
+    for (size_t i = 0; i < bins.bin_count; ++i) {
+        const double sum = binned_counts[i] + binned_expected[i];
+        if (sum > 0) {
+            const double diff =
+                double(binned_counts[i]) - double(binned_expected[i]);
+            chi2 += diff * diff / sum;
+            ++dof;
+        }
+    }
+    check_chi2(name, chi2, dof - 1);
+}
+
+template<class Sample>
+Counts sample_counts (
+        const VectorFloat & scores,
+        size_t sample_count,
+        Sample sample,
+        rng_t & rng)
+{
+    const size_t size = scores.size();
+    VectorFloat workspace(size);
+    Counts counts(size, 0);
+    for (size_t i = 0; i < sample_count; ++i) {
+        workspace = scores;
+        const size_t index = sample(rng, workspace);
+        LOOM_ASSERT1(index < size, "bad index: " << index);
+        ++counts[index];
+    }
+    return counts;
+}
+
+// the simd exp flushes exp(x) to zero below x = -87
+void check_flushed (
+        const char * name,
+        const VectorFloat & scores,
+        const Counts & counts)
+{
+    const float shift = *std::max_element(scores.begin(), scores.end());
+    for (size_t i = 0; i < scores.size(); ++i) {
+        if (scores[i] - shift < -87.f) {
+            LOOM_ASSERT(
+                counts[i] == 0,
+                name << " sampled a group " << (shift - scores[i]) <<
+                " nats below the max");
+        }
+    }
+}
+
+} // namespace loom
+
+int main (int argc, char ** argv)
+{
+    Args args(argc, argv, help_message);
+    const int group_count = args.pop_default(256);
+    const int sample_count = args.pop_default(100000);
+    const double spread = args.pop_default(10.0);
+    args.done();
+    LOOM_ASSERT_LT(1, group_count);
+    LOOM_ASSERT_LT(0, sample_count);
+    LOOM_ASSERT_LE(0, spread);
+
+    using namespace loom;
+    rng_t rng;
+
+    // scores are rounded to float16, so that all samplers see equal scores
+    VectorFloat scores(group_count);
+    std::uniform_real_distribution<float> random_score(-spread, 0.f);
+    std::vector<uint16_t> half_scores(group_count);
+    for (int i = 0; i < group_count; ++i) {
+        half_scores[i] = float_to_half(random_score(rng));
+        scores[i] = half_to_float(half_scores[i]);
+    }
+    const Probs probs = exact_probs(scores);
+    const Bins bins(probs, sample_count);
+
+    printf("%-16s %12s %12s\n", "test", "chi2", "bound");
+
+    const Counts dist = sample_counts(scores, sample_count,
+        [](rng_t & rng, VectorFloat & workspace) {
+            return distributions::sample_from_scores_overwrite(rng, workspace);
+        }, rng);
+    check_fit("dist vs exact", bins, probs, dist);
+
+    const Counts simd32 = sample_counts(scores, sample_count,
+        [](rng_t & rng, VectorFloat & workspace) {
+            return simd::sample_from_scores_overwrite(rng, workspace);
+        }, rng);
+    check_fit("simd32 vs exact", bins, probs, simd32);
+    check_same("simd32 vs dist", bins, simd32, dist);
+    check_flushed("simd32", scores, simd32);
+
+    const Counts simd16 = sample_counts(scores, sample_count,
+        [&](rng_t & rng, VectorFloat & workspace) {
+            return simd::sample_from_scores(
+                rng, half_scores.data(), half_scores.size(), workspace);
+        }, rng);
+    check_fit("simd16 vs exact", bins, probs, simd16);
+    check_same("simd16 vs dist", bins, simd16, dist);
+    check_flushed("simd16", scores, simd16);
+
+    return 0;
+}
@@ -0,0 +1,446 @@
+// Copyright (c) 2014, Salesforce.com, Inc.  All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// - Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+// - Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+// - Neither the name of Salesforce.com nor the names of its contributors
+//   may be used to endorse or promote products derived from this
+//   software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+// FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+// COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+// BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+// OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+// TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#pragma once
+
+#include <cstring>
+#include <algorithm>
+#include <vector>
+#include <google/protobuf/io/zero_copy_stream.h>
+#include <google/protobuf/io/zero_copy_stream_impl_lite.h>
+#include <loom/common.hpp>
+
+#ifdef LOOM_USE_ZSTD
+#include <zstd.h>
+#endif // LOOM_USE_ZSTD
+
+#ifdef LOOM_USE_LZ4
+#include <lz4frame.h>
+#endif // LOOM_USE_LZ4
+
+namespace loom
+{
+namespace protobuf
+{
+
+//----------------------------------------------------------------------------
+// Codec Streams
+//
+// .zst and .lz4 files are zstd and lz4 frames, supported when loom is
+// built with LOOM_USE_ZSTD and LOOM_USE_LZ4, resp.  Like .gz files,
+// they are read and written sequentially, and are not seekable.
+// Each codec adapts a ZeroCopy stream via protobuf's CopyingStream adaptors.
+
+class Codec
+{
+public:
+
+    enum Type { NONE, ZSTD, LZ4 };
+
+    static Type from_filename (const char * filename)
+    {
+        const size_t size = strlen(filename);
+        if (size >= 4 and strcmp(filename + size - 4, ".zst") == 0) {
+            return ZSTD;
+        }
+        if (size >= 4 and strcmp(filename + size - 4, ".lz4") == 0) {
+            return LZ4;
+        }
+        return NONE;
+    }
+
+    static google::protobuf::io::CopyingInputStreamAdaptor *
+    new_input_stream (
+            Type type,
+            google::protobuf::io::ZeroCopyInputStream * base);
+
+    static google::protobuf::io::CopyingOutputStreamAdaptor *
+    new_output_stream (
+            Type type,
+            google::protobuf::io::ZeroCopyOutputStream * base);
+
+    // these copy between a ZeroCopy stream and a buffer
+    static bool next (
+            google::protobuf::io::ZeroCopyInputStream * base,
+            const char *& data,
+            size_t & size)
+    {
+        const void * next_data;
+        int next_size;
+        while (base->Next(& next_data, & next_size)) {
+            if (next_size) {
+                data = static_cast<const char *>(next_data);
+                size = next_size;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static void write (
+            google::protobuf::io::ZeroCopyOutputStream * base,
+            const char * data,
+            size_t size)
+    {
+        while (size) {
+            void * next_data;
+            int next_size;
+            bool success = base->Next(& next_data, & next_size);
+            LOOM_ASSERT(success, "failed to write compressed stream");
+            const size_t chunk = std::min<size_t>(size, next_size);
+            memcpy(next_data, data, chunk);
+            base->BackUp(next_size - chunk);
+            data += chunk;
+            size -= chunk;
+        }
+    }
+};
+
+#ifdef LOOM_USE_ZSTD
+
+class ZstdInputStream : public google::protobuf::io::CopyingInputStream
+{
+public:
+
+    explicit ZstdInputStream (
+            google::protobuf::io::ZeroCopyInputStream * base) :
+        base_(base),
+        dctx_(ZSTD_createDCtx()),
+        finished_(true)
+    {
+        LOOM_ASSERT(dctx_, "failed to create zstd context");
+        in_.src = nullptr;
+        in_.size = 0;
+        in_.pos = 0;
+    }
+
+    ~ZstdInputStream ()
+    {
+        ZSTD_freeDCtx(dctx_);
+    }
+
+    int Read (void * buffer, int size)
+    {
+        ZSTD_outBuffer out = {buffer, static_cast<size_t>(size), 0};
+        while (true) {
+            // an unfinished frame may still hold decoded data after all of
+            // its input is consumed, so drain it before reading more input
+            if (in_.pos < in_.size or not finished_) {
+                const size_t status =
+                    ZSTD_decompressStream(dctx_, & out, & in_);
+                LOOM_ASSERT(
+                    not ZSTD_isError(status),
+                    "zstd error: " << ZSTD_getErrorName(status));
+                finished_ = (status == 0);
+                if (out.pos) {
+                    return out.pos;
+                }
+                if (in_.pos < in_.size) {
+                    continue;
+                }
+            }
+            const char * data;
+            size_t data_size;
+            if (not Codec::next(base_, data, data_size)) {
+                LOOM_ASSERT(finished_, "truncated zstd stream");
+                return 0;
+            }
+            in_.src = data;
+            in_.size = data_size;
+            in_.pos = 0;
+        }
+    }
+
+private:
+
+    google::protobuf::io::ZeroCopyInputStream * const base_;
+    ZSTD_DCtx * const dctx_;
+    ZSTD_inBuffer in_;
+    bool finished_;
+};
+
+class ZstdOutputStream : public google::protobuf::io::CopyingOutputStream
+{
+public:
+
+    enum { level = 3 };
+
+    explicit ZstdOutputStream (
+            google::protobuf::io::ZeroCopyOutputStream * base) :
+        base_(base),
+        cctx_(ZSTD_createCCtx()),
+        buffer_(ZSTD_CStreamOutSize())
+    {
+        LOOM_ASSERT(cctx_, "failed to create zstd context");
+        ZSTD_CCtx_setParameter(cctx_, ZSTD_c_compressionLevel, level);
+    }
+
+    ~ZstdOutputStream ()
+    {
+        ZSTD_inBuffer in = {nullptr, 0, 0};
+        while (_compress(in, ZSTD_e_end)) {}
+        ZSTD_freeCCtx(cctx_);
+    }
+
+    bool Write (const void * buffer, int size)
+    {
+        ZSTD_inBuffer in = {buffer, static_cast<size_t>(size), 0};
+        while (in.pos < in.size) {
+            _compress(in, ZSTD_e_continue);
+        }
+        return true;
+    }
+
+private:
+
+    size_t _compress (ZSTD_inBuffer & in, ZSTD_EndDirective mode)
+    {
+        ZSTD_outBuffer out = {buffer_.data(), buffer_.size(), 0};
+        const size_t remaining = ZSTD_compressStream2(cctx_, & out, & in, mode);
+        LOOM_ASSERT(
+            not ZSTD_isError(remaining),
+            "zstd error: " << ZSTD_getErrorName(remaining));
+        Codec::write(base_, buffer_.data(), out.pos);
+        return remaining;
+    }
+
+    google::protobuf::io::ZeroCopyOutputStream * const base_;
+    ZSTD_CCtx * const cctx_;
+    std::vector<char> buffer_;
+};
+
+#endif // LOOM_USE_ZSTD
+
+#ifdef LOOM_USE_LZ4
+
+class Lz4InputStream : public google::protobuf::io::CopyingInputStream
+{
+public:
+
+    explicit Lz4InputStream (
+            google::protobuf::io::ZeroCopyInputStream * base) :
+        base_(base),
+        data_(nullptr),
+        size_(0),
+        finished_(true)
+    {
+        const size_t status =
+            LZ4F_createDecompressionContext(& dctx_, LZ4F_VERSION);
+        LOOM_ASSERT(
+            not LZ4F_isError(status),
+            "lz4 error: " << LZ4F_getErrorName(status));
+    }
+
+    ~Lz4InputStream ()
+    {
+        LZ4F_freeDecompressionContext(dctx_);
+    }
+
+    int Read (void * buffer, int size)
+    {
+        while (true) {
+            // as with zstd, drain decoded data buffered by an unfinished
+            // frame before reading more input
+            if (size_ or not finished_) {
+                size_t out_size = size;
+                size_t in_size = size_;
+                const size_t status = LZ4F_decompress(
+                    dctx_,
+                    buffer,
+                    & out_size,
+                    data_,
+                    & in_size,
+                    nullptr);
+                LOOM_ASSERT(
+                    not LZ4F_isError(status),
+                    "lz4 error: " << LZ4F_getErrorName(status));
+                data_ += in_size;
+                size_ -= in_size;
+                finished_ = (status == 0);
+                if (out_size) {
+                    return out_size;
+                }
+                if (size_) {
+                    continue;
+                }
+            }
+            if (not Codec::next(base_, data_, size_)) {
+                LOOM_ASSERT(finished_, "truncated lz4 stream");
+                return 0;
+            }
+        }
+    }
+
+private:
+
+    google::protobuf::io::ZeroCopyInputStream * const base_;
+    LZ4F_dctx * dctx_;
+    const char * data_;
+    size_t size_;
+    bool finished_;
+};
+
+class Lz4OutputStream : public google::protobuf::io::CopyingOutputStream
+{
+public:
+
+    enum { chunk_size = 1 << 16 };
+
+    explicit Lz4OutputStream (
+            google::protobuf::io::ZeroCopyOutputStream * base) :
+        base_(base),
+        buffer_(LZ4F_compressBound(chunk_size, nullptr))
+    {
+        size_t status = LZ4F_createCompressionContext(& cctx_, LZ4F_VERSION);
+        LOOM_ASSERT(
+            not LZ4F_isError(status),
+            "lz4 error: " << LZ4F_getErrorName(status));
+        buffer_.resize(std::max<size_t>(buffer_.size(), LZ4F_HEADER_SIZE_MAX));
+        status = LZ4F_compressBegin(
+            cctx_,
+            buffer_.data(),
+            buffer_.size(),
+            nullptr);
+        _write(status);
+    }
+
+    ~Lz4OutputStream ()
+    {
+        const size_t status = LZ4F_compressEnd(
+            cctx_,
+            buffer_.data(),
+            buffer_.size(),
+            nullptr);
+        _write(status);
+        LZ4F_freeCompressionContext(cctx_);
+    }
+
+    bool Write (const void * buffer, int size)
+    {
+        const char * data = static_cast<const char *>(buffer);
+        while (size) {
+            const int chunk = std::min<int>(size, chunk_size);
+            const size_t status = LZ4F_compressUpdate(
+                cctx_,
+                buffer_.data(),
+                buffer_.size(),
+                data,
+                chunk,
+                nullptr);
+            _write(status);
+            data += chunk;
+            size -= chunk;
+        }
+        return true;
+    }
+
+private:
+
+    void _write (size_t status)
+    {
+        LOOM_ASSERT(
+            not LZ4F_isError(status),
+            "lz4 error: " << LZ4F_getErrorName(status));
+        Codec::write(base_, buffer_.data(), status);
+    }
+
+    google::protobuf::io::ZeroCopyOutputStream * const base_;
+    LZ4F_cctx * cctx_;
+    std::vector<char> buffer_;
+};
+
+#endif // LOOM_USE_LZ4
+
+inline google::protobuf::io::CopyingInputStreamAdaptor *
+Codec::new_input_stream (
+        Type type,
+        google::protobuf::io::ZeroCopyInputStream * base)
+{
+    google::protobuf::io::CopyingInputStream * stream = nullptr;
+    LOOM_ASSERT(base, "missing base stream");
+    switch (type) {
+        case ZSTD:
+#ifdef LOOM_USE_ZSTD
+            stream = new ZstdInputStream(base);
+#else // LOOM_USE_ZSTD
+            LOOM_ERROR("loom was built without zstd support");
+#endif // LOOM_USE_ZSTD
+            break;
+
+        case LZ4:
+#ifdef LOOM_USE_LZ4
+            stream = new Lz4InputStream(base);
+#else // LOOM_USE_LZ4
+            LOOM_ERROR("loom was built without lz4 support");
+#endif // LOOM_USE_LZ4
+            break;
+
+        case NONE:
+            LOOM_ERROR("no codec specified");
+    }
+    auto * adaptor =
+        new google::protobuf::io::CopyingInputStreamAdaptor(stream);
+    adaptor->SetOwnsCopyingStream(true);
+    return adaptor;
+}
+
+inline google::protobuf::io::CopyingOutputStreamAdaptor *
+Codec::new_output_stream (
+        Type type,
+        google::protobuf::io::ZeroCopyOutputStream * base)
+{
+    google::protobuf::io::CopyingOutputStream * stream = nullptr;
+    LOOM_ASSERT(base, "missing base stream");
+    switch (type) {
+        case ZSTD:
+#ifdef LOOM_USE_ZSTD
+            stream = new ZstdOutputStream(base);
+#else // LOOM_USE_ZSTD
+            LOOM_ERROR("loom was built without zstd support");
+#endif // LOOM_USE_ZSTD
+            break;
+
+        case LZ4:
+#ifdef LOOM_USE_LZ4
+            stream = new Lz4OutputStream(base);
+#else // LOOM_USE_LZ4
+            LOOM_ERROR("loom was built without lz4 support");
+#endif // LOOM_USE_LZ4
+            break;
+
+        case NONE:
+            LOOM_ERROR("no codec specified");
+    }
+    auto * adaptor =
+        new google::protobuf::io::CopyingOutputStreamAdaptor(stream);
+    adaptor->SetOwnsCopyingStream(true);
+    return adaptor;
+}
+
+} // namespace protobuf
+} // namespace loom
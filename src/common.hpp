@@ -48,6 +48,15 @@
 #  define LOOM_UNLIKELY(x) (x)
 #endif // __GNUG__
 
+// Compiles a function once per instruction set and resolves it at load
+// time via an ifunc, so one binary uses the full vector width of the host.
+#if defined(__GNUG__) && !defined(__clang__) && defined(__x86_64__)
+#  define LOOM_SIMD_CLONES \
+    __attribute__((target_clones("avx512f", "avx2", "default")))
+#else // defined(__GNUG__) && !defined(__clang__) && defined(__x86_64__)
+#  define LOOM_SIMD_CLONES
+#endif // defined(__GNUG__) && !defined(__clang__) && defined(__x86_64__)
+
 
 #define LOOM_ERROR(message) {                           \
     std::ostringstream PRIVATE_message;                 \
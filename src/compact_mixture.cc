@@ -0,0 +1,77 @@
+// Copyright (c) 2014, Salesforce.com, Inc.  All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// - Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+// - Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+// - Neither the name of Salesforce.com nor the names of its contributors
+//   may be used to endorse or promote products derived from this
+//   software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+// FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+// COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+// BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+// OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+// TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <loom/compact_mixture.hpp>
+
+namespace loom
+{
+
+CachePrecision parse_cache_precision (const std::string & name)
+{
+    if (name == "float32") {
+        return CachePrecision::FLOAT32;
+    } else if (name == "float16") {
+        return CachePrecision::FLOAT16;
+    } else if (name == "bfloat16") {
+        return CachePrecision::BFLOAT16;
+    } else {
+        LOOM_ERROR("unknown cache precision: " << name);
+    }
+}
+
+namespace simd
+{
+
+// compiled per instruction set via LOOM_SIMD_CLONES; the conversions in
+// float16.hpp are branch-free, so these loops auto-vectorize
+
+LOOM_SIMD_CLONES
+void add_half_difference (
+        const uint16_t * __restrict__ half_numer,
+        const float * __restrict__ denom,
+        size_t size,
+        float * __restrict__ scores)
+{
+    for (size_t i = 0; i < size; ++i) {
+        scores[i] += half_to_float(half_numer[i]) - denom[i];
+    }
+}
+
+LOOM_SIMD_CLONES
+void add_bfloat16_difference (
+        const uint16_t * __restrict__ bfloat16_numer,
+        const float * __restrict__ denom,
+        size_t size,
+        float * __restrict__ scores)
+{
+    for (size_t i = 0; i < size; ++i) {
+        scores[i] += bfloat16_to_float(bfloat16_numer[i]) - denom[i];
+    }
+}
+
+} // namespace simd
+} // namespace loom
@@ -0,0 +1,680 @@
+// Copyright (c) 2014, Salesforce.com, Inc.  All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// - Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+// - Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+// - Neither the name of Salesforce.com nor the names of its contributors
+//   may be used to endorse or promote products derived from this
+//   software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+// FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+// COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+// BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+// OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+// TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <cmath>
+#include <string>
+#include <unordered_map>
+#include <distributions/models/dd.hpp>
+#include <distributions/models/dpd.hpp>
+#include <loom/common.hpp>
+#include <loom/float16.hpp>
+
+// Cached mixtures for wide discrete features (DD256 and DPD), whose caches
+// hold one score term per (value, group) and dominate the memory of a
+// sample.  A group's score for a value is term[value][group] - shift[group].
+// PrecisionMixture keeps the distributions FastMixture for float32 caches,
+// and otherwise stores terms as float16 or bfloat16 to halve the cache, at a
+// bounded relative error per term; shifts stay in float32.  Score kernels
+// are defined in compact_mixture.cc.
+
+namespace loom
+{
+
+enum class CachePrecision { FLOAT32, FLOAT16, BFLOAT16 };
+
+// accepts "float32", "float16" or "bfloat16"
+CachePrecision parse_cache_precision (const std::string & name);
+
+namespace simd
+{
+
+void add_half_difference (
+        const uint16_t * half_numer,
+        const float * denom,
+        size_t size,
+        float * scores);
+
+void add_bfloat16_difference (
+        const uint16_t * bfloat16_numer,
+        const float * denom,
+        size_t size,
+        float * scores);
+
+} // namespace simd
+
+// Rows of per-group 16-bit terms in a precision fixed at init, each row
+// padded to a whole number of cache lines.  Rows can be appended as new
+// values are observed.  Groups are removed by moving the last group into
+// the hole, mirroring distributions::Packed_::packed_remove.
+class CompactTable
+{
+public:
+
+    enum { block_size = 16 };
+
+    CompactTable () :
+        precision_(CachePrecision::FLOAT16),
+        row_count_(0),
+        size_(0),
+        stride_(0)
+    {
+    }
+
+    size_t size () const { return size_; }
+    size_t row_count () const { return row_count_; }
+
+    // bound on |stored - term| / |term|
+    float relative_error () const
+    {
+        return precision_ == CachePrecision::FLOAT16
+            ? 1.f / (1 << 11)
+            : 1.f / (1 << 8);
+    }
+
+    void init (size_t row_count, size_t size, CachePrecision precision)
+    {
+        LOOM_ASSERT(
+            precision != CachePrecision::FLOAT32,
+            "float32 caches use the distributions mixtures");
+        precision_ = precision;
+        row_count_ = row_count;
+        size_ = size;
+        stride_ = padded(size);
+        bits_.clear();
+        _resize();
+    }
+
+    void add_row ()
+    {
+        ++row_count_;
+        _resize();
+    }
+
+    void add_group ()
+    {
+        if (LOOM_UNLIKELY(size_ == stride_)) {
+            const size_t stride = std::max(size_t(block_size), 2 * stride_);
+            _restride(stride);
+            stride_ = stride;
+        }
+        ++size_;
+    }
+
+    void remove_group (size_t groupid)
+    {
+        LOOM_ASSERT2(groupid < size_, "bad groupid: " << groupid);
+        const size_t last = --size_;
+        for (size_t r = 0; r < row_count_; ++r) {
+            uint16_t * row = & bits_[r * stride_];
+            row[groupid] = row[last];
+            row[last] = 0;
+        }
+    }
+
+    void set (size_t row, size_t groupid, float term)
+    {
+        const size_t i = row * stride_ + groupid;
+        bits_[i] = precision_ == CachePrecision::FLOAT16
+            ? float_to_half(term)
+            : float_to_bfloat16(term);
+    }
+
+    // scores[g] += term[row][g] - shift[g] for g in [begin, end)
+    void add_difference (
+            size_t row,
+            const float * shift,
+            size_t begin,
+            size_t end,
+            float * scores) const
+    {
+        const size_t i = row * stride_ + begin;
+        const size_t size = end - begin;
+        if (precision_ == CachePrecision::FLOAT16) {
+            simd::add_half_difference(
+                & bits_[i], shift + begin, size, scores + begin);
+        } else {
+            simd::add_bfloat16_difference(
+                & bits_[i], shift + begin, size, scores + begin);
+        }
+    }
+
+private:
+
+    static size_t padded (size_t size)
+    {
+        return (size + block_size - 1) / block_size * block_size;
+    }
+
+    void _resize ()
+    {
+        bits_.resize(row_count_ * stride_, 0);
+    }
+
+    void _restride (size_t stride)
+    {
+        std::vector<uint16_t> restrided(row_count_ * stride, 0);
+        for (size_t r = 0; r < row_count_; ++r) {
+            const uint16_t * row = & bits_[r * stride_];
+            std::copy(row, row + size_, & restrided[r * stride]);
+        }
+        bits_.swap(restrided);
+    }
+
+    CachePrecision precision_;
+    size_t row_count_;
+    size_t size_;
+    size_t stride_;
+    std::vector<uint16_t> bits_;
+};
+
+// Each Derived class maps values to table rows, via find_row (value, row),
+// row_value (row) and add_row (shared, value, row), which adds a row for a
+// value first seen while streaming, if the model allows one; and computes
+// term (shared, group, value) and shift (shared, group).  Sufficient
+// statistics stay in the distributions SmallMixture base, which also
+// provides score_data, score_value_group and sampling, and scores values
+// that have no row.
+template<class Model, class Derived>
+class CompactMixture : public Model::SmallMixture
+{
+    typedef typename Model::SmallMixture Base;
+
+public:
+
+    typedef typename Model::Shared Shared;
+    typedef typename Model::Value Value;
+    typedef typename Model::Group Group;
+
+    void init (
+            const Shared & shared,
+            CachePrecision precision,
+            rng_t & rng)
+    {
+        Base::init(shared, rng);
+        const size_t size = Base::groups().size();
+        derived().init_rows(shared);
+        table_.init(derived().row_count(), size, precision);
+        shift_.resize(size);
+        for (size_t groupid = 0; groupid < size; ++groupid) {
+            _update_group(shared, groupid);
+        }
+    }
+
+    void add_group (const Shared & shared, rng_t & rng)
+    {
+        Base::add_group(shared, rng);
+        table_.add_group();
+        shift_.push_back(0);
+        _update_group(shared, table_.size() - 1);
+    }
+
+    void remove_group (const Shared & shared, size_t groupid)
+    {
+        Base::remove_group(shared, groupid);
+        table_.remove_group(groupid);
+        shift_[groupid] = shift_.back();
+        shift_.pop_back();
+    }
+
+    void add_value (
+            const Shared & shared,
+            size_t groupid,
+            const Value & value,
+            rng_t & rng)
+    {
+        Base::add_value(shared, groupid, value, rng);
+        _update_value(shared, groupid, value);
+    }
+
+    void remove_value (
+            const Shared & shared,
+            size_t groupid,
+            const Value & value,
+            rng_t & rng)
+    {
+        Base::remove_value(shared, groupid, value, rng);
+        _update_value(shared, groupid, value);
+    }
+
+    void score_value (
+            const Shared & shared,
+            const Value & value,
+            VectorFloat & scores_accum,
+            rng_t & rng) const
+    {
+        const size_t size = table_.size();
+        LOOM_ASSERT1(scores_accum.size() == size, "bad scores size");
+        if (LOOM_DEBUG_LEVEL >= 2) {
+            validate_scores(shared, value, rng);
+        }
+        _score(shared, value, 0, size, scores_accum.data(), rng);
+    }
+
+    // each term is rounded by at most relative_error, on top of the
+    // float32 error allowed by the other cached mixtures
+    void validate_scores (
+            const Shared & shared,
+            const Value & value,
+            rng_t & rng) const
+    {
+        const size_t size = table_.size();
+        LOOM_ASSERT_EQ(size, Base::groups().size());
+        VectorFloat scores(size, 0.f);
+        _score(shared, value, 0, size, scores.data(), rng);
+        const float relative_error = table_.relative_error();
+        for (size_t groupid = 0; groupid < size; ++groupid) {
+            float expected =
+                Base::score_value_group(shared, groupid, value, rng);
+            float actual = scores[groupid];
+            float term = std::fabs(expected) + std::fabs(shift_[groupid]);
+            float bound =
+                relative_error * term + 1e-3f * (1.f + std::fabs(expected));
+            LOOM_ASSERT(
+                std::fabs(actual - expected) <= bound,
+                "compact score mismatch at group " << groupid << ": "
+                << actual << " vs " << expected);
+        }
+    }
+
+private:
+
+    void _update_group (const Shared & shared, size_t groupid)
+    {
+        const Group & group = Base::groups(groupid);
+        shift_[groupid] = derived().shift(shared, group);
+        for (size_t row = 0, rows = table_.row_count(); row < rows; ++row) {
+            const Value value = derived().row_value(row);
+            table_.set(row, groupid, derived().term(shared, group, value));
+        }
+    }
+
+    void _update_value (
+            const Shared & shared,
+            size_t groupid,
+            const Value & value)
+    {
+        size_t row;
+        if (LOOM_LIKELY(derived().find_row(value, row))) {
+            const Group & group = Base::groups(groupid);
+            table_.set(row, groupid, derived().term(shared, group, value));
+        } else if (derived().add_row(shared, value, row)) {
+            table_.add_row();
+            for (size_t g = 0, size = table_.size(); g < size; ++g) {
+                const Group & group = Base::groups(g);
+                table_.set(row, g, derived().term(shared, group, value));
+            }
+        }
+        shift_[groupid] = derived().shift(shared, Base::groups(groupid));
+    }
+
+    void _score (
+            const Shared & shared,
+            const Value & value,
+            size_t begin,
+            size_t end,
+            float * scores,
+            rng_t & rng) const
+    {
+        size_t row;
+        if (LOOM_LIKELY(derived().find_row(value, row))) {
+            table_.add_difference(row, shift_.data(), begin, end, scores);
+        } else {
+            for (size_t groupid = begin; groupid < end; ++groupid) {
+                scores[groupid] +=
+                    Base::score_value_group(shared, groupid, value, rng);
+            }
+        }
+    }
+
+    Derived & derived () { return static_cast<Derived &>(*this); }
+    const Derived & derived () const
+    {
+        return static_cast<const Derived &>(*this);
+    }
+
+    CompactTable table_;
+    VectorFloat shift_;
+};
+
+//----------------------------------------------------------------------------
+// Models
+
+// row v: log(alphas[v] + counts[v]), shift: log(alpha_sum + total)
+template<int max_dim>
+class CompactDirichletDiscrete : public CompactMixture<
+        distributions::DirichletDiscrete<max_dim>,
+        CompactDirichletDiscrete<max_dim>>
+{
+    typedef CompactMixture<
+        distributions::DirichletDiscrete<max_dim>,
+        CompactDirichletDiscrete<max_dim>> Base;
+
+public:
+
+    typedef typename Base::Shared Shared;
+    typedef typename Base::Value Value;
+    typedef typename Base::Group Group;
+
+    CompactDirichletDiscrete () : dim_(0), alpha_sum_(0) {}
+
+    void init_rows (const Shared & shared)
+    {
+        dim_ = shared.dim;
+        alpha_sum_ = 0;
+        for (size_t v = 0; v < dim_; ++v) {
+            alpha_sum_ += shared.alphas[v];
+        }
+    }
+
+    size_t row_count () const { return dim_; }
+
+    Value row_value (size_t row) const { return row; }
+
+    bool find_row (const Value & value, size_t & row) const
+    {
+        row = value;
+        return row < dim_;
+    }
+
+    bool add_row (const Shared &, const Value &, size_t &)
+    {
+        return false;
+    }
+
+    float term (
+            const Shared & shared,
+            const Group & group,
+            const Value & value) const
+    {
+        return std::log(shared.alphas[value] + group.counts[value]);
+    }
+
+    float shift (const Shared &, const Group & group) const
+    {
+        return std::log(alpha_sum_ + group.count_sum);
+    }
+
+private:
+
+    size_t dim_;
+    double alpha_sum_;
+};
+
+// row per value with a beta: log(alpha beta[v] + counts[v]),
+// shift: log(alpha + total); other values are scored by the base mixture
+class CompactDirichletProcessDiscrete : public CompactMixture<
+        distributions::DirichletProcessDiscrete,
+        CompactDirichletProcessDiscrete>
+{
+public:
+
+    void init_rows (const Shared & shared)
+    {
+        rows_.clear();
+        values_.clear();
+        for (const auto & pair : shared.betas) {
+            _add_row(pair.first);
+        }
+    }
+
+    size_t row_count () const { return values_.size(); }
+
+    Value row_value (size_t row) const { return values_[row]; }
+
+    bool find_row (const Value & value, size_t & row) const
+    {
+        auto i = rows_.find(value);
+        if (i == rows_.end()) {
+            return false;
+        } else {
+            row = i->second;
+            return true;
+        }
+    }
+
+    bool add_row (const Shared & shared, const Value & value, size_t & row)
+    {
+        if (shared.betas.contains(value)) {
+            row = _add_row(value);
+            return true;
+        } else {
+            return false;
+        }
+    }
+
+    float term (
+            const Shared & shared,
+            const Group & group,
+            const Value & value) const
+    {
+        return std::log(
+            shared.alpha * shared.betas.get(value) +
+            group.counts.get_count(value));
+    }
+
+    float shift (const Shared & shared, const Group & group) const
+    {
+        return std::log(shared.alpha + group.counts.get_total());
+    }
+
+private:
+
+    size_t _add_row (const Value & value)
+    {
+        const size_t row = values_.size();
+        rows_.insert(std::make_pair(value, row));
+        values_.push_back(value);
+        return row;
+    }
+
+    std::unordered_map<Value, size_t> rows_;
+    std::vector<Value> values_;
+};
+
+//----------------------------------------------------------------------------
+// Precision
+
+// The cached mixture of DD256 and DPD features: the distributions
+// FastMixture for float32 caches, else a Compact mixture.  The precision is
+// passed to init; groups loaded before init live in the FastMixture and are
+// moved to the Compact mixture, if needed, when the cache is built.
+template<class Model, class Compact>
+class PrecisionMixture
+{
+    typedef typename Model::FastMixture Fast;
+
+public:
+
+    typedef typename Model::Shared Shared;
+    typedef typename Model::Value Value;
+    typedef typename Model::Group Group;
+
+    PrecisionMixture () : precision_(CachePrecision::FLOAT32) {}
+
+    std::vector<Group> & groups ()
+    {
+        return _compact() ? compact_.groups() : fast_.groups();
+    }
+
+    const std::vector<Group> & groups () const
+    {
+        return _compact() ? compact_.groups() : fast_.groups();
+    }
+
+    Group & groups (size_t groupid) { return groups()[groupid]; }
+    const Group & groups (size_t groupid) const { return groups()[groupid]; }
+
+    void init (
+            const Shared & shared,
+            CachePrecision precision,
+            rng_t & rng)
+    {
+        if (precision != precision_) {
+            std::vector<Group> temp;
+            temp.swap(groups());
+            fast_ = Fast();
+            compact_ = Compact();
+            precision_ = precision;
+            groups().swap(temp);
+        }
+        if (_compact()) {
+            compact_.init(shared, precision_, rng);
+        } else {
+            fast_.init(shared, rng);
+        }
+    }
+
+    void add_group (const Shared & shared, rng_t & rng)
+    {
+        if (_compact()) {
+            compact_.add_group(shared, rng);
+        } else {
+            fast_.add_group(shared, rng);
+        }
+    }
+
+    void remove_group (const Shared & shared, size_t groupid)
+    {
+        if (_compact()) {
+            compact_.remove_group(shared, groupid);
+        } else {
+            fast_.remove_group(shared, groupid);
+        }
+    }
+
+    void add_value (
+            const Shared & shared,
+            size_t groupid,
+            const Value & value,
+            rng_t & rng)
+    {
+        if (_compact()) {
+            compact_.add_value(shared, groupid, value, rng);
+        } else {
+            fast_.add_value(shared, groupid, value, rng);
+        }
+    }
+
+    void remove_value (
+            const Shared & shared,
+            size_t groupid,
+            const Value & value,
+            rng_t & rng)
+    {
+        if (_compact()) {
+            compact_.remove_value(shared, groupid, value, rng);
+        } else {
+            fast_.remove_value(shared, groupid, value, rng);
+        }
+    }
+
+    void score_value (
+            const Shared & shared,
+            const Value & value,
+            VectorFloat & scores_accum,
+            rng_t & rng) const
+    {
+        if (_compact()) {
+            compact_.score_value(shared, value, scores_accum, rng);
+        } else {
+            fast_.score_value(shared, value, scores_accum, rng);
+        }
+    }
+
+    float score_value_group (
+            const Shared & shared,
+            size_t groupid,
+            const Value & value,
+            rng_t & rng) const
+    {
+        return _compact()
+            ? compact_.score_value_group(shared, groupid, value, rng)
+            : fast_.score_value_group(shared, groupid, value, rng);
+    }
+
+    float score_data (const Shared & shared, rng_t & rng) const
+    {
+        return _compact()
+            ? compact_.score_data(shared, rng)
+            : fast_.score_data(shared, rng);
+    }
+
+    void score_data_grid (
+            const std::vector<Shared> & shareds,
+            VectorFloat & scores_out,
+            rng_t & rng) const
+    {
+        if (_compact()) {
+            compact_.score_data_grid(shareds, scores_out, rng);
+        } else {
+            fast_.score_data_grid(shareds, scores_out, rng);
+        }
+    }
+
+    void validate (const Shared & shared) const
+    {
+        if (_compact()) {
+            compact_.validate(shared);
+        } else {
+            fast_.validate(shared);
+        }
+    }
+
+private:
+
+    bool _compact () const { return precision_ != CachePrecision::FLOAT32; }
+
+    CachePrecision precision_;
+    Fast fast_;
+    Compact compact_;
+};
+
+// builds the cache of any cached mixture, in the given precision where the
+// mixture supports one
+template<class Mixture, class Shared>
+inline void init_cache (
+        Mixture & mixture,
+        const Shared & shared,
+        CachePrecision,
+        rng_t & rng)
+{
+    mixture.init(shared, rng);
+}
+
+template<class Model, class Compact, class Shared>
+inline void init_cache (
+        PrecisionMixture<Model, Compact> & mixture,
+        const Shared & shared,
+        CachePrecision precision,
+        rng_t & rng)
+{
+    mixture.init(shared, precision, rng);
+}
+
+} // namespace loom
@@ -32,6 +32,7 @@
 #include <loom/store.hpp>
 #include <loom/cross_cat.hpp>
 #include <loom/infer_grid.hpp>
+#include <loom/task_pool.hpp>
 
 namespace loom
 {
@@ -93,6 +94,8 @@ void CrossCat::model_load (const char * filename)
         }
 
         kind.model.load(message_kind.product_model(), ordered_featureids);
+        kind.model.score_cache_precision = score_cache_precision;
+        kind.model.score_tile_size = score_tile_size;
         schema += kind.model.schema;
     }
 
@@ -154,8 +157,7 @@ void CrossCat::mixture_load (
     const size_t feature_count = featureid_to_kindid.size();
     auto seed = rng();
 
-    #pragma omp parallel for schedule(dynamic, 1)
-    for (size_t kindid = 0; kindid < kind_count; ++kindid) {
+    parallel_for(0, kind_count, [&](size_t kindid){
         rng_t rng(seed + kindid);
         Kind & kind = kinds[kindid];
         std::string filename = store::get_mixture_path(dirname, kindid);
@@ -164,11 +166,10 @@ void CrossCat::mixture_load (
             kind.model,
             filename.c_str(),
             empty_group_count);
-    }
+    });
     seed += kind_count;
 
-    #pragma omp parallel for schedule(dynamic, 1)
-    for (size_t featureid = 0; featureid < feature_count; ++featureid) {
+    parallel_for(0, feature_count, [&](size_t featureid){
         rng_t rng(seed + featureid);
         size_t kindid = featureid_to_kindid[featureid];
         auto & kind = kinds[kindid];
@@ -177,16 +178,15 @@ void CrossCat::mixture_load (
             featureid,
             empty_group_count,
             rng);
-    }
+    });
     seed += feature_count;
 
     if (not tares.empty()) {
-        #pragma omp parallel for schedule(dynamic, 1)
-        for (size_t kindid = 0; kindid < kind_count; ++kindid) {
+        parallel_for(0, kind_count, [&](size_t kindid){
             rng_t rng(seed + kindid);
             auto & kind = kinds[kindid];
             kind.mixture.load_step_3_of_3(kind.model, rng);
-        }
+        });
     }
 
     for (size_t kindid = 0; kindid < kind_count; ++kindid) {
@@ -55,6 +55,15 @@ struct CrossCat : noncopyable
     distributions::Packed_<Kind> kinds;
     std::vector<uint32_t> featureid_to_kindid;
 
+    // copied to the model of each kind by model_load
+    CachePrecision score_cache_precision;
+    size_t score_tile_size;
+
+    CrossCat () :
+        score_cache_precision(CachePrecision::FLOAT32),
+        score_tile_size(256)
+    {}
+
     void model_load (const char * filename);
     void model_dump (const char * filename) const;
 
@@ -78,15 +87,16 @@ struct CrossCat : noncopyable
             std::vector<ProductValue *> & temp_values,
             rng_t & rng);
 
-    void simplify (std::vector<ProductValue::Diff> & partial_diffss) const;
+    template<class Diff>
+    void simplify (std::vector<Diff> & partial_diffs) const;
 
     float score_data (rng_t & rng) const;
 
     void validate () const;
 };
 
-inline void CrossCat::simplify (
-        std::vector<ProductValue::Diff> & partial_diffs) const
+template<class Diff>
+inline void CrossCat::simplify (std::vector<Diff> & partial_diffs) const
 {
     if (LOOM_DEBUG_LEVEL >= 1) {
         LOOM_ASSERT_EQ(partial_diffs.size(), kinds.size());
@@ -25,7 +25,9 @@
 // TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
 // USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
+#include <thread>
 #include <loom/differ.hpp>
+#include <loom/pipeline.hpp>
 
 namespace loom
 {
@@ -51,15 +53,24 @@ inline protobuf::ProductValue::Observed get_full (const ValueSchema & schema)
     }
     return observed;
 }
+
+// Rows are read by the caller, then parsed and processed by any worker.
+struct Task
+{
+    std::atomic_flag claimed;
+    bool valid;
+    protobuf::RawMessage raw;
+    std::vector<char> diff;
+
+    Task () : claimed(ATOMIC_FLAG_INIT), valid(false) {}
+};
 } // anonymous namespace
 
 Differ::Differ (const ValueSchema & schema) :
     schema_(schema),
     blank_(get_blank(schema)),
     full_(get_full(schema)),
-    row_count_(0),
-    booleans_(schema.booleans_size),
-    counts_(schema.counts_size),
+    summaries_(schema),
     small_tare_(),
     dense_tare_()
 {
@@ -72,9 +83,7 @@ Differ::Differ (
     schema_(schema),
     blank_(get_blank(schema)),
     full_(get_full(schema)),
-    row_count_(0),
-    booleans_(schema.booleans_size),
-    counts_(schema.counts_size),
+    summaries_(schema),
     small_tare_(),
     dense_tare_()
 {
@@ -90,36 +99,98 @@ void Differ::set_tare (const ProductValue & tare)
     schema_.normalize_dense(* dense_tare_.mutable_observed());
 }
 
-void Differ::add_rows (const char * rows_in)
+size_t Differ::_get_thread_count (size_t thread_count)
 {
-    protobuf::InFile rows(rows_in);
-    protobuf::Row row;
-    while (rows.try_read_stream(row)) {
-        LOOM_ASSERT(not row.diff().tares_size(), "row is already sparsified");
-        const auto & value = row.diff().pos();
-        LOOM_ASSERT_EQ(
-            value.observed().sparsity(),
-            ProductValue::Observed::DENSE);
-
-        auto observed = value.observed().dense().begin();
-        {
-            auto fields = value.booleans().begin();
-            for (auto & summary : booleans_) {
-                if (*observed++) {
-                    summary.add(*fields++);
-                }
+    if (thread_count == 0) {
+        thread_count = std::thread::hardware_concurrency();
+    }
+    return std::max<size_t>(1, thread_count);
+}
+
+void Differ::ColumnSummaries::add (const ProductValue & value)
+{
+    LOOM_ASSERT_EQ(
+        value.observed().sparsity(),
+        ProductValue::Observed::DENSE);
+
+    auto observed = value.observed().dense().begin();
+    {
+        auto fields = value.booleans().begin();
+        for (auto & summary : booleans) {
+            if (*observed++) {
+                summary.add(*fields++);
             }
         }
-        {
-            auto fields = value.counts().begin();
-            for (auto & summary : counts_) {
-                if (*observed++) {
-                    summary.add(*fields++);
-                }
+    }
+    {
+        auto fields = value.counts().begin();
+        for (auto & summary : counts) {
+            if (*observed++) {
+                summary.add(*fields++);
             }
         }
-        // do not sparsify reals
-        ++row_count_;
+    }
+    // do not sparsify reals
+    ++row_count;
+}
+
+void Differ::ColumnSummaries::merge (const ColumnSummaries & other)
+{
+    LOOM_ASSERT_EQ(booleans.size(), other.booleans.size());
+    LOOM_ASSERT_EQ(counts.size(), other.counts.size());
+    row_count += other.row_count;
+    for (size_t i = 0; i < booleans.size(); ++i) {
+        for (size_t v = 0; v < 2; ++v) {
+            booleans[i].counts[v] += other.booleans[i].counts[v];
+        }
+    }
+    for (size_t i = 0; i < counts.size(); ++i) {
+        for (size_t v = 0; v < CountSummary::max_count; ++v) {
+            counts[i].counts[v] += other.counts[i].counts[v];
+        }
+    }
+}
+
+// Each worker accumulates its own summaries, which are merged at the end.
+// Since summaries are counts, the tare does not depend on thread_count.
+void Differ::add_rows (const char * rows_in, size_t thread_count)
+{
+    thread_count = _get_thread_count(thread_count);
+    const ColumnSummaries empty(schema_);
+    std::vector<ColumnSummaries> partial(thread_count, empty);
+    protobuf::InFile rows(rows_in);
+    {
+        struct ThreadState { protobuf::Row row; };
+        Pipeline<Task, ThreadState> pipeline(queue_capacity, 1, spin_limit);
+        for (size_t i = 0; i < thread_count; ++i) {
+            ColumnSummaries & summaries = partial[i];
+            pipeline.unsafe_add_thread(0, ThreadState(),
+                [&summaries](Task & task, ThreadState & thread){
+                if (task.valid and not task.claimed.test_and_set()) {
+                    bool ok = thread.row.ParseFromArray(
+                        task.raw.data(),
+                        task.raw.size());
+                    LOOM_ASSERT(ok, "failed to parse row");
+                    LOOM_ASSERT(
+                        not thread.row.diff().tares_size(),
+                        "row is already sparsified");
+                    summaries.add(thread.row.diff().pos());
+                }
+            });
+        }
+        pipeline.validate();
+
+        for (bool valid = true; valid;) {
+            pipeline.start([&](Task & task){
+                task.claimed.clear();
+                valid = task.valid = rows.try_read_stream(task.raw);
+            });
+        }
+        pipeline.wait();
+    }
+
+    for (const auto & summaries : partial) {
+        summaries_.merge(summaries);
     }
 
     _make_tare();
@@ -131,8 +202,8 @@ void Differ::_make_tare ()
     auto & observed = * tare.mutable_observed();
     observed.set_sparsity(ProductValue::Observed::DENSE);
 
-    _make_tare_type(observed, booleans_, * tare.mutable_booleans());
-    _make_tare_type(observed, counts_, * tare.mutable_counts());
+    _make_tare_type(observed, summaries_.booleans, * tare.mutable_booleans());
+    _make_tare_type(observed, summaries_.counts, * tare.mutable_counts());
 
     size_t ignored = schema_.reals_size;
     for (size_t i = 0; i < ignored; ++i) {
@@ -153,39 +224,79 @@ inline void Differ::_compress (ProductValue::Diff & diff) const
     _compress(* diff.mutable_neg());
 }
 
+// This reads rows in the calling thread, compresses rows in worker threads,
+// and writes diffs in order in a single writer thread, so that output is
+// independent of thread_count.
 void Differ::compress_rows (
         const char * rows_in,
-        const char * diffs_out) const
+        const char * diffs_out,
+        size_t thread_count) const
 {
+    thread_count = _get_thread_count(thread_count);
     protobuf::InFile rows(rows_in);
     if (rows.is_file()) {
         LOOM_ASSERT(
             std::string(rows_in) != std::string(diffs_out),
             "in-place sparsify is not supported");
     }
-    protobuf::OutFile diffs(diffs_out);
-    protobuf::Row abs;
-    protobuf::Row rel;
-    ProductValue actual;
-    if (schema_.total_size(dense_tare_)) {
-        while (rows.try_read_stream(abs)) {
-            rel.set_id(abs.id());
-            ProductValue & data = * abs.mutable_diff()->mutable_pos();
-            ProductValue::Diff & diff = * rel.mutable_diff();
-            _abs_to_rel(data, diff);
-            _compress(* rel.mutable_diff());
-            diffs.write_stream(rel);
-            if (LOOM_DEBUG_LEVEL >= 3) {
-                _rel_to_abs(actual, diff);
-                LOOM_ASSERT_EQ(actual, data);
+    protobuf::OutFile diffs(diffs_out, protobuf::OutFile::INDEX);
+
+    struct ThreadState
+    {
+        protobuf::Row abs;
+        protobuf::Row rel;
+        ProductValue actual;
+    };
+    Pipeline<Task, ThreadState> pipeline(queue_capacity, 2, spin_limit);
+
+    // compress
+    const bool has_tare = schema_.total_size(dense_tare_);
+    for (size_t i = 0; i < thread_count; ++i) {
+        pipeline.unsafe_add_thread(0, ThreadState(),
+            [this, has_tare](Task & task, ThreadState & thread){
+            if (task.valid and not task.claimed.test_and_set()) {
+                protobuf::Row & abs = thread.abs;
+                bool ok = abs.ParseFromArray(task.raw.data(), task.raw.size());
+                LOOM_ASSERT(ok, "failed to parse row");
+                protobuf::Row * out = & abs;
+                if (has_tare) {
+                    protobuf::Row & rel = thread.rel;
+                    rel.set_id(abs.id());
+                    ProductValue & data = * abs.mutable_diff()->mutable_pos();
+                    ProductValue::Diff & diff = * rel.mutable_diff();
+                    _abs_to_rel(data, diff);
+                    _compress(diff);
+                    if (LOOM_DEBUG_LEVEL >= 3) {
+                        _rel_to_abs(thread.actual, diff);
+                        LOOM_ASSERT_EQ(thread.actual, data);
+                    }
+                    out = & rel;
+                } else {
+                    _compress(* abs.mutable_diff());
+                }
+                task.diff.resize(out->ByteSize());
+                out->SerializeWithCachedSizesToArray(
+                    reinterpret_cast<uint8_t *>(task.diff.data()));
             }
+        });
+    }
+
+    // write
+    pipeline.unsafe_add_thread(1, ThreadState(),
+        [&diffs](const Task & task, ThreadState &){
+        if (task.valid) {
+            diffs.write_stream(task.diff);
         }
-    } else {
-        while (rows.try_read_stream(abs)) {
-            _compress(* abs.mutable_diff());
-            diffs.write_stream(abs);
-        }
+    });
+    pipeline.validate();
+
+    for (bool valid = true; valid;) {
+        pipeline.start([&](Task & task){
+            task.claimed.clear();
+            valid = task.valid = rows.try_read_stream(task.raw);
+        });
     }
+    pipeline.wait();
 }
 
 template<class Summaries, class Values>
@@ -194,7 +305,7 @@ inline void Differ::_make_tare_type (
         const Summaries & summaries,
         Values & values) const
 {
-    const float count_threshold = 0.5 * row_count_;
+    const float count_threshold = 0.5 * summaries_.row_count;
     for (const auto & summary : summaries) {
         const auto mode = summary.get_mode();
         bool is_dense = (summary.get_count(mode) > count_threshold);
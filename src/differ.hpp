@@ -41,14 +41,20 @@ public:
     Differ (const ValueSchema & schema);
     Differ (const ValueSchema & schema, const ProductValue & tare);
 
-    void add_rows (const char * rows_in);
+    // thread_count = 0 uses all hardware threads
+    void add_rows (const char * rows_in, size_t thread_count = 0);
     const ProductValue & get_tare () const { return small_tare_; }
     void set_tare (const ProductValue & tare);
 
-    void compress_rows (const char * rows_in, const char * diffs_out) const;
+    void compress_rows (
+            const char * rows_in,
+            const char * diffs_out,
+            size_t thread_count = 0) const;
 
 private:
 
+    enum { queue_capacity = 256, spin_limit = 1024 };
+
     struct BooleanSummary
     {
         typedef bool Value;
@@ -94,6 +100,25 @@ private:
         }
     };
 
+    struct ColumnSummaries
+    {
+        size_t row_count;
+        std::vector<BooleanSummary> booleans;
+        std::vector<CountSummary> counts;
+
+        explicit ColumnSummaries (const ValueSchema & schema) :
+            row_count(0),
+            booleans(schema.booleans_size),
+            counts(schema.counts_size)
+        {
+        }
+
+        void add (const ProductValue & value);
+        void merge (const ColumnSummaries & other);
+    };
+
+    static size_t _get_thread_count (size_t thread_count);
+
     void _make_tare ();
 
     template<class Summaries, class Values>
@@ -129,9 +154,7 @@ private:
     const ValueSchema & schema_;
     const protobuf::ProductValue blank_;
     const protobuf::ProductValue::Observed full_;
-    size_t row_count_;
-    std::vector<BooleanSummary> booleans_;
-    std::vector<CountSummary> counts_;
+    ColumnSummaries summaries_;
     protobuf::ProductValue small_tare_;
     protobuf::ProductValue dense_tare_;
 };
@@ -0,0 +1,502 @@
+// Copyright (c) 2014, Salesforce.com, Inc.  All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// - Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+// - Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+// - Neither the name of Salesforce.com nor the names of its contributors
+//   may be used to endorse or promote products derived from this
+//   software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+// FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+// COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+// BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+// OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+// TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#pragma once
+
+#include <vector>
+#include <cstring>
+#include <loom/common.hpp>
+#include <loom/protobuf.hpp>
+
+namespace loom
+{
+
+//----------------------------------------------------------------------------
+// Flat Values
+//
+// FlatValue, FlatDiff and FlatRow mirror the read accessors of
+// protobuf::ProductValue, ProductValue::Diff and Row, but store fields in
+// reusable std::vectors and are parsed by a specialized wire decoder.
+// They are used in the cat kernel hot loop, where generic protobuf
+// parsing and repeated-field churn dominate.
+
+class FlatValue
+{
+public:
+
+    typedef protobuf::ProductValue::Observed::Sparsity Sparsity;
+
+    class Observed
+    {
+    public:
+
+        Observed () : sparsity_(protobuf::ProductValue::Observed::NONE) {}
+
+        Sparsity sparsity () const { return sparsity_; }
+        const std::vector<uint8_t> & dense () const { return dense_; }
+        const std::vector<uint32_t> & sparse () const { return sparse_; }
+        bool dense (size_t i) const { return dense_[i]; }
+        uint32_t sparse (size_t i) const { return sparse_[i]; }
+        size_t dense_size () const { return dense_.size(); }
+        size_t sparse_size () const { return sparse_.size(); }
+
+        void set_sparsity (Sparsity sparsity) { sparsity_ = sparsity; }
+        std::vector<uint8_t> * mutable_dense () { return & dense_; }
+        std::vector<uint32_t> * mutable_sparse () { return & sparse_; }
+
+        void clear (Sparsity sparsity)
+        {
+            sparsity_ = sparsity;
+            dense_.clear();
+            sparse_.clear();
+        }
+
+    private:
+
+        friend class FlatDecoder;
+
+        Sparsity sparsity_;
+        std::vector<uint8_t> dense_;
+        std::vector<uint32_t> sparse_;
+    };
+
+    const Observed & observed () const { return observed_; }
+    const std::vector<uint8_t> & booleans () const { return booleans_; }
+    const std::vector<uint32_t> & counts () const { return counts_; }
+    const std::vector<float> & reals () const { return reals_; }
+    size_t booleans_size () const { return booleans_.size(); }
+    size_t counts_size () const { return counts_.size(); }
+    size_t reals_size () const { return reals_.size(); }
+
+    Observed * mutable_observed () { return & observed_; }
+    std::vector<uint8_t> * mutable_booleans () { return & booleans_; }
+    std::vector<uint32_t> * mutable_counts () { return & counts_; }
+    std::vector<float> * mutable_reals () { return & reals_; }
+
+    void clear (Sparsity sparsity = protobuf::ProductValue::Observed::NONE)
+    {
+        observed_.clear(sparsity);
+        booleans_.clear();
+        counts_.clear();
+        reals_.clear();
+    }
+
+    void dump (protobuf::ProductValue & value) const
+    {
+        auto & observed = * value.mutable_observed();
+        observed.set_sparsity(observed_.sparsity());
+        observed.clear_dense();
+        for (auto i : observed_.dense()) {
+            observed.add_dense(i);
+        }
+        observed.clear_sparse();
+        for (auto i : observed_.sparse()) {
+            observed.add_sparse(i);
+        }
+        value.clear_booleans();
+        for (auto i : booleans_) {
+            value.add_booleans(i);
+        }
+        value.clear_counts();
+        for (auto i : counts_) {
+            value.add_counts(i);
+        }
+        value.clear_reals();
+        for (auto i : reals_) {
+            value.add_reals(i);
+        }
+    }
+
+private:
+
+    friend class FlatDecoder;
+
+    Observed observed_;
+    std::vector<uint8_t> booleans_;
+    std::vector<uint32_t> counts_;
+    std::vector<float> reals_;
+};
+
+class FlatDiff
+{
+public:
+
+    const FlatValue & pos () const { return pos_; }
+    const FlatValue & neg () const { return neg_; }
+    const std::vector<uint32_t> & tares () const { return tares_; }
+    size_t tares_size () const { return tares_.size(); }
+
+    FlatValue * mutable_pos () { return & pos_; }
+    FlatValue * mutable_neg () { return & neg_; }
+    std::vector<uint32_t> * mutable_tares () { return & tares_; }
+
+    void clear ()
+    {
+        pos_.clear();
+        neg_.clear();
+        tares_.clear();
+    }
+
+    void dump (protobuf::ProductValue::Diff & diff) const
+    {
+        pos_.dump(* diff.mutable_pos());
+        neg_.dump(* diff.mutable_neg());
+        diff.clear_tares();
+        for (auto i : tares_) {
+            diff.add_tares(i);
+        }
+    }
+
+private:
+
+    friend class FlatDecoder;
+
+    FlatValue pos_;
+    FlatValue neg_;
+    std::vector<uint32_t> tares_;
+};
+
+class FlatRow
+{
+public:
+
+    FlatRow () : id_(0) {}
+
+    uint64_t id () const { return id_; }
+    const FlatDiff & diff () const { return diff_; }
+
+    void set_id (uint64_t id) { id_ = id; }
+    FlatDiff * mutable_diff () { return & diff_; }
+
+    // this reuses storage from previous rows
+    bool ParseFromArray (const void * data, size_t size);
+
+    void dump (protobuf::Row & row) const
+    {
+        row.set_id(id_);
+        diff_.dump(* row.mutable_diff());
+    }
+
+private:
+
+    friend class FlatDecoder;
+
+    uint64_t id_;
+    FlatDiff diff_;
+};
+
+//----------------------------------------------------------------------------
+// Flat Decoder
+//
+// This decodes the protobuf wire format of Row directly into a FlatRow,
+// accepting both packed and unpacked repeated fields and skipping
+// unknown fields.  Any malformed input makes the decoder fail.
+
+namespace flat_wire
+{
+
+enum Type
+{
+    VARINT = 0,
+    FIXED64 = 1,
+    LENGTH_DELIMITED = 2,
+    FIXED32 = 5
+};
+
+constexpr uint32_t tag (uint32_t field, Type type)
+{
+    return (field << 3) | type;
+}
+
+} // namespace flat_wire
+
+class FlatDecoder
+{
+    typedef flat_wire::Type Type;
+    static constexpr Type VARINT = flat_wire::VARINT;
+    static constexpr Type FIXED64 = flat_wire::FIXED64;
+    static constexpr Type LENGTH_DELIMITED = flat_wire::LENGTH_DELIMITED;
+    static constexpr Type FIXED32 = flat_wire::FIXED32;
+
+public:
+
+    FlatDecoder (const void * data, size_t size) :
+        pos_(static_cast<const uint8_t *>(data)),
+        end_(pos_ + size),
+        ok_(true)
+    {
+    }
+
+    bool ok () const { return ok_; }
+    bool done () const { return pos_ == end_; }
+
+    bool read (FlatRow & row)
+    {
+        bool has_id = false;
+        bool has_diff = false;
+        row.diff_.clear();
+        while (ok_ and not done()) {
+            const uint32_t tag = _read_varint();
+            switch (tag) {
+                case flat_wire::tag(1, VARINT):
+                    row.id_ = _read_varint();
+                    has_id = true;
+                    break;
+
+                case flat_wire::tag(2, LENGTH_DELIMITED):
+                    _fail_unless(_delimited().read(row.diff_));
+                    has_diff = true;
+                    break;
+
+                default:
+                    _skip(tag);
+            }
+        }
+        return ok_ and has_id and has_diff;
+    }
+
+    bool read (FlatDiff & diff)
+    {
+        bool has_pos = false;
+        bool has_neg = false;
+        while (ok_ and not done()) {
+            const uint32_t tag = _read_varint();
+            switch (tag) {
+                case flat_wire::tag(1, LENGTH_DELIMITED):
+                    _fail_unless(_delimited().read(diff.pos_));
+                    has_pos = true;
+                    break;
+
+                case flat_wire::tag(2, LENGTH_DELIMITED):
+                    _fail_unless(_delimited().read(diff.neg_));
+                    has_neg = true;
+                    break;
+
+                case flat_wire::tag(3, VARINT):
+                case flat_wire::tag(3, LENGTH_DELIMITED):
+                    _read_varints(tag, diff.tares_);
+                    break;
+
+                default:
+                    _skip(tag);
+            }
+        }
+        return ok_ and has_pos and has_neg;
+    }
+
+    bool read (FlatValue & value)
+    {
+        bool has_observed = false;
+        while (ok_ and not done()) {
+            const uint32_t tag = _read_varint();
+            switch (tag) {
+                case flat_wire::tag(1, LENGTH_DELIMITED):
+                    _fail_unless(_delimited().read(value.observed_));
+                    has_observed = true;
+                    break;
+
+                case flat_wire::tag(2, VARINT):
+                case flat_wire::tag(2, LENGTH_DELIMITED):
+                    _read_varints(tag, value.booleans_);
+                    break;
+
+                case flat_wire::tag(3, VARINT):
+                case flat_wire::tag(3, LENGTH_DELIMITED):
+                    _read_varints(tag, value.counts_);
+                    break;
+
+                case flat_wire::tag(4, FIXED32):
+                case flat_wire::tag(4, LENGTH_DELIMITED):
+                    _read_floats(tag, value.reals_);
+                    break;
+
+                default:
+                    _skip(tag);
+            }
+        }
+        return ok_ and has_observed;
+    }
+
+    bool read (FlatValue::Observed & observed)
+    {
+        bool has_sparsity = false;
+        while (ok_ and not done()) {
+            const uint32_t tag = _read_varint();
+            switch (tag) {
+                case flat_wire::tag(1, VARINT): {
+                    const uint64_t sparsity = _read_varint();
+                    _fail_unless(
+                        sparsity <= protobuf::ProductValue::Observed::ALL and
+                        protobuf::ProductValue::Observed::Sparsity_IsValid(
+                            static_cast<int>(sparsity)));
+                    observed.sparsity_ = static_cast<FlatValue::Sparsity>(
+                        sparsity);
+                    has_sparsity = true;
+                } break;
+
+                case flat_wire::tag(2, VARINT):
+                case flat_wire::tag(2, LENGTH_DELIMITED):
+                    _read_varints(tag, observed.dense_);
+                    break;
+
+                case flat_wire::tag(3, VARINT):
+                case flat_wire::tag(3, LENGTH_DELIMITED):
+                    _read_varints(tag, observed.sparse_);
+                    break;
+
+                default:
+                    _skip(tag);
+            }
+        }
+        return ok_ and has_sparsity;
+    }
+
+private:
+
+    FlatDecoder (const uint8_t * begin, const uint8_t * end, bool ok) :
+        pos_(begin),
+        end_(end),
+        ok_(ok)
+    {
+    }
+
+    void _fail_unless (bool cond)
+    {
+        if (LOOM_UNLIKELY(not cond)) {
+            ok_ = false;
+            pos_ = end_;
+        }
+    }
+
+    uint64_t _read_varint ()
+    {
+        uint64_t result = 0;
+        for (size_t shift = 0; shift < 64; shift += 7) {
+            if (LOOM_UNLIKELY(pos_ == end_)) {
+                break;
+            }
+            const uint8_t byte = * pos_++;
+            result |= uint64_t(byte & 0x7f) << shift;
+            if (LOOM_LIKELY(byte < 0x80)) {
+                return result;
+            }
+        }
+        _fail_unless(false);
+        return 0;
+    }
+
+    float _read_float ()
+    {
+        float result = 0;
+        if (LOOM_LIKELY(end_ - pos_ >= 4)) {
+            // the wire format is little-endian, as are supported hosts
+            memcpy(& result, pos_, 4);
+            pos_ += 4;
+        } else {
+            _fail_unless(false);
+        }
+        return result;
+    }
+
+    FlatDecoder _delimited ()
+    {
+        const uint64_t size = _read_varint();
+        if (LOOM_UNLIKELY(not ok_ or size > uint64_t(end_ - pos_))) {
+            _fail_unless(false);
+            return FlatDecoder(end_, end_, false);
+        }
+        const uint8_t * begin = pos_;
+        pos_ += size;
+        return FlatDecoder(begin, pos_, true);
+    }
+
+    template<class T>
+    void _read_varints (uint32_t tag, std::vector<T> & values)
+    {
+        if ((tag & 7) == LENGTH_DELIMITED) {
+            FlatDecoder packed = _delimited();
+            while (packed.ok_ and not packed.done()) {
+                values.push_back(static_cast<T>(packed._read_varint()));
+            }
+            _fail_unless(packed.ok_);
+        } else {
+            values.push_back(static_cast<T>(_read_varint()));
+        }
+    }
+
+    void _read_floats (uint32_t tag, std::vector<float> & values)
+    {
+        if ((tag & 7) == LENGTH_DELIMITED) {
+            FlatDecoder packed = _delimited();
+            _fail_unless(packed.ok_ and (packed.end_ - packed.pos_) % 4 == 0);
+            values.reserve(values.size() + (packed.end_ - packed.pos_) / 4);
+            while (packed.ok_ and not packed.done()) {
+                values.push_back(packed._read_float());
+            }
+        } else {
+            values.push_back(_read_float());
+        }
+    }
+
+    void _skip (uint32_t tag)
+    {
+        switch (tag & 7) {
+            case VARINT:
+                _read_varint();
+                break;
+
+            case FIXED64:
+                _fail_unless(end_ - pos_ >= 8);
+                pos_ += ok_ ? 8 : 0;
+                break;
+
+            case LENGTH_DELIMITED:
+                _delimited();
+                break;
+
+            case FIXED32:
+                _fail_unless(end_ - pos_ >= 4);
+                pos_ += ok_ ? 4 : 0;
+                break;
+
+            default:
+                _fail_unless(false);
+        }
+    }
+
+    const uint8_t * pos_;
+    const uint8_t * end_;
+    bool ok_;
+};
+
+inline bool FlatRow::ParseFromArray (const void * data, size_t size)
+{
+    return FlatDecoder(data, size).read(* this);
+}
+
+} // namespace loom
@@ -0,0 +1,114 @@
+// Copyright (c) 2014, Salesforce.com, Inc.  All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// - Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+// - Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+// - Neither the name of Salesforce.com nor the names of its contributors
+//   may be used to endorse or promote products derived from this
+//   software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+// FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+// COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+// BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+// OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+// TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+// IEEE 754 binary16 and bfloat16 values, stored as raw uint16_t so that
+// arrays of them can be converted inside auto-vectorized loops.
+
+namespace loom
+{
+
+inline uint32_t float_bits (float value)
+{
+    uint32_t bits;
+    std::memcpy(& bits, & value, sizeof(bits));
+    return bits;
+}
+
+inline float bits_float (uint32_t bits)
+{
+    float value;
+    std::memcpy(& value, & bits, sizeof(value));
+    return value;
+}
+
+// rounds to nearest even; overflows to infinity
+inline uint16_t float_to_half (float value)
+{
+    const uint32_t f16_max = (127 + 16) << 23;
+    const uint32_t f32_infinity = 255 << 23;
+    const uint32_t denorm_magic = ((127 - 15) + (23 - 10) + 1) << 23;
+
+    uint32_t bits = float_bits(value);
+    const uint32_t sign = bits & 0x80000000u;
+    bits ^= sign;
+
+    uint32_t half;
+    if (bits >= f16_max) {
+        half = bits > f32_infinity ? 0x7e00 : 0x7c00;
+    } else if (bits < (113u << 23)) {
+        const float shifted = bits_float(bits) + bits_float(denorm_magic);
+        half = float_bits(shifted) - denorm_magic;
+    } else {
+        const uint32_t mantissa_odd = (bits >> 13) & 1;
+        bits += (uint32_t(15 - 127) << 23) + 0xfff + mantissa_odd;
+        half = bits >> 13;
+    }
+    return half | (sign >> 16);
+}
+
+// branch-free, so that loops over arrays of halves vectorize;
+// subnormals are converted through integers, since -ffast-math flushes
+// subnormal floats to zero
+inline float half_to_float (uint16_t half)
+{
+    const uint32_t sign = uint32_t(half & 0x8000) << 16;
+    const uint32_t exponent_mantissa = half & 0x7fff;
+    const uint32_t normal = (exponent_mantissa << 13) + ((127 - 15) << 23);
+    const uint32_t special = 0x7f800000u | (exponent_mantissa << 13);
+    const float two_pow_minus_24 = 5.9604644775390625e-8f;
+    const float subnormal =
+        float(int32_t(exponent_mantissa)) * two_pow_minus_24;
+    const uint32_t bits =
+        exponent_mantissa < 0x0400 ? float_bits(subnormal) :
+        exponent_mantissa < 0x7c00 ? normal :
+        special;
+    return bits_float(bits | sign);
+}
+
+// bfloat16 keeps the float exponent and the top 7 mantissa bits;
+// rounds to nearest even and keeps nans quiet
+inline uint16_t float_to_bfloat16 (float value)
+{
+    const uint32_t bits = float_bits(value);
+    if ((bits & 0x7fffffffu) > 0x7f800000u) {
+        return (bits >> 16) | 0x0040;
+    }
+    const uint32_t rounding = 0x7fff + ((bits >> 16) & 1);
+    return (bits + rounding) >> 16;
+}
+
+inline float bfloat16_to_float (uint16_t value)
+{
+    return bits_float(uint32_t(value) << 16);
+}
+
+} // namespace loom
@@ -48,7 +48,7 @@ void generate_rows (
     VectorFloat scores;
     std::vector<ProductModel::Value> partial_values(kind_count);
     protobuf::Row row;
-    protobuf::OutFile rows(rows_out);
+    protobuf::OutFile rows(rows_out, protobuf::OutFile::INDEX);
 
     for (auto & kind : cross_cat.kinds) {
         kind.model.realize(rng);
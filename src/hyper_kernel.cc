@@ -29,6 +29,7 @@
 #include <loom/infer_grid.hpp>
 #include <loom/hyper_kernel.hpp>
 #include <loom/hyper_prior.hpp>
+#include <loom/task_pool.hpp>
 
 namespace loom
 {
@@ -71,6 +72,7 @@ struct HyperKernel::infer_feature_hypers_fun
 {
     const HyperPrior & hyper_prior;
     ProductMixture::Features & mixtures;
+    const CachePrecision precision;
     rng_t & rng;
 
     template<class T>
@@ -81,7 +83,7 @@ struct HyperKernel::infer_feature_hypers_fun
         InferShared<Mixture> infer_shared(shared, mixture, rng);
         const auto & grid_prior = protobuf::Fields<T>::get(hyper_prior);
         for_each_gridpoint(grid_prior, infer_shared);
-        mixture.init(shared, rng);
+        init_cache(mixture, shared, precision, rng);
     }
 
     void operator() (DPD * t, size_t i, DPD::Shared & shared);
@@ -169,7 +171,7 @@ void HyperKernel::infer_feature_hypers_fun::operator() (
 
         // grid gibbs alpha | beta0, betas, gamma
         if (grid_prior.alpha_size()) {
-            mixture.init(shared, rng);
+            init_cache(mixture, shared, precision, rng);
             for (auto alpha : grid_prior.alpha()) {
                 infer_shared.add().alpha = alpha;
             }
@@ -177,7 +179,7 @@ void HyperKernel::infer_feature_hypers_fun::operator() (
         }
     }
 
-    mixture.init(shared, rng);
+    init_cache(mixture, shared, precision, rng);
 }
 
 inline void HyperKernel::infer_feature_hypers (
@@ -187,51 +189,65 @@ inline void HyperKernel::infer_feature_hypers (
         size_t featureid,
         rng_t & rng)
 {
-    infer_feature_hypers_fun fun = {hyper_prior, mixture.features, rng};
+    infer_feature_hypers_fun fun = {
+        hyper_prior,
+        mixture.features,
+        model.score_cache_precision,
+        rng};
     for_one_feature(fun, model.features, featureid);
     mixture.maintaining_cache = true;
 }
 
-void HyperKernel::run (rng_t & rng)
+// Each kind's hypers form one task, with its features' hypers as nested
+// tasks, so that on_kind can start work on a finished kind while other
+// kinds are still running.  Seeds do not depend on this grouping.
+void HyperKernel::run (rng_t & rng, const OnKind & on_kind)
 {
     Timer::Scope timer(timer_);
     LOOM_ASSERT(run_, "hyper kernel should not be run");
 
     const size_t kind_count = cross_cat_.kinds.size();
-    const size_t feature_count = cross_cat_.featureid_to_kindid.size();
-    const size_t task_count = 1 + kind_count + feature_count;
+    const size_t task_count = 1 + kind_count;
     const auto seed = rng();
 
-    #pragma omp parallel for if(parallel_) schedule(dynamic, 1)
-    for (size_t taskid = 0; taskid < task_count; ++taskid) {
-        rng_t rng(seed + taskid);
+    parallel_for(0, task_count, [&](size_t taskid){
         if (taskid == 0) {
 
+            rng_t rng(seed);
             infer_topology_hypers(cross_cat_.hyper_prior.topology(), rng);
 
-        } else if (taskid < 1 + kind_count) {
+        } else {
 
             size_t kindid = taskid - 1;
             auto & kind = cross_cat_.kinds[kindid];
-            infer_clustering_hypers(
-                kind.model,
-                kind.mixture,
-                cross_cat_.hyper_prior,
-                rng);
-
-        } else {
+            {
+                rng_t rng(seed + taskid);
+                infer_clustering_hypers(
+                    kind.model,
+                    kind.mixture,
+                    cross_cat_.hyper_prior,
+                    rng);
+            }
 
-            size_t featureid = taskid - 1 - kind_count;
-            size_t kindid = cross_cat_.featureid_to_kindid[featureid];
-            auto & kind = cross_cat_.kinds[kindid];
-            infer_feature_hypers(
-                kind.model,
-                kind.mixture,
-                cross_cat_.hyper_prior,
-                featureid,
-                rng);
+            const std::vector<size_t> featureids(
+                kind.featureids.begin(),
+                kind.featureids.end());
+            parallel_for(0, featureids.size(), [&](size_t i){
+                size_t featureid = featureids[i];
+                rng_t rng(seed + 1 + kind_count + featureid);
+                infer_feature_hypers(
+                    kind.model,
+                    kind.mixture,
+                    cross_cat_.hyper_prior,
+                    featureid,
+                    rng);
+            }, parallel_);
+
+            if (on_kind) {
+                on_kind(kindid);
+            }
         }
-    }
+    }, parallel_);
 }
 
 } // namespace loom
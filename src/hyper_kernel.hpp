@@ -27,6 +27,7 @@
 
 #pragma once
 
+#include <functional>
 #include <loom/cross_cat.hpp>
 #include <loom/timer.hpp>
 #include <loom/logger.hpp>
@@ -56,15 +57,21 @@ public:
     {
     }
 
-    bool try_run (rng_t & rng)
+    // on_kind(kindid) is called as soon as the hypers of that kind are done,
+    // possibly while other kinds' hypers are still being inferred
+    typedef std::function<void(size_t kindid)> OnKind;
+
+    bool enabled () const { return run_; }
+
+    bool try_run (rng_t & rng, const OnKind & on_kind = OnKind())
     {
         if (run_) {
-            run(rng);
+            run(rng, on_kind);
         }
         return run_;
     }
 
-    void run (rng_t & rng);
+    void run (rng_t & rng, const OnKind & on_kind = OnKind());
 
     void log_metrics (Logger::Message & message);
 
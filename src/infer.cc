@@ -56,6 +56,8 @@ const char * help_message =
 "\n                    or --none to not log"
 "\nNotes:"
 "\n  Any filename can end with .gz to indicate gzip compression."
+"\n  Row streams can end with .bgz to indicate block gzip compression."
+"\n  Row streams can end with .zst or .lz4 if loom was built with those codecs."
 "\n  Any filename can be '-' or '-.gz' to indicate stdin/stdout."
 "\n  If running kind inference and GROUPS_IN is provided,"
 "\n    then all data in groups must be accounted for in ASSIGN_IN."
@@ -27,6 +27,7 @@
 
 #include <loom/kind_kernel.hpp>
 #include <loom/infer_grid.hpp>
+#include <loom/task_pool.hpp>
 
 namespace loom
 {
@@ -162,6 +163,8 @@ void KindKernel::add_featureless_kind (bool maintaining_cache)
     auto & model = kind.model;
     auto & mixture = kind.mixture;
     model.clear();
+    model.score_cache_precision = cross_cat_.score_cache_precision;
+    model.score_tile_size = cross_cat_.score_tile_size;
     mixture.maintaining_cache = maintaining_cache;
 
     const auto & grid_prior = cross_cat_.hyper_prior.clustering();
@@ -275,8 +278,7 @@ void KindKernel::init_cache ()
         const size_t task_count = feature_count + feature_count;
         const auto seed = rng_();
 
-        #pragma omp parallel for if(score_parallel_) schedule(dynamic, 1)
-        for (size_t taskid = 0; taskid < task_count; ++taskid) {
+        parallel_for(0, task_count, [&](size_t taskid){
             rng_t rng(seed + taskid);
             if (taskid < feature_count) {
                 size_t featureid = taskid;
@@ -289,15 +291,14 @@ void KindKernel::init_cache ()
                 auto & kind = kind_proposer_.kinds[kindid];
                 kind.mixture.init_feature_cache(kind.model, featureid, rng);
             }
-        }
+        }, score_parallel_);
     }
 
     if (not cross_cat_.tares.empty()) {
         const size_t task_count = kind_count + kind_count;
         const auto seed = rng_();
 
-        #pragma omp parallel for if(score_parallel_) schedule(dynamic, 1)
-        for (size_t taskid = 0; taskid < task_count; ++taskid) {
+        parallel_for(0, task_count, [&](size_t taskid){
             rng_t rng(seed + taskid);
             if (taskid < kind_count) {
                 size_t kindid = taskid;
@@ -308,7 +309,53 @@ void KindKernel::init_cache ()
                 auto & kind = kind_proposer_.kinds[kindid];
                 kind.mixture.init_tare_cache(kind.model, rng);
             }
+        }, score_parallel_);
+    }
+
+    validate();
+}
+
+void KindKernel::try_run_hypers_and_init_cache (
+        HyperKernel & hyper_kernel,
+        rng_t & rng)
+{
+    LOOM_ASSERT1(not kind_proposer_.kinds.empty(), "kind_proposer is empty");
+
+    // as in init_cache, hypers of the first kind decide whether feature
+    // caches need initializing; if so, nothing can overlap the hypers
+    const auto & first_kind = cross_cat_.kinds[0];
+    if (not hyper_kernel.enabled() or
+        not (first_kind.mixture.maintaining_cache or
+             not first_kind.featureids.empty()))
+    {
+        hyper_kernel.try_run(rng);
+        init_cache();
+        return;
+    }
+
+    const size_t kind_count = cross_cat_.kinds.size();
+    const bool has_tares = not cross_cat_.tares.empty();
+    const auto seed = has_tares ? rng_() : 0;
+
+    hyper_kernel.run(rng, [&](size_t kindid){
+        auto & kind = cross_cat_.kinds[kindid];
+        kind.mixture.maintaining_cache = true;
+        if (has_tares) {
+            rng_t rng(seed + kindid);
+            kind.mixture.init_tare_cache(kind.model, rng);
         }
+    });
+
+    kind_proposer_.model_load(cross_cat_);
+    for (auto & kind : kind_proposer_.kinds) {
+        kind.mixture.maintaining_cache = true;
+    }
+    if (has_tares) {
+        parallel_for(0, kind_count, [&](size_t kindid){
+            rng_t rng(seed + kind_count + kindid);
+            auto & kind = kind_proposer_.kinds[kindid];
+            kind.mixture.init_tare_cache(kind.model, rng);
+        }, score_parallel_);
     }
 
     validate();
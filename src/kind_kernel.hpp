@@ -29,8 +29,10 @@
 
 #include <thread>
 #include <loom/cross_cat.hpp>
+#include <loom/cat_kernel.hpp>
 #include <loom/assignments.hpp>
 #include <loom/kind_proposer.hpp>
+#include <loom/hyper_kernel.hpp>
 #include <loom/pipeline.hpp>
 #include <loom/timer.hpp>
 #include <loom/logger.hpp>
@@ -54,24 +56,34 @@ public:
     void remove_row (const protobuf::Row & row);
     bool try_run ();
     void init_cache ();
+
+    // This is equivalent to hyper_kernel.try_run(rng) then init_cache(),
+    // but initializes each kind's tare cache as soon as its hypers are done.
+    void try_run_hypers_and_init_cache (
+            HyperKernel & hyper_kernel,
+            rng_t & rng);
     void validate () const;
     void log_metrics (Logger::Message & message);
 
+    // Diff is either ProductValue::Diff or FlatDiff
+    template<class Diff>
     size_t add_to_cross_cat (
             size_t kindid,
-            const ProductValue::Diff & partial_diff,
+            const Diff & partial_diff,
             VectorFloat & scores,
             rng_t & rng);
 
+    template<class Diff>
     void add_to_kind_proposer (
             size_t kindid,
             size_t groupid,
-            const ProductValue::Diff & diff,
+            const Diff & diff,
             rng_t & rng);
 
+    template<class Diff>
     size_t remove_from_cross_cat (
             size_t kindid,
-            const ProductValue::Diff & partial_diff,
+            const Diff & partial_diff,
             rng_t & rng);
 
     void remove_from_kind_proposer (
@@ -161,9 +173,10 @@ inline void KindKernel::add_row (const protobuf::Row & row)
     }
 }
 
+template<class Diff>
 inline size_t KindKernel::add_to_cross_cat (
         size_t kindid,
-        const ProductValue::Diff & partial_diff,
+        const Diff & partial_diff,
         VectorFloat & scores,
         rng_t & rng)
 {
@@ -177,12 +190,12 @@ inline size_t KindKernel::add_to_cross_cat (
         auto & value = partial_diff.pos();
         model.add_value(value, rng);
         mixture.score_value(model, value, scores, rng);
-        groupid = sample_from_scores_overwrite(rng, scores);
+        groupid = sample_groupid(rng, scores);
         mixture.add_value(model, groupid, value, rng);
     } else {
         model.add_diff(partial_diff, rng);
         mixture.score_diff(model, partial_diff, scores, rng);
-        groupid = sample_from_scores_overwrite(rng, scores);
+        groupid = sample_groupid(rng, scores);
         mixture.add_diff(model, groupid, partial_diff, rng);
     }
     size_t global_groupid = mixture.id_tracker.packed_to_global(groupid);
@@ -190,10 +203,11 @@ inline size_t KindKernel::add_to_cross_cat (
     return groupid;
 }
 
+template<class Diff>
 inline void KindKernel::add_to_kind_proposer (
         size_t kindid,
         size_t groupid,
-        const ProductValue::Diff & diff,
+        const Diff & diff,
         rng_t & rng)
 {
     LOOM_ASSERT3(kindid < cross_cat_.kinds.size(), "bad kindid: " << kindid);
@@ -235,9 +249,10 @@ inline void KindKernel::remove_row (const protobuf::Row & row)
     }
 }
 
+template<class Diff>
 inline size_t KindKernel::remove_from_cross_cat (
         size_t kindid,
-        const ProductValue::Diff & partial_diff,
+        const Diff & partial_diff,
         rng_t & rng)
 {
     LOOM_ASSERT3(kindid < cross_cat_.kinds.size(), "bad kindid: " << kindid);
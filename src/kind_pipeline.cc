@@ -37,12 +37,18 @@ KindPipeline::KindPipeline (
         Assignments & assignments,
         KindKernel & kind_kernel,
         rng_t & rng) :
-    pipeline_(config.row_queue_capacity(), stage_count),
+    batch_size_(std::max<size_t>(1, config.batch_size())),
+    pending_(),
+    kind_threads_(config.kind_threads()),
+    numa_(config.numa_pinning() ? new NumaTopology() : nullptr),
+    pipeline_(config.row_queue_capacity(), stage_count, config.spin_limit()),
+    scheduler_(),
+    kind_rngs_(),
+    kind_nodes_(),
     cross_cat_(cross_cat),
     rows_(rows),
     assignments_(assignments),
     kind_kernel_(kind_kernel),
-    kind_count_(0),
     rng_(rng)
 {
     start_threads(config.parser_threads());
@@ -55,33 +61,72 @@ inline void KindPipeline::add_thread (
 {
     ThreadState thread;
     thread.rng.seed(rng_());
-    pipeline_.unsafe_add_thread(stage_number, thread, fun);
+    int cpu;
+    place_thread(cpu);
+    pipeline_.unsafe_add_thread(stage_number, thread, fun, cpu);
+}
+
+// returns the thread's NUMA node, or -1 if threads are not pinned
+inline int KindPipeline::place_thread (int & cpu)
+{
+    cpu = -1;
+    return numa_ ? static_cast<int>(numa_->place_thread(cpu)) : -1;
+}
+
+// Called by the kind's owning thread, so that its memory becomes local.
+// The model schema is read by parser threads, so only features move.
+void KindPipeline::relocate_kind (size_t kindid)
+{
+    auto & kind = cross_cat_.kinds[kindid];
+    relocate_to_current_node(kind.model.features);
+    relocate_to_current_node(kind.mixture);
+    relocate_to_current_node(assignments_.groupids(kindid));
 }
 
 void KindPipeline::start_threads (size_t parser_threads)
 {
-    // unzip
-    add_thread(0, [this](Task & task, const ThreadState &){
-        if (task.add) {
-            task.parsed.clear();
-            rows_.read_unassigned(task.raw);
+    // unzip, and decode columnar rows
+    const bool columnar = rows_.is_columnar();
+    add_thread(0, [this, columnar](Task & task, const ThreadState &){
+        for (auto & item : task.items) {
+            if (item.add) {
+                if (columnar) {
+                    rows_.read_unassigned(item.row);
+                } else {
+                    rows_.read_unassigned(item.raw);
+                }
+            }
         }
     });
-    add_thread(0, [this](Task & task, const ThreadState &){
-        if (not task.add) {
-            task.parsed.clear();
-            rows_.read_assigned(task.raw);
+    add_thread(0, [this, columnar](Task & task, const ThreadState &){
+        for (auto & item : task.items) {
+            if (not item.add) {
+                if (columnar) {
+                    rows_.read_assigned(item.row);
+                } else {
+                    rows_.read_assigned(item.raw);
+                }
+            }
         }
     });
 
     // parse
     LOOM_ASSERT_LT(0, parser_threads);
     for (size_t i = 0; i < parser_threads; ++i) {
-        add_thread(1, [this, parser_threads](Task & task, ThreadState &){
+        add_thread(1, [this, columnar](Task & task, ThreadState &){
             if (not task.parsed.test_and_set()) {
-                task.row.ParseFromArray(task.raw.data(), task.raw.size());
-                cross_cat_.splitter.split(task.row.diff(), task.partial_diffs);
-                cross_cat_.simplify(task.partial_diffs);
+                for (auto & item : task.items) {
+                    if (not columnar) {
+                        bool ok = item.row.ParseFromArray(
+                            item.raw.data(),
+                            item.raw.size());
+                        LOOM_ASSERT(ok, "failed to parse row");
+                    }
+                    cross_cat_.splitter.split(
+                        item.row.diff(),
+                        item.partial_diffs);
+                    cross_cat_.simplify(item.partial_diffs);
+                }
             }
         });
     }
@@ -89,13 +134,15 @@ void KindPipeline::start_threads (size_t parser_threads)
     // add/remove
     auto & rowids = assignments_.rowids();
     add_thread(2, [&rowids](const Task & task, ThreadState &){
-        if (task.add) {
-            bool ok = rowids.try_push(task.row.id());
-            LOOM_ASSERT1(ok, "duplicate row: " << task.row.id());
-        } else {
-            const auto rowid = rowids.pop();
-            if (LOOM_DEBUG_LEVEL >= 1) {
-                LOOM_ASSERT_EQ(rowid, task.row.id());
+        for (const auto & item : task.items) {
+            if (item.add) {
+                bool ok = rowids.try_push(item.row.id());
+                LOOM_ASSERT1(ok, "duplicate row: " << item.row.id());
+            } else {
+                const auto rowid = rowids.pop();
+                if (LOOM_DEBUG_LEVEL >= 1) {
+                    LOOM_ASSERT_EQ(rowid, item.row.id());
+                }
             }
         }
     });
@@ -104,38 +151,60 @@ void KindPipeline::start_threads (size_t parser_threads)
     pipeline_.validate();
 }
 
+// Kinds are packed into kind_threads threads, defaulting to one per kind.
+// Each kind keeps its own rng, so packing does not affect results.
 void KindPipeline::start_kind_threads ()
 {
-    while (kind_count_ < cross_cat_.kinds.size()) {
-        size_t i = kind_count_++;
+    while (kind_rngs_.size() < cross_cat_.kinds.size()) {
+        kind_rngs_.push_back(rng_t(rng_()));
+        kind_nodes_.push_back(-1);
+    }
+
+    const size_t thread_count =
+        kind_threads_ ? kind_threads_ : kind_rngs_.size();
+    while (scheduler_.thread_count() < thread_count) {
+        const size_t t = scheduler_.thread_count();
+        scheduler_.set_thread_count(t + 1);
 
         // add/remove
-        add_thread(2, [i, this](const Task & task, ThreadState & thread){
-            if (LOOM_LIKELY(i < cross_cat_.kinds.size())) {
-                if (task.add) {
-
-                    auto groupid = kind_kernel_.add_to_cross_cat(
-                        i,
-                        task.partial_diffs[i],
-                        thread.scores,
-                        thread.rng);
-                    kind_kernel_.add_to_kind_proposer(
-                        i,
-                        groupid,
-                        task.row.diff(),
-                        thread.rng);
+        int cpu;
+        const int node = place_thread(cpu);
+        pipeline_.unsafe_add_thread(2, ThreadState(),
+            [t, node, this](const Task & task, ThreadState & thread)
+        {
+            for (size_t i : scheduler_.kindids(t)) {
+                if (LOOM_UNLIKELY(kind_nodes_[i] != node)) {
+                    relocate_kind(i);
+                    kind_nodes_[i] = node;
+                }
+                auto & rng = kind_rngs_[i];
+                for (const auto & item : task.items) {
+                    if (item.add) {
 
-                } else {
+                        auto groupid = kind_kernel_.add_to_cross_cat(
+                            i,
+                            item.partial_diffs[i],
+                            thread.scores,
+                            rng);
+                        kind_kernel_.add_to_kind_proposer(
+                            i,
+                            groupid,
+                            item.row.diff(),
+                            rng);
 
-                    auto groupid = kind_kernel_.remove_from_cross_cat(
-                        i,
-                        task.partial_diffs[i],
-                        thread.rng);
-                    kind_kernel_.remove_from_kind_proposer(i, groupid);
+                    } else {
+
+                        auto groupid = kind_kernel_.remove_from_cross_cat(
+                            i,
+                            item.partial_diffs[i],
+                            rng);
+                        kind_kernel_.remove_from_kind_proposer(i, groupid);
+                    }
                 }
             }
-        });
+        }, cpu);
     }
+    scheduler_.schedule(cross_cat_);
 }
 
 } // namespace loom
@@ -30,6 +30,7 @@
 #include <distributions/vector_math.hpp>
 #include <distributions/trivial_hash.hpp>
 #include <loom/kind_proposer.hpp>
+#include <loom/task_pool.hpp>
 
 #define LOOM_ASSERT_CLOSE(x, y) \
     LOOM_ASSERT_LT(fabs((x) - (y)) / ((x) + (y) + 1e-20), 1e-4)
@@ -47,6 +48,8 @@ void KindProposer::model_load (
     }
     LOOM_ASSERT_EQ(model.schema, cross_cat.schema);
     model.tares = cross_cat.tares;
+    model.score_cache_precision = cross_cat.score_cache_precision;
+    model.score_tile_size = cross_cat.score_tile_size;
 }
 
 void KindProposer::model_load (const CrossCat & cross_cat)
@@ -323,10 +326,9 @@ KindProposer::Timers KindProposer::infer_assignments (
     if (not model.tares.empty()) {
         TimedScope timer(timers.tare);
 
-        #pragma omp parallel for if(parallel) schedule(dynamic, 1)
-        for (size_t k = 0; k < kind_count; ++k) {
+        parallel_for(0, kind_count, [&](size_t k){
             kinds[k].mixture.add_diff_step_2_of_2(model, rng);
-        }
+        }, parallel);
     }
     if (LOOM_DEBUG_LEVEL >= 3) {
         for (size_t k = 0; k < kind_count; ++k) {
@@ -336,8 +338,7 @@ KindProposer::Timers KindProposer::infer_assignments (
     {
         TimedScope timer(timers.score);
 
-        #pragma omp parallel for if(parallel) schedule(dynamic, 1)
-        for (size_t f = 0; f < feature_count; ++f) {
+        parallel_for(0, feature_count, [&](size_t f){
             rng_t rng(seed + f);
             VectorFloat & scores = likelihoods[f];
             for (size_t k = 0; k < kind_count; ++k) {
@@ -345,7 +346,7 @@ KindProposer::Timers KindProposer::infer_assignments (
                 scores[k] = mixture.score_feature(model, f, rng);
             }
             distributions::scores_to_likelihoods(scores);
-        }
+        }, parallel);
     }
     {
         TimedScope timer(timers.sample);
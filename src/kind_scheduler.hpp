@@ -0,0 +1,103 @@
+// Copyright (c) 2014, Salesforce.com, Inc.  All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// - Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+// - Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+// - Neither the name of Salesforce.com nor the names of its contributors
+//   may be used to endorse or promote products derived from this
+//   software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+// FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+// COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+// BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+// OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+// TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <algorithm>
+#include <functional>
+#include <loom/common.hpp>
+#include <loom/cross_cat.hpp>
+
+namespace loom
+{
+
+// Packs kinds into a fixed number of worker threads, balancing the estimated
+// per-row cost (features x groups) of each thread's kinds.
+// Kinds are independent, so packing does not affect results.
+class KindScheduler : noncopyable
+{
+public:
+
+    typedef uint64_t cost_t;
+
+    KindScheduler () : kindids_(), costs_(), loads_() {}
+
+    size_t thread_count () const { return kindids_.size(); }
+
+    void set_thread_count (size_t thread_count)
+    {
+        kindids_.resize(thread_count);
+        loads_.resize(thread_count);
+    }
+
+    const std::vector<size_t> & kindids (size_t threadid) const
+    {
+        return kindids_[threadid];
+    }
+
+    static cost_t estimate_cost (const CrossCat::Kind & kind)
+    {
+        const cost_t feature_count = kind.featureids.size();
+        const cost_t group_count = kind.mixture.clustering.counts().size();
+        return (1 + feature_count) * group_count;
+    }
+
+    // longest-processing-time-first greedy packing
+    void schedule (const CrossCat & cross_cat)
+    {
+        LOOM_ASSERT(thread_count(), "no kind threads");
+        const size_t kind_count = cross_cat.kinds.size();
+        costs_.clear();
+        for (size_t i = 0; i < kind_count; ++i) {
+            costs_.push_back({estimate_cost(cross_cat.kinds[i]), i});
+        }
+        std::sort(costs_.begin(), costs_.end(), std::greater<Cost>());
+
+        for (auto & kindids : kindids_) {
+            kindids.clear();
+        }
+        std::fill(loads_.begin(), loads_.end(), 0);
+        for (const auto & cost : costs_) {
+            auto least = std::min_element(loads_.begin(), loads_.end());
+            *least += cost.first;
+            kindids_[least - loads_.begin()].push_back(cost.second);
+        }
+        for (auto & kindids : kindids_) {
+            std::sort(kindids.begin(), kindids.end());
+        }
+    }
+
+private:
+
+    typedef std::pair<cost_t, size_t> Cost;
+
+    std::vector<std::vector<size_t>> kindids_;
+    std::vector<Cost> costs_;
+    std::vector<cost_t> loads_;
+};
+
+} // namespace loom
@@ -31,6 +31,7 @@
 #include <loom/hyper_kernel.hpp>
 #include <loom/kind_kernel.hpp>
 #include <loom/kind_pipeline.hpp>
+#include <loom/single_pass_pipeline.hpp>
 #include <loom/stream_interval.hpp>
 #include <loom/generate.hpp>
 
@@ -51,6 +52,10 @@ Loom::Loom (
     cross_cat_(),
     assignments_()
 {
+    cross_cat_.score_cache_precision =
+        parse_cache_precision(config_.score_cache_precision());
+    cross_cat_.score_tile_size = config_.kernels().cat().score_tile_size();
+
     cross_cat_.model_load(model_in);
     const size_t kind_count = cross_cat_.kinds.size();
     LOOM_ASSERT(kind_count, "no kinds, loom is empty");
@@ -109,12 +114,12 @@ void Loom::dump (
     }
 }
 
-void Loom::infer_single_pass (
+void Loom::infer_single_pass_sequential (
         rng_t & rng,
         const char * rows_in,
         const char * assign_out)
 {
-    protobuf::InFile rows(rows_in);
+    RowInFile rows(rows_in);
     protobuf::Row row;
     CatKernel cat_kernel(config_.kernels().cat(), cross_cat_);
 
@@ -136,6 +141,28 @@ void Loom::infer_single_pass (
     }
 }
 
+void Loom::infer_single_pass_parallel (
+        rng_t & rng,
+        const char * rows_in,
+        const char * assign_out)
+{
+    RowInFile rows(rows_in);
+    CatKernel cat_kernel(config_.kernels().cat(), cross_cat_);
+    std::unique_ptr<protobuf::OutFile> assignments;
+    if (assign_out) {
+        assignments.reset(new protobuf::OutFile(assign_out));
+    }
+
+    SinglePassPipeline pipeline(
+        config_.kernels().cat(),
+        cross_cat_,
+        rows,
+        assignments.get(),
+        cat_kernel,
+        rng);
+    pipeline.run();
+}
+
 void Loom::log_metrics (Logger::Message & message)
 {
     auto & summary = * message.mutable_summary();
@@ -183,11 +210,10 @@ void Loom::infer_multi_pass (
         schedule.load(checkpoint.schedule());
         checkpoint.set_tardis_iter(checkpoint.tardis_iter() + 1);
     } else {
-        size_t row_count =
-            protobuf::InFile::stream_stats(rows_in).message_count;
+        size_t row_count = RowInFile::row_count(rows_in);
         checkpoint.set_row_count(row_count);
         if (assignments_.row_count()) {
-            rows.init_from_assignments(assignments_);
+            rows.init_from_assignments(assignments_, row_count);
         }
         checkpoint.set_tardis_iter(0);
         logger([&](Logger::Message & message){
@@ -222,6 +248,9 @@ bool Loom::infer_kind_structure_sequential (
 {
     KindKernel kind_kernel(config_.kernels(), cross_cat_, assignments_, rng());
     HyperKernel hyper_kernel(config_.kernels().hyper(), cross_cat_);
+    StreamInterval::Readahead readahead(
+        rows,
+        config_.kernels().kind().readahead_capacity());
     protobuf::Row row;
 
     while (LOOM_LIKELY(assignments_.row_count() != checkpoint.row_count())) {
@@ -243,8 +272,7 @@ bool Loom::infer_kind_structure_sequential (
                 schedule.accelerating.extra_passes(
                     assignments_.row_count()));
             schedule.disabling.run(kind_kernel.try_run());
-            hyper_kernel.try_run(rng);
-            kind_kernel.init_cache();
+            kind_kernel.try_run_hypers_and_init_cache(hyper_kernel, rng);
             checkpoint.set_tardis_iter(checkpoint.tardis_iter() + 1);
             logger([&](Logger::Message & message){
                 message.set_iter(checkpoint.tardis_iter());
@@ -309,8 +337,7 @@ bool Loom::infer_kind_structure_parallel (
                 schedule.accelerating.extra_passes(
                     assignments_.row_count()));
             schedule.disabling.run(pipeline.try_run());
-            hyper_kernel.try_run(rng);
-            pipeline.init_cache();
+            pipeline.try_run_hypers_and_init_cache(hyper_kernel, rng);
             checkpoint.set_tardis_iter(checkpoint.tardis_iter() + 1);
             logger([&](Logger::Message & message){
                 message.set_iter(checkpoint.tardis_iter());
@@ -346,6 +373,9 @@ bool Loom::infer_cat_structure_sequential (
 {
     CatKernel cat_kernel(config_.kernels().cat(), cross_cat_);
     HyperKernel hyper_kernel(config_.kernels().hyper(), cross_cat_);
+    StreamInterval::Readahead readahead(
+        rows,
+        config_.kernels().cat().readahead_capacity());
     protobuf::Row row;
 
     while (LOOM_LIKELY(assignments_.row_count() != checkpoint.row_count())) {
@@ -431,6 +461,7 @@ bool Loom::infer_cat_structure_parallel (
             logger([&](Logger::Message & message){
                 message.set_iter(checkpoint.tardis_iter());
                 log_metrics(message);
+                pipeline.log_metrics(message);
                 hyper_kernel.log_metrics(message);
             });
             if (schedule.checkpointing.test()) {
@@ -449,21 +480,21 @@ bool Loom::infer_cat_structure_parallel (
     return true;
 }
 
-void Loom::posterior_enum (
+template<class WriteSample>
+void Loom::posterior_enum_samples (
         rng_t & rng,
-        const char * rows_in,
-        const char * samples_out)
+        const std::vector<protobuf::Row> & rows,
+        size_t sample_count,
+        const WriteSample & write_sample)
 {
-    const size_t sample_count = config_.posterior_enum().sample_count();
+    const size_t total_count = config_.posterior_enum().sample_count();
     const size_t sample_skip = config_.posterior_enum().sample_skip();
-    LOOM_ASSERT_LE(1, sample_count);
-    LOOM_ASSERT(sample_skip > 0 or sample_count == 1, "zero diversity");
+    LOOM_ASSERT_LE(1, total_count);
+    LOOM_ASSERT(sample_skip > 0 or total_count == 1, "zero diversity");
 
     CatKernel cat_kernel(config_.kernels().cat(), cross_cat_);
     HyperKernel hyper_kernel(config_.kernels().hyper(), cross_cat_);
 
-    const auto rows = protobuf_stream_load<protobuf::Row>(rows_in);
-
     LOOM_ASSERT_LT(0, rows.size());
     if (assignments_.rowids().empty()) {
         for (const auto & row : rows) {
@@ -471,7 +502,6 @@ void Loom::posterior_enum (
         }
     }
 
-    protobuf::OutFile sample_stream(samples_out);
     protobuf::PosteriorEnum::Sample sample;
 
     if (config_.kernels().kind().iterations() > 0) {
@@ -489,11 +519,10 @@ void Loom::posterior_enum (
                     kind_kernel.add_row(row);
                 }
                 kind_kernel.try_run();
-                hyper_kernel.try_run(rng);
-                kind_kernel.init_cache();
+                kind_kernel.try_run_hypers_and_init_cache(hyper_kernel, rng);
             }
             dump_posterior_enum(sample, rng);
-            sample_stream.write_stream(sample);
+            write_sample(sample);
         }
 
     } else {
@@ -507,11 +536,39 @@ void Loom::posterior_enum (
                 hyper_kernel.try_run(rng);
             }
             dump_posterior_enum(sample, rng);
-            sample_stream.write_stream(sample);
+            write_sample(sample);
         }
     }
 }
 
+void Loom::posterior_enum (
+        rng_t & rng,
+        const char * rows_in,
+        const char * samples_out)
+{
+    const size_t sample_count = config_.posterior_enum().sample_count();
+    const auto rows = RowInFile::load_all(rows_in);
+    protobuf::OutFile sample_stream(samples_out);
+    posterior_enum_samples(rng, rows, sample_count,
+        [&](const protobuf::PosteriorEnum::Sample & sample){
+            sample_stream.write_stream(sample);
+        });
+}
+
+void Loom::posterior_enum (
+        rng_t & rng,
+        const std::vector<protobuf::Row> & rows,
+        size_t sample_count,
+        std::vector<protobuf::PosteriorEnum::Sample> & samples)
+{
+    samples.clear();
+    samples.reserve(sample_count);
+    posterior_enum_samples(rng, rows, sample_count,
+        [&](const protobuf::PosteriorEnum::Sample & sample){
+            samples.push_back(sample);
+        });
+}
+
 inline void Loom::dump_posterior_enum (
         protobuf::PosteriorEnum::Sample & message,
         rng_t & rng)
@@ -561,9 +618,10 @@ void Loom::generate (
     LOOM_ASSERT_EQ(assignments_.row_count(), config_.generate().row_count());
 }
 
-void Loom::mix (
+template<class Sweep>
+void Loom::mix_sweeps (
         rng_t & rng,
-        const char * rows_in)
+        const Sweep & sweep)
 {
     const size_t sample_skip = config_.generate().sample_skip();
     LOOM_ASSERT(sample_skip > 0, "zero diversity");
@@ -573,16 +631,36 @@ void Loom::mix (
     KindKernel kind_kernel(config_.kernels(), cross_cat_, assignments_, rng());
 
     for (size_t i = 0; i < sample_skip; ++i) {
-        protobuf::InFile rows(rows_in);
+        sweep(kind_kernel);
+        kind_kernel.try_run();
+        kind_kernel.try_run_hypers_and_init_cache(hyper_kernel, rng);
+    }
+}
+
+void Loom::mix (
+        rng_t & rng,
+        const char * rows_in)
+{
+    mix_sweeps(rng, [rows_in](KindKernel & kind_kernel){
+        RowInFile rows(rows_in);
         protobuf::Row row;
         while (rows.try_read_stream(row)) {
             kind_kernel.remove_row(row);
             kind_kernel.add_row(row);
         }
-        kind_kernel.try_run();
-        hyper_kernel.try_run(rng);
-        kind_kernel.init_cache();
-    }
+    });
+}
+
+void Loom::mix (
+        rng_t & rng,
+        const std::vector<protobuf::Row> & rows)
+{
+    mix_sweeps(rng, [&rows](KindKernel & kind_kernel){
+        for (const auto & row : rows) {
+            kind_kernel.remove_row(row);
+            kind_kernel.add_row(row);
+        }
+    });
 }
 
 } // namespace loom
@@ -75,6 +75,13 @@ public:
             const char * rows_in,
             const char * samples_out);
 
+    // runs one chain on preloaded rows, which may be shared among chains
+    void posterior_enum (
+            rng_t & rng,
+            const std::vector<protobuf::Row> & rows,
+            size_t sample_count,
+            std::vector<protobuf::PosteriorEnum::Sample> & samples);
+
     void generate (
             rng_t & rng,
             const char * rows_out);
@@ -83,10 +90,24 @@ public:
             rng_t & rng,
             const char * rows_in);
 
+    void mix (
+            rng_t & rng,
+            const std::vector<protobuf::Row> & rows);
+
     const CrossCat & cross_cat () const { return cross_cat_; }
 
 private:
 
+    void infer_single_pass_sequential (
+            rng_t & rng,
+            const char * rows_in,
+            const char * assign_out);
+
+    void infer_single_pass_parallel (
+            rng_t & rng,
+            const char * rows_in,
+            const char * assign_out);
+
     bool infer_kind_structure_sequential (
             StreamInterval & rows,
             Checkpoint & checkpoint,
@@ -125,15 +146,40 @@ private:
 
     void log_metrics (Logger::Message & message);
 
+    template<class WriteSample>
+    void posterior_enum_samples (
+            rng_t & rng,
+            const std::vector<protobuf::Row> & rows,
+            size_t sample_count,
+            const WriteSample & write_sample);
+
     void dump_posterior_enum (
             protobuf::PosteriorEnum::Sample & message,
             rng_t & rng);
 
+    // sweep(kind_kernel) removes and re-adds each row once
+    template<class Sweep>
+    void mix_sweeps (
+            rng_t & rng,
+            const Sweep & sweep);
+
     const protobuf::Config & config_;
     CrossCat cross_cat_;
     Assignments assignments_;
 };
 
+inline void Loom::infer_single_pass (
+        rng_t & rng,
+        const char * rows_in,
+        const char * assign_out)
+{
+    if (config_.kernels().cat().row_queue_capacity()) {
+        infer_single_pass_parallel(rng, rows_in, assign_out);
+    } else {
+        infer_single_pass_sequential(rng, rows_in, assign_out);
+    }
+}
+
 inline bool Loom::infer_kind_structure (
         StreamInterval & rows,
         Checkpoint & checkpoint,
@@ -27,11 +27,13 @@
 
 #include <loom/args.hpp>
 #include <loom/protobuf_stream.hpp>
+#include <loom/row_block.hpp>
+#include <loom/task_pool.hpp>
 #include <loom/loom.hpp>
 
 const char * help_message =
-"Usage: generate CONFIG_IN ROWS_IN MODEL_IN GROUPS_IN ASSIGN_IN"
-"\n  MODEL_OUT GROUPS_OUT ASSIGN_OUT"
+"Usage: mix CONFIG_IN ROWS_IN MODEL_IN GROUPS_IN ASSIGN_IN"
+"\n  MODEL_OUT GROUPS_OUT ASSIGN_OUT [MODEL_OUT GROUPS_OUT ASSIGN_OUT ...]"
 "\nArguments:"
 "\n  CONFIG_IN     filename of config (e.g. config.pb.gz)"
 "\n  ROWS_IN       filename of input dataset stream (e.g. rows.pbs.gz)"
@@ -44,6 +46,9 @@ const char * help_message =
 "\nNotes:"
 "\n  Any filename can end with .gz to indicate gzip compression."
 "\n  Any filename can be '-' or '-.gz' to indicate stdin/stdout."
+"\n  Each additional output triple is mixed by an independent chain,"
+"\n    chains running in parallel on the shared task pool"
+"\n    and sharing rows in memory."
 ;
 
 int main (int argc, char ** argv)
@@ -56,17 +61,51 @@ int main (int argc, char ** argv)
     const char * model_in = args.pop();
     const char * groups_in = args.pop();
     const char * assign_in = args.pop();
-    const char * model_out = args.pop();
-    const char * groups_out = args.pop();
-    const char * assign_out = args.pop();
+    struct Outputs
+    {
+        const char * model_out;
+        const char * groups_out;
+        const char * assign_out;
+    };
+    std::vector<Outputs> outputs;
+    do {
+        const char * model_out = args.pop();
+        const char * groups_out = args.pop();
+        const char * assign_out = args.pop();
+        outputs.push_back({model_out, groups_out, assign_out});
+    } while (not args.empty());
     args.done();
 
     const auto config = loom::protobuf_load<loom::protobuf::Config>(config_in);
-    loom::rng_t rng(config.seed());
-    loom::Loom engine(rng, config, model_in, groups_in, assign_in);
+    const size_t chain_count = outputs.size();
 
-    engine.mix(rng, rows_in);
-    engine.dump(model_out, groups_out, assign_out);
+    if (chain_count == 1) {
+
+        const Outputs & out = outputs[0];
+        loom::rng_t rng(config.seed());
+        loom::Loom engine(rng, config, model_in, groups_in, assign_in);
+
+        engine.mix(rng, rows_in);
+        engine.dump(out.model_out, out.groups_out, out.assign_out);
+
+    } else {
+
+        const auto rows = loom::RowInFile::load_all(rows_in);
+        // chains run on their own pool, sized to the thread count, so that
+        // pipeline threads helping the shared pool never pick up a chain
+        const size_t thread_count = std::min(
+            chain_count,
+            loom::TaskPool::global().worker_count() + 1);
+        loom::TaskPool pool(thread_count - 1);
+        loom::parallel_for(0, chain_count, [&](size_t c){
+            const Outputs & out = outputs[c];
+            loom::rng_t rng(config.seed() + c);
+            loom::Loom engine(rng, config, model_in, groups_in, assign_in);
+
+            engine.mix(rng, rows);
+            engine.dump(out.model_out, out.groups_out, out.assign_out);
+        }, true, pool);
+    }
 
     return 0;
 }
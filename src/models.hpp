@@ -35,6 +35,11 @@
 #include <distributions/models/gp.hpp>
 #include <distributions/models/nich.hpp>
 #include <distributions/io/protobuf.hpp>
+#include <loom/compact_mixture.hpp>
+
+#ifdef LOOM_SIMD_MIXTURES
+#include <loom/simd_mixture.hpp>
+#endif // LOOM_SIMD_MIXTURES
 
 namespace loom
 {
@@ -87,28 +92,60 @@ struct Clustering : BaseModel<Clustering>
 struct BetaBernoulli : FeatureModel<
         BetaBernoulli,
         distributions::BetaBernoulli>
-{};
+{
+#ifdef LOOM_SIMD_MIXTURES
+    typedef SimdBetaBernoulli FastMixture;
+#endif // LOOM_SIMD_MIXTURES
+};
 
 template<int max_dim>
 struct DirichletDiscrete : FeatureModel<
         DirichletDiscrete<max_dim>,
         distributions::DirichletDiscrete<max_dim>>
-{};
+{
+#ifdef LOOM_SIMD_MIXTURES
+    typedef SimdDirichletDiscrete<max_dim> NarrowMixture;
+#else // LOOM_SIMD_MIXTURES
+    typedef typename distributions::DirichletDiscrete<max_dim>::FastMixture
+        NarrowMixture;
+#endif // LOOM_SIMD_MIXTURES
+
+    // wide discrete features need one cached row per category,
+    // kept in the kind's score_cache_precision
+    typedef typename std::conditional<
+        max_dim <= 16,
+        NarrowMixture,
+        PrecisionMixture<
+            distributions::DirichletDiscrete<max_dim>,
+            CompactDirichletDiscrete<max_dim>>>::type FastMixture;
+};
 
 struct DirichletProcessDiscrete : FeatureModel<
         DirichletProcessDiscrete,
         distributions::DirichletProcessDiscrete>
-{};
+{
+    typedef PrecisionMixture<
+        distributions::DirichletProcessDiscrete,
+        CompactDirichletProcessDiscrete> FastMixture;
+};
 
 struct GammaPoisson : FeatureModel<
         GammaPoisson,
         distributions::GammaPoisson>
-{};
+{
+#ifdef LOOM_SIMD_MIXTURES
+    typedef SimdGammaPoisson FastMixture;
+#endif // LOOM_SIMD_MIXTURES
+};
 
 struct NormalInverseChiSq : FeatureModel<
         NormalInverseChiSq,
         distributions::NormalInverseChiSq>
-{};
+{
+#ifdef LOOM_SIMD_MIXTURES
+    typedef SimdNormalInverseChiSq FastMixture;
+#endif // LOOM_SIMD_MIXTURES
+};
 
 //----------------------------------------------------------------------------
 // Feature types
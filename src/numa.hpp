@@ -0,0 +1,210 @@
+// Copyright (c) 2014, Salesforce.com, Inc.  All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// - Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+// - Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+// - Neither the name of Salesforce.com nor the names of its contributors
+//   may be used to endorse or promote products derived from this
+//   software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+// FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+// COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+// BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+// OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+// TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <sched.h>
+#include <pthread.h>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <loom/common.hpp>
+
+namespace loom
+{
+
+// Parses a sysfs cpu list like "0-17,36-53".
+inline std::vector<int> parse_cpu_list (const std::string & text)
+{
+    std::vector<int> cpus;
+    std::istringstream stream(text);
+    std::string range;
+    while (std::getline(stream, range, ',')) {
+        if (range.empty() or range == "\n") {
+            continue;
+        }
+        const size_t dash = range.find('-');
+        const int begin = std::stoi(range.substr(0, dash));
+        const int end = dash == std::string::npos
+                      ? begin
+                      : std::stoi(range.substr(dash + 1));
+        for (int cpu = begin; cpu <= end; ++cpu) {
+            cpus.push_back(cpu);
+        }
+    }
+    return cpus;
+}
+
+inline void pin_current_thread (int cpu)
+{
+    cpu_set_t cpus;
+    CPU_ZERO(& cpus);
+    CPU_SET(cpu, & cpus);
+    int info = pthread_setaffinity_np(pthread_self(), sizeof(cpus), & cpus);
+    LOOM_ASSERT(info == 0, "failed to pin thread to cpu " << cpu);
+}
+
+// Linux places pages on the node of the thread that first touches them,
+// so copying an object from a pinned thread moves its heap memory there.
+template<class T>
+inline void relocate_to_current_node (T & t)
+{
+    T copy(t);
+    t = std::move(copy);
+}
+
+// Reads the NUMA topology from sysfs, restricted to cpus this process may
+// run on, and spreads threads round-robin across nodes.
+// Machines without sysfs node information are treated as a single node.
+class NumaTopology : noncopyable
+{
+public:
+
+    NumaTopology () :
+        nodes_(),
+        node_cpus_(),
+        thread_counts_(),
+        local_pages_(),
+        other_pages_()
+    {
+        cpu_set_t allowed;
+        CPU_ZERO(& allowed);
+        sched_getaffinity(0, sizeof(allowed), & allowed);
+
+        for (int node : parse_cpu_list(read_file(node_path("online")))) {
+            std::vector<int> cpus;
+            const auto cpulist = read_file(node_path(node, "cpulist"));
+            for (int cpu : parse_cpu_list(cpulist)) {
+                if (CPU_ISSET(cpu, & allowed)) {
+                    cpus.push_back(cpu);
+                }
+            }
+            if (not cpus.empty()) {
+                nodes_.push_back(node);
+                node_cpus_.push_back(cpus);
+            }
+        }
+        if (node_cpus_.empty()) {
+            std::vector<int> cpus;
+            for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+                if (CPU_ISSET(cpu, & allowed)) {
+                    cpus.push_back(cpu);
+                }
+            }
+            LOOM_ASSERT(not cpus.empty(), "no cpus available");
+            nodes_.push_back(-1);
+            node_cpus_.push_back(cpus);
+        }
+        thread_counts_.resize(node_cpus_.size(), 0);
+        local_pages_.resize(node_cpus_.size(), 0);
+        other_pages_.resize(node_cpus_.size(), 0);
+        read_numastat(local_pages_, other_pages_);
+    }
+
+    size_t node_count () const { return node_cpus_.size(); }
+
+    // returns the node index of the newly placed thread
+    size_t place_thread (int & cpu)
+    {
+        size_t total = 0;
+        for (auto count : thread_counts_) {
+            total += count;
+        }
+        const size_t node = total % node_count();
+        const auto & cpus = node_cpus_[node];
+        cpu = cpus[thread_counts_[node]++ % cpus.size()];
+        return node;
+    }
+
+    // Reports per-node page allocations since the previous call,
+    // split into pages local to and remote from the allocating thread.
+    template<class Message>
+    void log_metrics (Message & message)
+    {
+        std::vector<uint64_t> local_pages(node_count(), 0);
+        std::vector<uint64_t> other_pages(node_count(), 0);
+        read_numastat(local_pages, other_pages);
+        for (size_t i = 0; i < node_count(); ++i) {
+            message.add_thread_counts(thread_counts_[i]);
+            message.add_local_pages(local_pages[i] - local_pages_[i]);
+            message.add_other_pages(other_pages[i] - other_pages_[i]);
+        }
+        local_pages_.swap(local_pages);
+        other_pages_.swap(other_pages);
+    }
+
+private:
+
+    static std::string node_path (const char * name)
+    {
+        return std::string("/sys/devices/system/node/") + name;
+    }
+
+    static std::string node_path (int node, const char * name)
+    {
+        std::ostringstream path;
+        path << "/sys/devices/system/node/node" << node << "/" << name;
+        return path.str();
+    }
+
+    static std::string read_file (const std::string & filename)
+    {
+        std::ifstream file(filename);
+        std::string text;
+        std::getline(file, text);
+        return text;
+    }
+
+    void read_numastat (
+            std::vector<uint64_t> & local_pages,
+            std::vector<uint64_t> & other_pages) const
+    {
+        for (size_t i = 0; i < node_count(); ++i) {
+            if (nodes_[i] < 0) {
+                continue;
+            }
+            std::ifstream file(node_path(nodes_[i], "numastat"));
+            std::string key;
+            uint64_t value;
+            while (file >> key >> value) {
+                if (key == "local_node") {
+                    local_pages[i] = value;
+                } else if (key == "other_node") {
+                    other_pages[i] = value;
+                }
+            }
+        }
+    }
+
+    std::vector<int> nodes_;
+    std::vector<std::vector<int>> node_cpus_;
+    std::vector<size_t> thread_counts_;
+    std::vector<uint64_t> local_pages_;
+    std::vector<uint64_t> other_pages_;
+};
+
+} // namespace loom
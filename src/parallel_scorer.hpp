@@ -0,0 +1,174 @@
+// Copyright (c) 2014, Salesforce.com, Inc.  All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// - Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+// - Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+// - Neither the name of Salesforce.com nor the names of its contributors
+//   may be used to endorse or promote products derived from this
+//   software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+// FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+// COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+// BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+// OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+// TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <distributions/vector_math.hpp>
+#include <loom/common.hpp>
+#include <loom/cross_cat.hpp>
+#include <loom/task_pool.hpp>
+
+namespace loom
+{
+
+// Scores a single wide kind as a parallel_for over blocks of features on
+// the shared TaskPool. Each block is scored into a partial score vector,
+// and the calling thread sums the partials into the full scores.
+// Sampling and mixture updates remain on the calling thread.
+class ParallelScorer : noncopyable
+{
+public:
+
+    explicit ParallelScorer (size_t block_count);
+
+    size_t block_count () const { return blocks_.size() + 1; }
+
+    template<class ValueType>
+    void score_value (
+            const CrossCat::Kind & kind,
+            const ValueType & value,
+            VectorFloat & scores,
+            rng_t & rng);
+
+    template<class Diff>
+    void score_diff (
+            const CrossCat::Kind & kind,
+            const Diff & diff,
+            VectorFloat & scores,
+            rng_t & rng);
+
+private:
+
+    // block 0 is scored into the caller's scores with the caller's rng
+    struct Block
+    {
+        VectorFloat scores;
+        rng_t rng;
+    };
+
+    size_t block_begin (size_t feature_count, size_t blockid) const
+    {
+        return feature_count * blockid / block_count();
+    }
+
+    template<class Job>
+    void _run (
+            const Job & job,
+            size_t feature_count,
+            VectorFloat & scores,
+            rng_t & rng);
+
+    std::vector<Block> blocks_;
+    bool seeded_;
+};
+
+inline ParallelScorer::ParallelScorer (size_t block_count) :
+    blocks_(block_count - 1),
+    seeded_(false)
+{
+    LOOM_ASSERT_LT(1, block_count);
+}
+
+template<class ValueType>
+inline void ParallelScorer::score_value (
+        const CrossCat::Kind & kind,
+        const ValueType & value,
+        VectorFloat & scores,
+        rng_t & rng)
+{
+    _run(
+        [&](size_t begin, size_t end, VectorFloat & scores, rng_t & rng){
+            kind.mixture.score_value_block(
+                kind.model,
+                value,
+                begin,
+                end,
+                scores,
+                rng);
+        },
+        kind.model.schema.total_size(),
+        scores,
+        rng);
+}
+
+template<class Diff>
+inline void ParallelScorer::score_diff (
+        const CrossCat::Kind & kind,
+        const Diff & diff,
+        VectorFloat & scores,
+        rng_t & rng)
+{
+    _run(
+        [&](size_t begin, size_t end, VectorFloat & scores, rng_t & rng){
+            kind.mixture.score_diff_block(
+                kind.model,
+                diff,
+                begin,
+                end,
+                scores,
+                rng);
+        },
+        kind.model.schema.total_size(),
+        scores,
+        rng);
+}
+
+template<class Job>
+inline void ParallelScorer::_run (
+        const Job & job,
+        size_t feature_count,
+        VectorFloat & scores,
+        rng_t & rng)
+{
+    // block rngs are seeded from the kernel rng on first use, so that
+    // blocks of different kinds draw from unrelated streams
+    if (LOOM_UNLIKELY(not seeded_)) {
+        for (auto & block : blocks_) {
+            block.rng.seed(rng());
+        }
+        seeded_ = true;
+    }
+
+    parallel_for(0, block_count(), [&](size_t blockid){
+        const size_t begin = block_begin(feature_count, blockid);
+        const size_t end = block_begin(feature_count, blockid + 1);
+        if (blockid == 0) {
+            job(begin, end, scores, rng);
+        } else {
+            Block & block = blocks_[blockid - 1];
+            job(begin, end, block.scores, block.rng);
+        }
+    });
+
+    const size_t size = scores.size();
+    for (const auto & block : blocks_) {
+        LOOM_ASSERT3(block.scores.size() == size, "bad partial scores");
+        distributions::vector_add(size, scores.data(), block.scores.data());
+    }
+}
+
+} // namespace loom
@@ -28,19 +28,25 @@
 #pragma once
 
 #include <atomic>
+#include <memory>
 #include <mutex>
 #include <thread>
 #include <condition_variable>
 #include <distributions/aligned_allocator.hpp>
 #include <loom/common.hpp>
+#include <loom/timer.hpp>
+#include <loom/numa.hpp>
+#include <loom/task_pool.hpp>
 
 #ifdef LOOM_ASSUME_X86
 #  define load_barrier() asm volatile("lfence":::"memory")
 #  define store_barrier() asm volatile("sfence":::"memory")
+#  define spin_pause() asm volatile("pause":::"memory")
 #else // LOOM_ASSUME_X86
 #  warn "defaulting to full memory barriers"
 #  define load_barrier() __sync_synchronize()
 #  define store_barrier() __sync_synchronize()
+#  define spin_pause() std::this_thread::yield()
 #endif // LOOM_ASSUME_X86
 
 #if 0
@@ -55,6 +61,7 @@ namespace loom
 class PipelineState
 {
     std::atomic<uint_fast64_t> pair_;
+    std::atomic<uint_fast32_t> waiter_count_;
 
 public:
 
@@ -84,7 +91,7 @@ public:
         return pair & 0xFFFFUL;
     }
 
-    PipelineState () : pair_(0)
+    PipelineState () : pair_(0), waiter_count_(0)
     {
         static_test();
     }
@@ -109,6 +116,26 @@ public:
         return get_count(pair_.fetch_sub(1, std::memory_order_acq_rel));
     }
 
+    // Waiters register before re-checking the stage, and releasers check for
+    // waiters after storing the stage; the paired fences ensure that at
+    // least one side sees the other, so no wakeup is lost.
+    void add_waiter ()
+    {
+        waiter_count_.fetch_add(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+
+    void remove_waiter ()
+    {
+        waiter_count_.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    bool has_waiters () const
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        return waiter_count_.load(std::memory_order_relaxed);
+    }
+
 private:
 
     static constexpr pair_t _state (uint_fast64_t stage_number, count_t count)
@@ -150,37 +177,62 @@ class PipelineGuard
 {
     PipelineState::pair_t state_;
     PipelineState::stage_t stage_;
+    size_t spin_limit_;
     std::mutex mutex_;
     std::condition_variable cond_variable_;
+    std::atomic<uint_fast64_t> spin_count_;
+    std::atomic<uint_fast64_t> wait_count_;
+    std::atomic<uint_fast64_t> pause_count_;
 
 public:
 
-    void init (size_t stage_number, size_t count)
+    struct Stats
+    {
+        uint64_t spin_count;
+        uint64_t wait_count;
+        uint64_t pause_count;
+    };
+
+    PipelineGuard () :
+        spin_limit_(0),
+        spin_count_(0),
+        wait_count_(0),
+        pause_count_(0)
+    {
+    }
+
+    void init (size_t stage_number, size_t count, size_t spin_limit)
     {
         state_ = PipelineState::create_state(stage_number, count);
         stage_ = PipelineState::create_state(stage_number, 0);
+        spin_limit_ = spin_limit;
     }
 
     size_t get_count () { return PipelineState::get_count(state_); }
 
-    void acquire (const PipelineState & state)
+    void acquire (PipelineState & state)
     {
-        if (state.load_stage() != stage_) {
-            std::unique_lock<std::mutex> lock(mutex_);
-            cond_variable_.wait(lock, [&](){
-                return state.load_stage() == stage_;
-            });
+        if (LOOM_UNLIKELY(state.load_stage() != stage_)) {
+            if (not _spin(state)) {
+                _block(state);
+            }
         }
         load_barrier();
     }
 
-    void release (PipelineState & state)
+    // returns true iff this was the last release of the previous stage
+    bool release (PipelineState & state)
     {
         store_barrier();
         if (state.decrement_count() == 1) {
             state.store(state_);
-            std::unique_lock<std::mutex> lock(mutex_);
-            cond_variable_.notify_all();
+            if (state.has_waiters()) {
+                std::unique_lock<std::mutex> lock(mutex_);
+                cond_variable_.notify_all();
+            }
+            return true;
+        } else {
+            return false;
         }
     }
 
@@ -193,6 +245,49 @@ public:
     {
         LOOM_ASSERT2(state.load_stage() == stage_, "state is not ready");
     }
+
+    // returns counts since the previous call
+    Stats pop_stats ()
+    {
+        Stats stats;
+        stats.spin_count = spin_count_.exchange(0, std::memory_order_relaxed);
+        stats.wait_count = wait_count_.exchange(0, std::memory_order_relaxed);
+        stats.pause_count = pause_count_.exchange(0, std::memory_order_relaxed);
+        return stats;
+    }
+
+private:
+
+    // spin with exponential backoff, up to spin_limit_ pauses in total
+    bool _spin (const PipelineState & state)
+    {
+        size_t pauses = 0;
+        for (size_t step = 1; pauses + step <= spin_limit_; step *= 2) {
+            for (size_t i = 0; i < step; ++i) {
+                spin_pause();
+            }
+            pauses += step;
+            if (state.load_stage() == stage_) {
+                spin_count_.fetch_add(1, std::memory_order_relaxed);
+                pause_count_.fetch_add(pauses, std::memory_order_relaxed);
+                return true;
+            }
+        }
+        pause_count_.fetch_add(pauses, std::memory_order_relaxed);
+        return false;
+    }
+
+    // while blocked, run pending tasks of the shared pool,
+    // e.g. of kernel loops issued between batches
+    void _block (PipelineState & state)
+    {
+        wait_count_.fetch_add(1, std::memory_order_relaxed);
+        state.add_waiter();
+        TaskPool::global().wait_until(mutex_, cond_variable_, [&](){
+            return state.load_stage() == stage_;
+        });
+        state.remove_waiter();
+    }
 };
 
 namespace detail
@@ -233,8 +328,10 @@ class PipelineQueue
     std::vector<Envelope, Alloc> envelopes_;
     const size_t size_plus_one_;
     const size_t stage_count_;
+    const size_t spin_limit_;
     std::vector<size_t> consumer_counts_;
     size_t position_;
+    std::atomic<uint_fast64_t> finished_count_;
     PipelineGuard guards_[PipelineState::max_stage_count];
 
     Envelope & envelopes (size_t position)
@@ -254,21 +351,23 @@ class PipelineQueue
 
 public:
 
-    PipelineQueue (size_t size, size_t stage_count) :
+    PipelineQueue (size_t size, size_t stage_count, size_t spin_limit) :
         envelopes_(size + 1),
         size_plus_one_(size + 1),
         stage_count_(stage_count),
+        spin_limit_(spin_limit),
         consumer_counts_(stage_count, 0),
         position_(0),
+        finished_count_(0),
         guards_()
     {
         LOOM_ASSERT_LE(1, stage_count_);
         LOOM_ASSERT_LE(1 + stage_count_, PipelineState::max_stage_count);
 
         for (size_t i = 0; i < stage_count_; ++i) {
-            guards_[i].init(i, 0);
+            guards_[i].init(i, 0, spin_limit_);
         }
-        guards_[stage_count_].init(stage_count_, 1);
+        guards_[stage_count_].init(stage_count_, 1, spin_limit_);
 
         PipelineGuard & guard = guards_[stage_count_];
         for (size_t i = 0; i < size_plus_one_; ++i) {
@@ -298,7 +397,7 @@ public:
         LOOM_ASSERT_LT(stage_number, stage_count_);
         assert_ready();
         size_t count = ++consumer_counts_[stage_number];
-        guards_[stage_number].init(stage_number, count);
+        guards_[stage_number].init(stage_number, count, spin_limit_);
         assert_ready();
     }
 
@@ -316,6 +415,13 @@ public:
         return position_;
     }
 
+    // number of produced tasks that have not yet passed the last stage;
+    // only the producer may call this
+    size_t fill () const
+    {
+        return position_ - finished_count_.load(std::memory_order_acquire);
+    }
+
     void wait ()
     {
         LOOM_DEBUG_QUEUE("wait at " << (position_ % size_plus_one_));
@@ -330,7 +436,7 @@ public:
         LOOM_DEBUG_QUEUE("produce " << (position_ % size_plus_one_));
         LOOM_ASSERT2(size_plus_one_ > 1, "cannot use zero-length queue");
 
-        const Envelope & fence = envelopes(position_ + 1);
+        Envelope & fence = envelopes(position_ + 1);
         guards_[stage_count_].acquire(fence.state);
         Envelope & envelope = envelopes(position_);
         producer(envelope.message);
@@ -354,8 +460,63 @@ public:
         Envelope & envelope = envelopes(position);
         guards_[stage_number].acquire(envelope.state);
         consumer(envelope.message);
-        guards_[stage_number + 1].release(envelope.state);
+        if (guards_[stage_number + 1].release(envelope.state)) {
+            if (stage_number + 1 == stage_count_) {
+                finished_count_.fetch_add(1, std::memory_order_release);
+            }
+        }
+    }
+
+    // stats are indexed by stage, with the producer last
+    std::vector<PipelineGuard::Stats> pop_wait_stats ()
+    {
+        std::vector<PipelineGuard::Stats> stats;
+        stats.reserve(stage_count_ + 1);
+        for (size_t i = 0; i <= stage_count_; ++i) {
+            stats.push_back(guards_[i].pop_stats());
+        }
+        return stats;
+    }
+};
+
+// A batch of items carried by a single pipeline task,
+// so that each stage synchronizes once per batch rather than once per item.
+// Items are reused across batches to avoid reallocation.
+template<class Item>
+class PipelineBatch
+{
+    std::vector<Item> items_;
+    size_t size_;
+
+public:
+
+    PipelineBatch () : items_(), size_(0) {}
+
+    size_t size () const { return size_; }
+    bool empty () const { return size_ == 0; }
+    void clear () { size_ = 0; }
+
+    Item & push_back ()
+    {
+        if (size_ == items_.size()) {
+            items_.resize(size_ + 1);
+        }
+        return items_[size_++];
+    }
+
+    void pop_back ()
+    {
+        LOOM_ASSERT1(size_, "cannot pop from empty batch");
+        --size_;
     }
+
+    Item & operator[] (size_t i) { return items_[i]; }
+    const Item & operator[] (size_t i) const { return items_[i]; }
+
+    Item * begin () { return items_.data(); }
+    Item * end () { return items_.data() + size_; }
+    const Item * begin () const { return items_.data(); }
+    const Item * end () const { return items_.data() + size_; }
 };
 
 template<class Task, class ThreadState, size_t cache_line_size = 64>
@@ -368,36 +529,80 @@ class Pipeline
         PipelineTask () : exit(false) {}
     };
 
+    // Times are accumulated by the owning thread
+    // and popped concurrently by the producer.
+    struct ThreadStats
+    {
+        const size_t stage_number;
+        std::atomic<usec_t> busy_time;
+        std::atomic<usec_t> wait_time;
+
+        ThreadStats (size_t stage) :
+            stage_number(stage),
+            busy_time(0),
+            wait_time(0)
+        {
+        }
+
+        void add (usec_t & ready, usec_t start, usec_t finish)
+        {
+            wait_time.fetch_add(start - ready, std::memory_order_relaxed);
+            busy_time.fetch_add(finish - start, std::memory_order_relaxed);
+            ready = finish;
+        }
+    };
+
     PipelineQueue<PipelineTask, cache_line_size> queue_;
     std::vector<std::thread> threads_;
+    std::vector<std::unique_ptr<ThreadStats>> thread_stats_;
+    ThreadStats producer_stats_;
+    uint64_t task_count_;
+    uint64_t fill_sum_;
+    uint64_t fill_max_;
 
 public:
 
-    Pipeline (size_t capacity, size_t stage_count) :
-        queue_(capacity, stage_count),
-        threads_()
+    Pipeline (size_t capacity, size_t stage_count, size_t spin_limit) :
+        queue_(capacity, stage_count, spin_limit),
+        threads_(),
+        thread_stats_(),
+        producer_stats_(stage_count),
+        task_count_(0),
+        fill_sum_(0),
+        fill_max_(0)
     {
     }
 
+    // threads float freely unless pinned to a cpu
     template<class Fun>
     void unsafe_add_thread (
             size_t stage_number,
             const ThreadState & init_thread,
-            const Fun & fun)
+            const Fun & fun,
+            int cpu = -1)
     {
         queue_.unsafe_add_consumer(stage_number);
         size_t init_position = queue_.unsafe_position();
+        thread_stats_.emplace_back(new ThreadStats(stage_number));
+        ThreadStats * stats = thread_stats_.back().get();
         threads_.push_back(std::thread(
-                [this, stage_number, init_thread, init_position, fun](){
+                [this, stage_number, init_thread, init_position, fun, cpu,
+                 stats](){
+            if (cpu >= 0) {
+                pin_current_thread(cpu);
+            }
             ThreadState thread = init_thread;
             size_t position = init_position;
+            usec_t ready = current_time_usec();
             for (bool alive = true; LOOM_LIKELY(alive);) {
                 queue_.consume(stage_number, position, [&](PipelineTask & task){
+                    usec_t start = current_time_usec();
                     if (LOOM_UNLIKELY(task.exit)) {
                         alive = false;
                     } else {
                         fun(task.task, thread);
                     }
+                    stats->add(ready, start, current_time_usec());
                 });
                 ++position;
             }
@@ -412,7 +617,16 @@ public:
     template<class Fun>
     void start (const Fun & fun)
     {
-        queue_.produce([fun](PipelineTask & task){ fun(task.task); });
+        usec_t ready = current_time_usec();
+        queue_.produce([&](PipelineTask & task){
+            usec_t start = current_time_usec();
+            fun(task.task);
+            producer_stats_.add(ready, start, current_time_usec());
+        });
+        ++task_count_;
+        uint64_t fill = queue_.fill();
+        fill_sum_ += fill;
+        fill_max_ = std::max(fill_max_, fill);
     }
 
     void wait ()
@@ -420,6 +634,46 @@ public:
         queue_.wait();
     }
 
+    // logs counts and times since the previous call
+    template<class KernelStatus>
+    void log_metrics (KernelStatus & status)
+    {
+        auto & message = * status.mutable_pipeline();
+        message.set_task_count(task_count_);
+        for (const auto & stats : queue_.pop_wait_stats()) {
+            message.add_spin_counts(stats.spin_count);
+            message.add_wait_counts(stats.wait_count);
+            message.add_pause_counts(stats.pause_count);
+        }
+        message.set_queue_size(queue_.size());
+        message.set_queue_fill_max(fill_max_);
+        message.set_queue_fill_mean(
+            task_count_ ? float(fill_sum_) / task_count_ : 0.f);
+        task_count_ = 0;
+        fill_sum_ = 0;
+        fill_max_ = 0;
+
+        const size_t stage_count = queue_.stage_count();
+        auto & parcat = * status.mutable_parcat();
+        parcat.mutable_times()->Resize(stage_count + 1, 0);
+        parcat.mutable_counts()->Resize(stage_count + 1, 0);
+        auto log_thread = [&](ThreadStats & stats){
+            auto & thread = * message.add_threads();
+            const size_t stage = stats.stage_number;
+            thread.set_stage(stage);
+            thread.set_busy_time(
+                stats.busy_time.exchange(0, std::memory_order_relaxed));
+            thread.set_wait_time(
+                stats.wait_time.exchange(0, std::memory_order_relaxed));
+            parcat.set_times(stage, parcat.times(stage) + thread.busy_time());
+            parcat.set_counts(stage, parcat.counts(stage) + 1);
+        };
+        for (auto & stats : thread_stats_) {
+            log_thread(* stats);
+        }
+        log_thread(producer_stats_);
+    }
+
     ~Pipeline ()
     {
         queue_.produce([](PipelineTask & task) { task.exit = true; });
@@ -27,6 +27,8 @@
 
 #include <loom/args.hpp>
 #include <loom/protobuf_stream.hpp>
+#include <loom/row_block.hpp>
+#include <loom/task_pool.hpp>
 #include <loom/loom.hpp>
 
 const char * help_message =
@@ -48,6 +50,9 @@ const char * help_message =
 "\n  Any filename can be '-' or '-.gz' to indicate stdin/stdout."
 "\n  If running kind inference and GROUPS_IN is provided,"
 "\n    then all data in groups must be accounted for in ASSIGN_IN."
+"\n  With config.posterior_enum.chain_count > 1, independent chains run in"
+"\n    parallel on the shared task pool and their samples are interleaved"
+"\n    round-robin."
 ;
 
 int main (int argc, char ** argv)
@@ -65,10 +70,55 @@ int main (int argc, char ** argv)
     args.done();
 
     const auto config = loom::protobuf_load<loom::protobuf::Config>(config_in);
-    loom::rng_t rng(config.seed());
-    loom::Loom engine(rng, config, model_in, groups_in, assign_in, tares_in);
+    const size_t chain_count =
+        std::max<size_t>(1, config.posterior_enum().chain_count());
 
-    engine.posterior_enum(rng, rows_in, samples_out);
+    if (chain_count == 1) {
+
+        loom::rng_t rng(config.seed());
+        loom::Loom engine(
+            rng,
+            config,
+            model_in,
+            groups_in,
+            assign_in,
+            tares_in);
+
+        engine.posterior_enum(rng, rows_in, samples_out);
+
+    } else {
+
+        // chain c produces samples c, c + chain_count, c + 2 chain_count, ...
+        typedef loom::protobuf::PosteriorEnum::Sample Sample;
+        const size_t sample_count = config.posterior_enum().sample_count();
+        const auto rows = loom::RowInFile::load_all(rows_in);
+        std::vector<std::vector<Sample>> samples(chain_count);
+        // chains run on their own pool, sized to the thread count, so that
+        // pipeline threads helping the shared pool never pick up a chain
+        const size_t thread_count = std::min(
+            chain_count,
+            loom::TaskPool::global().worker_count() + 1);
+        loom::TaskPool pool(thread_count - 1);
+        loom::parallel_for(0, chain_count, [&](size_t c){
+            loom::rng_t rng(config.seed() + c);
+            loom::Loom engine(
+                rng,
+                config,
+                model_in,
+                groups_in,
+                assign_in,
+                tares_in);
+            const size_t count =
+                (sample_count + chain_count - 1 - c) / chain_count;
+            engine.posterior_enum(rng, rows, count, samples[c]);
+        }, true, pool);
+
+        loom::protobuf::OutFile sample_stream(samples_out);
+        for (size_t i = 0; i < sample_count; ++i) {
+            const size_t c = i % chain_count;
+            sample_stream.write_stream(samples[c][i / chain_count]);
+        }
+    }
 
     return 0;
 }
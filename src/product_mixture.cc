@@ -163,10 +163,11 @@ struct ProductMixture_<cached>::add_value_fun
 };
 
 template<bool cached>
-void ProductMixture_<cached>::add_value (
+template<class ValueType>
+inline void ProductMixture_<cached>::_add_value (
         const ProductModel & model,
         size_t groupid,
-        const Value & value,
+        const ValueType & value,
         rng_t & rng)
 {
     LOOM_ASSERT1(maintaining_cache, "cache is not being maintained");
@@ -183,6 +184,26 @@ void ProductMixture_<cached>::add_value (
     }
 }
 
+template<bool cached>
+void ProductMixture_<cached>::add_value (
+        const ProductModel & model,
+        size_t groupid,
+        const Value & value,
+        rng_t & rng)
+{
+    _add_value(model, groupid, value, rng);
+}
+
+template<bool cached>
+void ProductMixture_<cached>::add_value (
+        const ProductModel & model,
+        size_t groupid,
+        const FlatValue & value,
+        rng_t & rng)
+{
+    _add_value(model, groupid, value, rng);
+}
+
 template<bool cached>
 struct ProductMixture_<cached>::remove_group_fun
 {
@@ -218,10 +239,11 @@ struct ProductMixture_<cached>::remove_value_fun
 };
 
 template<bool cached>
-void ProductMixture_<cached>::remove_value (
+template<class ValueType>
+inline void ProductMixture_<cached>::_remove_value (
         const ProductModel & model,
         size_t groupid,
-        const Value & value,
+        const ValueType & value,
         rng_t & rng)
 {
     LOOM_ASSERT1(maintaining_cache, "cache is not being maintained");
@@ -239,10 +261,31 @@ void ProductMixture_<cached>::remove_value (
 }
 
 template<bool cached>
-void ProductMixture_<cached>::add_diff (
+void ProductMixture_<cached>::remove_value (
         const ProductModel & model,
         size_t groupid,
-        const Value::Diff & diff,
+        const Value & value,
+        rng_t & rng)
+{
+    _remove_value(model, groupid, value, rng);
+}
+
+template<bool cached>
+void ProductMixture_<cached>::remove_value (
+        const ProductModel & model,
+        size_t groupid,
+        const FlatValue & value,
+        rng_t & rng)
+{
+    _remove_value(model, groupid, value, rng);
+}
+
+template<bool cached>
+template<class Diff>
+inline void ProductMixture_<cached>::_add_diff (
+        const ProductModel & model,
+        size_t groupid,
+        const Diff & diff,
         rng_t & rng)
 {
     LOOM_ASSERT1(maintaining_cache, "cache is not being maintained");
@@ -272,11 +315,32 @@ void ProductMixture_<cached>::add_diff (
 }
 
 template<bool cached>
-void ProductMixture_<cached>::remove_diff (
+void ProductMixture_<cached>::add_diff (
         const ProductModel & model,
         size_t groupid,
         const Value::Diff & diff,
         rng_t & rng)
+{
+    _add_diff(model, groupid, diff, rng);
+}
+
+template<bool cached>
+void ProductMixture_<cached>::add_diff (
+        const ProductModel & model,
+        size_t groupid,
+        const FlatDiff & diff,
+        rng_t & rng)
+{
+    _add_diff(model, groupid, diff, rng);
+}
+
+template<bool cached>
+template<class Diff>
+inline void ProductMixture_<cached>::_remove_diff (
+        const ProductModel & model,
+        size_t groupid,
+        const Diff & diff,
+        rng_t & rng)
 {
     LOOM_ASSERT1(maintaining_cache, "cache is not being maintained");
 
@@ -305,12 +369,33 @@ void ProductMixture_<cached>::remove_diff (
     }
 }
 
-template<>
-void ProductMixture_<false>::add_diff_step_1_of_2 (
+template<bool cached>
+void ProductMixture_<cached>::remove_diff (
         const ProductModel & model,
         size_t groupid,
         const Value::Diff & diff,
         rng_t & rng)
+{
+    _remove_diff(model, groupid, diff, rng);
+}
+
+template<bool cached>
+void ProductMixture_<cached>::remove_diff (
+        const ProductModel & model,
+        size_t groupid,
+        const FlatDiff & diff,
+        rng_t & rng)
+{
+    _remove_diff(model, groupid, diff, rng);
+}
+
+template<>
+template<class Diff>
+inline void ProductMixture_<false>::_add_diff_step_1_of_2 (
+        const ProductModel & model,
+        size_t groupid,
+        const Diff & diff,
+        rng_t & rng)
 {
     bool add_group = clustering.add_value(model.clustering, groupid);
     for (auto id : diff.tares()) {
@@ -337,6 +422,26 @@ void ProductMixture_<false>::add_diff_step_1_of_2 (
     }
 }
 
+template<>
+void ProductMixture_<false>::add_diff_step_1_of_2 (
+        const ProductModel & model,
+        size_t groupid,
+        const Value::Diff & diff,
+        rng_t & rng)
+{
+    _add_diff_step_1_of_2(model, groupid, diff, rng);
+}
+
+template<>
+void ProductMixture_<false>::add_diff_step_1_of_2 (
+        const ProductModel & model,
+        size_t groupid,
+        const FlatDiff & diff,
+        rng_t & rng)
+{
+    _add_diff_step_1_of_2(model, groupid, diff, rng);
+}
+
 template<bool cached>
 struct ProductMixture_<cached>::add_diff_fun
 {
@@ -418,6 +523,230 @@ struct ProductMixture_<cached>::score_value_fun
     }
 };
 
+// mixtures that can score a subrange of groups, see simd_mixture.hpp
+template<class Mixture>
+class scores_range
+{
+    template<class M>
+    static std::true_type test (decltype(&M::score_value_range));
+
+    template<class M>
+    static std::false_type test (...);
+
+public:
+
+    static const bool value = decltype(test<Mixture>(nullptr))::value;
+};
+
+template<bool cached>
+struct ProductMixture_<cached>::score_untiled_fun
+{
+    const Features & mixtures;
+    const ProductModel::Features & shareds;
+    VectorFloat * scores;
+    rng_t & rng;
+    TiledValues * tiled;
+
+    size_t untiled_count;
+    size_t tiled_count;
+
+    template<class T>
+    void operator() (
+            T * t,
+            size_t i,
+            const typename T::Value & value)
+    {
+        typedef typename T::template Mixture<cached>::t Mixture;
+        if (scores_range<Mixture>::value) {
+            if (tiled) {
+                (*tiled)[t].push_back(std::make_pair(uint32_t(i), value));
+            }
+            ++tiled_count;
+        } else {
+            if (scores) {
+                mixtures[t][i].score_value(shareds[t][i], value, *scores, rng);
+            }
+            ++untiled_count;
+        }
+    }
+};
+
+template<bool cached>
+struct ProductMixture_<cached>::clear_tiled_fun
+{
+    TiledValues & tiled;
+
+    template<class T>
+    void operator() (T * t)
+    {
+        tiled[t].clear();
+    }
+};
+
+template<bool cached>
+struct ProductMixture_<cached>::score_tile_fun
+{
+    const Features & mixtures;
+    const ProductModel::Features & shareds;
+    const TiledValues & tiled;
+    float * scores;
+    size_t begin;
+    size_t end;
+    rng_t & rng;
+
+    template<class T>
+    void operator() (T * t)
+    {
+        typedef typename T::template Mixture<cached>::t Mixture;
+        typedef std::integral_constant<bool, scores_range<Mixture>::value>
+            Tag;
+        for (const auto & pair : tiled[t]) {
+            const size_t i = pair.first;
+            score(Tag(), mixtures[t][i], shareds[t][i], pair.second);
+        }
+    }
+
+    template<class Mixture, class Shared, class Value>
+    void score (
+            std::true_type,
+            const Mixture & mixture,
+            const Shared & shared,
+            const Value & value)
+    {
+        mixture.score_value_range(shared, value, begin, end, scores, rng);
+    }
+
+    template<class Mixture, class Shared, class Value>
+    void score (
+            std::false_type,
+            const Mixture &,
+            const Shared &,
+            const Value &)
+    {
+    }
+};
+
+// Tiles are whole blocks of simd::GroupTable, so that every tile starts
+// aligned and each group takes the same vector or scalar code path
+// whatever the tile size; this keeps tiled scores bitwise reproducible.
+inline size_t round_tile_size (size_t tile_size, size_t group_count)
+{
+    if (tile_size == 0) {
+        return std::max(group_count, size_t(1));
+    } else {
+        const size_t block_size = 16;
+        return (tile_size + block_size - 1) / block_size * block_size;
+    }
+}
+
+template<bool cached>
+template<class ValueType>
+inline void ProductMixture_<cached>::_score_value (
+        const ProductModel & model,
+        const ValueType & value,
+        VectorFloat & scores,
+        rng_t & rng) const
+{
+    LOOM_ASSERT1(maintaining_cache, "cache is not being maintained");
+
+    static thread_local TiledValues * tiled = nullptr;
+    construct_if_null(tiled);
+    clear_tiled_fun clear = {*tiled};
+    for_each_feature_type(clear);
+
+    const size_t size = clustering.counts().size();
+    scores.resize(size);
+    clustering.score_value(model.clustering, scores);
+    score_untiled_fun untiled =
+        {features, model.features, &scores, rng, tiled, 0, 0};
+    read_value(untiled, model.schema, features, value);
+    if (untiled.tiled_count) {
+        const size_t tile_size = round_tile_size(model.score_tile_size, size);
+        score_tile_fun fun =
+            {features, model.features, *tiled, scores.data(), 0, 0, rng};
+        for (size_t begin = 0; begin < size; begin += tile_size) {
+            fun.begin = begin;
+            fun.end = std::min(size, begin + tile_size);
+            for_each_feature_type(fun);
+        }
+    }
+}
+
+template<bool cached>
+template<class Diff>
+inline void ProductMixture_<cached>::_score_diff (
+        const ProductModel & model,
+        const Diff & diff,
+        VectorFloat & scores,
+        rng_t & rng) const
+{
+    LOOM_ASSERT1(maintaining_cache, "cache is not being maintained");
+
+    // pos and neg values are each decoded once, not once per tile
+    static thread_local TiledValues * tiled_pos = nullptr;
+    static thread_local TiledValues * tiled_neg = nullptr;
+    construct_if_null(tiled_pos);
+    construct_if_null(tiled_neg);
+    clear_tiled_fun clear_pos = {*tiled_pos};
+    clear_tiled_fun clear_neg = {*tiled_neg};
+    for_each_feature_type(clear_pos);
+    for_each_feature_type(clear_neg);
+
+    const size_t size = clustering.counts().size();
+    scores.resize(size);
+    clustering.score_value(model.clustering, scores);
+
+    // features without range scoring stream the full scores vector
+    score_untiled_fun pos =
+        {features, model.features, &scores, rng, tiled_pos, 0, 0};
+    read_value(pos, model.schema, features, diff.pos());
+    score_untiled_fun neg =
+        {features, model.features, nullptr, rng, tiled_neg, 0, 0};
+    if (model.schema.total_size(diff.neg())) {
+        read_value(neg, model.schema, features, diff.neg());
+        if (neg.untiled_count) {
+            score_untiled_fun untiled =
+                {features, model.features, &scores, rng, nullptr, 0, 0};
+            distributions::vector_negate(size, scores.data());
+            read_value(untiled, model.schema, features, diff.neg());
+            distributions::vector_negate(size, scores.data());
+        }
+    }
+    for (auto id : diff.tares()) {
+        LOOM_ASSERT1(id < model.tares.size(), "bad tare id: " << id);
+        if (LOOM_DEBUG_LEVEL >= 1) {
+            LOOM_ASSERT_EQ(tare_caches[id].scores.size(), size);
+        }
+    }
+
+    // all other terms are accumulated one tile at a time
+    const size_t tile_size = round_tile_size(model.score_tile_size, size);
+    score_tile_fun pos_tile =
+        {features, model.features, *tiled_pos, scores.data(), 0, 0, rng};
+    score_tile_fun neg_tile =
+        {features, model.features, *tiled_neg, scores.data(), 0, 0, rng};
+    for (size_t begin = 0; begin < size; begin += tile_size) {
+        const size_t end = std::min(size, begin + tile_size);
+        float * tile = scores.data() + begin;
+        if (pos.tiled_count) {
+            pos_tile.begin = begin;
+            pos_tile.end = end;
+            for_each_feature_type(pos_tile);
+        }
+        if (neg.tiled_count) {
+            neg_tile.begin = begin;
+            neg_tile.end = end;
+            distributions::vector_negate(end - begin, tile);
+            for_each_feature_type(neg_tile);
+            distributions::vector_negate(end - begin, tile);
+        }
+        for (auto id : diff.tares()) {
+            const float * tare_tile = tare_caches[id].scores.data() + begin;
+            distributions::vector_add(end - begin, tile, tare_tile);
+        }
+    }
+}
+
 template<>
 void ProductMixture_<true>::score_value (
         const ProductModel & model,
@@ -425,12 +754,17 @@ void ProductMixture_<true>::score_value (
         VectorFloat & scores,
         rng_t & rng) const
 {
-    LOOM_ASSERT1(maintaining_cache, "cache is not being maintained");
+    _score_value(model, value, scores, rng);
+}
 
-    scores.resize(clustering.counts().size());
-    clustering.score_value(model.clustering, scores);
-    score_value_fun fun = {features, model.features, scores, rng};
-    read_value(fun, model.schema, features, value);
+template<>
+void ProductMixture_<true>::score_value (
+        const ProductModel & model,
+        const FlatValue & value,
+        VectorFloat & scores,
+        rng_t & rng) const
+{
+    _score_value(model, value, scores, rng);
 }
 
 template<>
@@ -439,29 +773,183 @@ void ProductMixture_<true>::score_diff (
         const Value::Diff & diff,
         VectorFloat & scores,
         rng_t & rng) const
+{
+    _score_diff(model, diff, scores, rng);
+}
+
+template<>
+void ProductMixture_<true>::score_diff (
+        const ProductModel & model,
+        const FlatDiff & diff,
+        VectorFloat & scores,
+        rng_t & rng) const
+{
+    _score_diff(model, diff, scores, rng);
+}
+
+template<bool cached>
+template<class Fun>
+struct ProductMixture_<cached>::feature_block_fun
+{
+    Fun & fun;
+    const ProductModel::Features & shareds;
+    const size_t begin;
+    const size_t end;
+
+    // features are positioned in read_value order
+    size_t offset (BB *) const { return 0; }
+    size_t offset (DD16 *) const
+    {
+        return offset(BB::null()) + shareds.bb.size();
+    }
+    size_t offset (DD256 *) const
+    {
+        return offset(DD16::null()) + shareds.dd16.size();
+    }
+    size_t offset (DPD *) const
+    {
+        return offset(DD256::null()) + shareds.dd256.size();
+    }
+    size_t offset (GP *) const
+    {
+        return offset(DPD::null()) + shareds.dpd.size();
+    }
+    size_t offset (NICH *) const
+    {
+        return offset(GP::null()) + shareds.gp.size();
+    }
+
+    template<class T>
+    void operator() (
+            T * t,
+            size_t i,
+            const typename T::Value & value)
+    {
+        const size_t position = offset(t) + i;
+        if (begin <= position and position < end) {
+            fun(t, i, value);
+        }
+    }
+};
+
+template<bool cached>
+inline void ProductMixture_<cached>::_init_block_scores (
+        const ProductModel & model,
+        size_t begin,
+        VectorFloat & scores) const
 {
     LOOM_ASSERT1(maintaining_cache, "cache is not being maintained");
 
     const size_t size = clustering.counts().size();
     scores.resize(size);
-    clustering.score_value(model.clustering, scores);
+    if (begin == 0) {
+        clustering.score_value(model.clustering, scores);
+    } else {
+        std::fill(scores.begin(), scores.end(), 0.f);
+    }
+}
+
+template<bool cached>
+template<class ValueType>
+inline void ProductMixture_<cached>::_score_value_block (
+        const ProductModel & model,
+        const ValueType & value,
+        size_t begin,
+        size_t end,
+        VectorFloat & scores,
+        rng_t & rng) const
+{
+    _init_block_scores(model, begin, scores);
+    score_value_fun fun = {features, model.features, scores, rng};
+    feature_block_fun<score_value_fun> block = {
+        fun,
+        model.features,
+        begin,
+        end};
+    read_value(block, model.schema, features, value);
+}
+
+template<bool cached>
+template<class Diff>
+inline void ProductMixture_<cached>::_score_diff_block (
+        const ProductModel & model,
+        const Diff & diff,
+        size_t begin,
+        size_t end,
+        VectorFloat & scores,
+        rng_t & rng) const
+{
+    _init_block_scores(model, begin, scores);
+    const size_t size = scores.size();
     score_value_fun fun = {features, model.features, scores, rng};
-    read_value(fun, model.schema, features, diff.pos());
+    feature_block_fun<score_value_fun> block = {
+        fun,
+        model.features,
+        begin,
+        end};
+    read_value(block, model.schema, features, diff.pos());
     if (model.schema.total_size(diff.neg())) {
         distributions::vector_negate(size, scores.data());
-        read_value(fun, model.schema, features, diff.neg());
+        read_value(block, model.schema, features, diff.neg());
         distributions::vector_negate(size, scores.data());
     }
-    for (auto id : diff.tares()) {
-        LOOM_ASSERT1(id < model.tares.size(), "bad tare id: " << id);
-        const auto & tare_scores = tare_caches[id].scores;
-        if (LOOM_DEBUG_LEVEL >= 1) {
-            LOOM_ASSERT_EQ(tare_scores.size(), size);
+    if (begin == 0) {
+        for (auto id : diff.tares()) {
+            LOOM_ASSERT1(id < model.tares.size(), "bad tare id: " << id);
+            const auto & tare_scores = tare_caches[id].scores;
+            distributions::vector_add(size, scores.data(), tare_scores.data());
         }
-        distributions::vector_add(size, scores.data(), tare_scores.data());
     }
 }
 
+template<>
+void ProductMixture_<true>::score_value_block (
+        const ProductModel & model,
+        const Value & value,
+        size_t begin,
+        size_t end,
+        VectorFloat & scores,
+        rng_t & rng) const
+{
+    _score_value_block(model, value, begin, end, scores, rng);
+}
+
+template<>
+void ProductMixture_<true>::score_value_block (
+        const ProductModel & model,
+        const FlatValue & value,
+        size_t begin,
+        size_t end,
+        VectorFloat & scores,
+        rng_t & rng) const
+{
+    _score_value_block(model, value, begin, end, scores, rng);
+}
+
+template<>
+void ProductMixture_<true>::score_diff_block (
+        const ProductModel & model,
+        const Value::Diff & diff,
+        size_t begin,
+        size_t end,
+        VectorFloat & scores,
+        rng_t & rng) const
+{
+    _score_diff_block(model, diff, begin, end, scores, rng);
+}
+
+template<>
+void ProductMixture_<true>::score_diff_block (
+        const ProductModel & model,
+        const FlatDiff & diff,
+        size_t begin,
+        size_t end,
+        VectorFloat & scores,
+        rng_t & rng) const
+{
+    _score_diff_block(model, diff, begin, end, scores, rng);
+}
+
 template<bool cached>
 struct ProductMixture_<cached>::score_value_features_fun
 {
@@ -511,6 +999,7 @@ template<bool cached>
 struct ProductMixture_<cached>::init_feature_cache_fun
 {
     const ProductModel::Features & shareds;
+    const CachePrecision precision;
     rng_t & rng;
 
     template<class T>
@@ -519,7 +1008,7 @@ struct ProductMixture_<cached>::init_feature_cache_fun
             size_t i,
             typename T::template Mixture<cached>::t & mixture)
     {
-        mixture.init(shareds[t][i], rng);
+        init_cache(mixture, shareds[t][i], precision, rng);
     }
 };
 
@@ -530,7 +1019,8 @@ void ProductMixture_<cached>::init_feature_cache (
         rng_t & rng)
 {
     if (maintaining_cache) {
-        init_feature_cache_fun fun = {model.features, rng};
+        init_feature_cache_fun fun =
+            {model.features, model.score_cache_precision, rng};
         for_one_feature(fun, features, featureid);
     }
 }
@@ -654,6 +1144,7 @@ struct ProductMixture_<cached>::init_unobserved_fun
     const ProductModel::Features & shared_features;
     Features & mixture_features;
     const bool maintaining_cache;
+    const CachePrecision precision;
     rng_t & rng;
 
     template<class T>
@@ -671,7 +1162,7 @@ struct ProductMixture_<cached>::init_unobserved_fun
                 group.init(shared, rng);
             }
             if (maintaining_cache) {
-                mixture.init(shared, rng);
+                init_cache(mixture, shared, precision, rng);
             }
         }
     }
@@ -691,6 +1182,7 @@ void ProductMixture_<cached>::init_unobserved (
         model.features,
         features,
         maintaining_cache,
+        model.score_cache_precision,
         rng};
     for_each_feature_type(fun);
 
@@ -770,6 +1262,7 @@ struct ProductMixture_<cached>::init_groups_fun
     const ProductModel::Features & shareds;
     const size_t empty_group_count;
     const bool maintaining_cache;
+    const CachePrecision precision;
     rng_t & rng;
 
     template<class T>
@@ -787,7 +1280,7 @@ struct ProductMixture_<cached>::init_groups_fun
             groups[i].init(shared, rng);
         }
         if (maintaining_cache) {
-            mixture.init(shared, rng);
+            init_cache(mixture, shared, precision, rng);
         }
     }
 };
@@ -803,6 +1296,7 @@ void ProductMixture_<cached>::load_step_2_of_3 (
         model.features,
         empty_group_count,
         maintaining_cache,
+        model.score_cache_precision,
         rng};
     for_one_feature(fun, features, featureid);
 }
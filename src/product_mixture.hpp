@@ -110,12 +110,42 @@ struct ProductMixture_
             const Value::Diff & diff,
             rng_t & rng);
 
+    void add_value (
+            const ProductModel & model,
+            size_t groupid,
+            const FlatValue & value,
+            rng_t & rng);
+
+    void remove_value (
+            const ProductModel & model,
+            size_t groupid,
+            const FlatValue & value,
+            rng_t & rng);
+
+    void add_diff (
+            const ProductModel & model,
+            size_t groupid,
+            const FlatDiff & diff,
+            rng_t & rng);
+
+    void remove_diff (
+            const ProductModel & model,
+            size_t groupid,
+            const FlatDiff & diff,
+            rng_t & rng);
+
     void add_diff_step_1_of_2 (
             const ProductModel & model,
             size_t groupid,
             const Value::Diff & diff,
             rng_t & rng);
 
+    void add_diff_step_1_of_2 (
+            const ProductModel & model,
+            size_t groupid,
+            const FlatDiff & diff,
+            rng_t & rng);
+
     void add_diff_step_2_of_2 (
             const ProductModel & model,
             rng_t & rng);
@@ -136,6 +166,53 @@ struct ProductMixture_
             VectorFloat & scores,
             rng_t & rng) const;
 
+    void score_value (
+            const ProductModel & model,
+            const FlatValue & value,
+            VectorFloat & scores,
+            rng_t & rng) const;
+
+    void score_diff (
+            const ProductModel & model,
+            const FlatDiff & diff,
+            VectorFloat & scores,
+            rng_t & rng) const;
+
+    // Block scoring scores only features in [begin, end), for splitting
+    // a wide kind across threads; the partial scores of all blocks sum to
+    // the full score. Clustering and tare terms are added to block 0 only.
+    void score_value_block (
+            const ProductModel & model,
+            const Value & value,
+            size_t begin,
+            size_t end,
+            VectorFloat & scores,
+            rng_t & rng) const;
+
+    void score_value_block (
+            const ProductModel & model,
+            const FlatValue & value,
+            size_t begin,
+            size_t end,
+            VectorFloat & scores,
+            rng_t & rng) const;
+
+    void score_diff_block (
+            const ProductModel & model,
+            const Value::Diff & diff,
+            size_t begin,
+            size_t end,
+            VectorFloat & scores,
+            rng_t & rng) const;
+
+    void score_diff_block (
+            const ProductModel & model,
+            const FlatDiff & diff,
+            size_t begin,
+            size_t end,
+            VectorFloat & scores,
+            rng_t & rng) const;
+
     void score_value_features (
             const ProductModel & model,
             const Value & value,
@@ -192,6 +269,78 @@ private:
             size_t groupid,
             rng_t & rng);
 
+    template<class ValueType>
+    void _add_value (
+            const ProductModel & model,
+            size_t groupid,
+            const ValueType & value,
+            rng_t & rng);
+
+    template<class ValueType>
+    void _remove_value (
+            const ProductModel & model,
+            size_t groupid,
+            const ValueType & value,
+            rng_t & rng);
+
+    template<class Diff>
+    void _add_diff (
+            const ProductModel & model,
+            size_t groupid,
+            const Diff & diff,
+            rng_t & rng);
+
+    template<class Diff>
+    void _remove_diff (
+            const ProductModel & model,
+            size_t groupid,
+            const Diff & diff,
+            rng_t & rng);
+
+    template<class Diff>
+    void _add_diff_step_1_of_2 (
+            const ProductModel & model,
+            size_t groupid,
+            const Diff & diff,
+            rng_t & rng);
+
+    template<class ValueType>
+    void _score_value (
+            const ProductModel & model,
+            const ValueType & value,
+            VectorFloat & scores,
+            rng_t & rng) const;
+
+    template<class Diff>
+    void _score_diff (
+            const ProductModel & model,
+            const Diff & diff,
+            VectorFloat & scores,
+            rng_t & rng) const;
+
+    void _init_block_scores (
+            const ProductModel & model,
+            size_t begin,
+            VectorFloat & scores) const;
+
+    template<class ValueType>
+    void _score_value_block (
+            const ProductModel & model,
+            const ValueType & value,
+            size_t begin,
+            size_t end,
+            VectorFloat & scores,
+            rng_t & rng) const;
+
+    template<class Diff>
+    void _score_diff_block (
+            const ProductModel & model,
+            const Diff & diff,
+            size_t begin,
+            size_t end,
+            VectorFloat & scores,
+            rng_t & rng) const;
+
     struct validate_fun;
     struct clear_fun;
     struct load_group_fun;
@@ -206,17 +355,34 @@ private:
     struct remove_value_fun;
     struct add_diff_fun;
     struct score_value_fun;
+    struct score_untiled_fun;
+    struct clear_tiled_fun;
+    struct score_tile_fun;
     struct score_value_features_fun;
     struct score_value_group_fun;
     struct score_feature_fun;
     struct score_data_fun;
     struct sample_fun;
 
+    template<class Fun>
+    struct feature_block_fun;
+
     template<class OtherMixture>
     struct move_feature_to_fun;
 
     template<bool other_cached>
     struct validate_subset_fun;
+
+    // (featureid, value) of each observed feature scored one tile at a time
+    struct TiledFeature
+    {
+        template<class T>
+        struct Container
+        {
+            typedef std::vector<std::pair<uint32_t, typename T::Value>> t;
+        };
+    };
+    typedef ForEachFeatureType<TiledFeature> TiledValues;
 };
 
 template<bool cached>
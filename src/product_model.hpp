@@ -53,6 +53,22 @@ struct ProductModel
     Features features;
     std::vector<Value> tares;
 
+    // precision of DD256 and DPD score caches, see compact_mixture.hpp
+    CachePrecision score_cache_precision;
+
+    // ProductMixture_::score_value and score_diff add all observed features
+    // to one tile of this many groups before moving to the next, so the
+    // tile of scores stays in L1 cache; 0 scores all groups at once.
+    // Scores are bitwise identical for any tile size. Only mixtures with
+    // score_value_range (those of -DLOOM_SIMD_MIXTURES builds) are tiled;
+    // others are added to all groups before the first tile.
+    size_t score_tile_size;
+
+    ProductModel () :
+        score_cache_precision(CachePrecision::FLOAT32),
+        score_tile_size(256)
+    {}
+
     void clear ();
 
     void load (
@@ -66,6 +82,10 @@ struct ProductModel
     void remove_value (const Value & value, rng_t & rng);
     void add_diff (const Value::Diff & diff, rng_t & rng);
     void remove_diff (const Value::Diff & diff, rng_t & rng);
+    void add_value (const FlatValue & value, rng_t & rng);
+    void remove_value (const FlatValue & value, rng_t & rng);
+    void add_diff (const FlatDiff & diff, rng_t & rng);
+    void remove_diff (const FlatDiff & diff, rng_t & rng);
     void realize (rng_t & rng);
 
     void validate () const;
@@ -150,6 +170,36 @@ inline void ProductModel::remove_diff (
     remove_value(diff.pos(), rng);
 }
 
+inline void ProductModel::add_value (
+        const FlatValue & value,
+        rng_t & rng)
+{
+    add_value_fun fun = {features, rng};
+    read_value(fun, schema, features, value);
+}
+
+inline void ProductModel::remove_value (
+        const FlatValue & value,
+        rng_t & rng)
+{
+    remove_value_fun fun = {features, rng};
+    read_value(fun, schema, features, value);
+}
+
+inline void ProductModel::add_diff (
+        const FlatDiff & diff,
+        rng_t & rng)
+{
+    add_value(diff.pos(), rng);
+}
+
+inline void ProductModel::remove_diff (
+        const FlatDiff & diff,
+        rng_t & rng)
+{
+    remove_value(diff.pos(), rng);
+}
+
 struct ProductModel::realize_fun
 {
     rng_t & rng;
@@ -31,6 +31,7 @@
 #include <loom/common.hpp>
 #include <loom/protobuf.hpp>
 #include <loom/models.hpp>
+#include <loom/flat_value.hpp>
 
 namespace loom
 {
@@ -169,6 +170,13 @@ struct ValueSchema
             + value.reals_size();
     }
 
+    static size_t total_size (const FlatValue & value)
+    {
+        return value.booleans_size()
+            + value.counts_size()
+            + value.reals_size();
+    }
+
     void clear ()
     {
         booleans_size = 0;
@@ -379,6 +387,48 @@ struct ValueSchema
             and (diff.tares_size() or not total_size(diff.neg()));
     }
 
+    void validate (const FlatValue & value) const
+    {
+        const auto & observed = value.observed();
+        switch (observed.sparsity()) {
+            case ProductValue::Observed::ALL:
+                LOOM_ASSERT_EQ(value.booleans_size(), booleans_size);
+                LOOM_ASSERT_EQ(value.counts_size(), counts_size);
+                LOOM_ASSERT_EQ(value.reals_size(), reals_size);
+                return;
+
+            case ProductValue::Observed::DENSE:
+                LOOM_ASSERT_EQ(observed.dense_size(), total_size());
+                LOOM_ASSERT_EQ(
+                    std::count(
+                        observed.dense().begin(),
+                        observed.dense().end(),
+                        true),
+                    total_size(value));
+                return;
+
+            case ProductValue::Observed::SPARSE:
+                for (size_t i = 1; i < observed.sparse_size(); ++i) {
+                    LOOM_ASSERT_LT(observed.sparse(i - 1), observed.sparse(i));
+                }
+                LOOM_ASSERT_EQ(observed.sparse_size(), total_size(value));
+                return;
+
+            case ProductValue::Observed::NONE:
+                LOOM_ASSERT_EQ(total_size(value), 0);
+                return;
+        }
+    }
+
+    void validate (const FlatDiff & diff) const
+    {
+        validate(diff.pos());
+        validate(diff.neg());
+        LOOM_ASSERT(
+            diff.tares_size() or not total_size(diff.neg()),
+            "diff has neg parts but no tares");
+    }
+
     template<class Derived>
     void validate (const ForEachFeatureType<Derived> & features) const
     {
@@ -501,9 +551,9 @@ struct ValueSchema
         }
     }
 
-    template<class Fun>
+    template<class Observed, class Fun>
     void for_each (
-            const ProductValue::Observed & observed,
+            const Observed & observed,
             const Fun & fun) const
     {
         const size_t size = total_size();
@@ -554,6 +604,27 @@ struct ValueSchema
         simplify(* diff.mutable_neg());
     }
 
+    void simplify (FlatValue & value) const
+    {
+        const size_t size = total_size();
+        const size_t count = total_size(value);
+        if (count == 0) {
+            value.mutable_observed()->clear(ProductValue::Observed::NONE);
+        } else if (count == size) {
+            value.mutable_observed()->clear(ProductValue::Observed::ALL);
+        }
+
+        if (LOOM_DEBUG_LEVEL >= 2) {
+            validate(value);
+        }
+    }
+
+    void simplify (FlatDiff & diff) const
+    {
+        simplify(* diff.mutable_pos());
+        simplify(* diff.mutable_neg());
+    }
+
     template<class Fun>
     void for_each_datatype (Fun & fun) const
     {
@@ -583,11 +654,11 @@ struct ValueSchema
 //----------------------------------------------------------------------------
 // Read
 
-template<class Feature, class Fun>
+template<class Feature, class Fun, class Value>
 inline void read_value_all (
         Fun & fun,
         const ForEachFeatureType<Feature> & model_schema,
-        const ProductValue & value)
+        const Value & value)
 {
     if (value.booleans_size()) {
         auto packed = value.booleans().begin();
@@ -623,11 +694,11 @@ inline void read_value_all (
     }
 }
 
-template<class Feature, class Fun>
+template<class Feature, class Fun, class Value>
 inline void read_value_dense (
         Fun & fun,
         const ForEachFeatureType<Feature> & model_schema,
-        const ProductValue & value)
+        const Value & value)
 {
     auto observed = value.observed().dense().begin();
     const auto end = value.observed().dense().end();
@@ -690,11 +761,11 @@ inline void read_value_dense (
     LOOM_ASSERT2(observed == end, "programmer error");
 }
 
-template<class Feature, class Fun>
+template<class Feature, class Fun, class Value>
 inline void read_value_sparse (
         Fun & fun,
         const ForEachFeatureType<Feature> & model_schema,
-        const ProductValue & value)
+        const Value & value)
 {
     auto i = value.observed().sparse().begin();
     const auto end = value.observed().sparse().end();
@@ -732,12 +803,12 @@ inline void read_value_sparse (
     }
 }
 
-template<class Feature, class Fun>
+template<class Feature, class Fun, class Value>
 inline void read_value (
         Fun & fun,
         const ValueSchema & value_schema,
         const ForEachFeatureType<Feature> & model_schema,
-        const ProductValue & value)
+        const Value & value)
 {
     try {
         if (LOOM_DEBUG_LEVEL >= 2) {
@@ -963,6 +1034,10 @@ struct ValueSplitter : noncopyable
             const ProductValue::Diff & full_diff,
             std::vector<ProductValue::Diff> & partial_diffs) const;
 
+    void split (
+            const FlatDiff & full_diff,
+            std::vector<FlatDiff> & partial_diffs) const;
+
     void join (
             ProductValue & full_value,
             const std::vector<ProductValue> & partial_values) const;
@@ -993,6 +1068,12 @@ private:
             ProductValue & full_value,
             const std::vector<const ProductValue *> & partial_values) const;
 
+    template<class GetPart>
+    void split (
+            const FlatValue & full_value,
+            std::vector<FlatDiff> & partial_diffs,
+            const GetPart & get_part) const;
+
     void validate (const ProductValue & full_value) const;
     void validate (
             const std::vector<const ProductValue *> & partial_values) const;
@@ -1091,6 +1172,62 @@ inline void ValueSplitter::split (
     }
 }
 
+// This splits directly into sparse partial values,
+// which read identically to the partial values of the protobuf split.
+template<class GetPart>
+inline void ValueSplitter::split (
+        const FlatValue & full_value,
+        std::vector<FlatDiff> & partial_diffs,
+        const GetPart & get_part) const
+{
+    if (LOOM_DEBUG_LEVEL >= 2) {
+        schema_.validate(full_value);
+    }
+    for (auto & partial_diff : partial_diffs) {
+        get_part(partial_diff).clear(ProductValue::Observed::SPARSE);
+    }
+
+    const size_t counts_begin = schema_.booleans_size;
+    const size_t reals_begin = counts_begin + schema_.counts_size;
+    auto booleans = full_value.booleans().begin();
+    auto counts = full_value.counts().begin();
+    auto reals = full_value.reals().begin();
+    schema_.for_each(full_value.observed(), [&](size_t full_pos){
+        auto & partial_diff = partial_diffs[full_to_partid_[full_pos]];
+        FlatValue & partial_value = get_part(partial_diff);
+        partial_value.mutable_observed()->mutable_sparse()->push_back(
+            full_to_part_[full_pos]);
+        if (full_pos < counts_begin) {
+            partial_value.mutable_booleans()->push_back(*booleans++);
+        } else if (full_pos < reals_begin) {
+            partial_value.mutable_counts()->push_back(*counts++);
+        } else {
+            partial_value.mutable_reals()->push_back(*reals++);
+        }
+    });
+    LOOM_ASSERT1(
+        booleans == full_value.booleans().end() and
+        counts == full_value.counts().end() and
+        reals == full_value.reals().end(),
+        "programmer error");
+}
+
+inline void ValueSplitter::split (
+        const FlatDiff & full_diff,
+        std::vector<FlatDiff> & partial_diffs) const
+{
+    partial_diffs.resize(part_schemas_.size());
+    split(full_diff.pos(), partial_diffs, [](FlatDiff & diff) -> FlatValue & {
+        return * diff.mutable_pos();
+    });
+    split(full_diff.neg(), partial_diffs, [](FlatDiff & diff) -> FlatValue & {
+        return * diff.mutable_neg();
+    });
+    for (auto & partial_diff : partial_diffs) {
+        * partial_diff.mutable_tares() = full_diff.tares();
+    }
+}
+
 inline void ValueSplitter::join (
         ProductValue & full_value,
         const std::vector<ProductValue> & partial_values) const
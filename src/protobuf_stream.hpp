@@ -29,34 +29,170 @@
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <fcntl.h>
+#include <zlib.h>
 #include <vector>
 #include <google/protobuf/io/coded_stream.h>
 #include <google/protobuf/io/zero_copy_stream_impl.h>
 #include <google/protobuf/io/gzip_stream.h>
 #include <loom/common.hpp>
+#include <loom/block_stream.hpp>
+#include <loom/codec_stream.hpp>
+#include <loom/stream_index.hpp>
 
 namespace loom
 {
 namespace protobuf
 {
 
-inline bool endswith (const char * filename, const char * suffix)
+//----------------------------------------------------------------------------
+// Raw Message
+//
+// This either views a message in place, e.g. in a memory-mapped file,
+// or holds its own copy of the message.
+
+class RawMessage
 {
-    return strlen(filename) >= strlen(suffix) and
-        strcmp(filename + strlen(filename) - strlen(suffix), suffix) == 0;
-}
+public:
+
+    RawMessage () : data_(nullptr), size_(0) {}
+
+    const char * data () const { return data_; }
+    size_t size () const { return size_; }
+
+    void assign_view (const char * data, size_t size)
+    {
+        data_ = data;
+        size_ = size;
+    }
+
+    char * assign_copy (size_t size)
+    {
+        storage_.resize(size);
+        data_ = storage_.data();
+        size_ = size;
+        return storage_.data();
+    }
+
+private:
+
+    const char * data_;
+    size_t size_;
+    std::vector<char> storage_;
+};
+
+//----------------------------------------------------------------------------
+// Mapped Input Stream
+//
+// Uncompressed regular files are mapped read-only, so that raw messages
+// can be viewed without copying and the page cache is shared among
+// processes reading the same file.
+
+class MappedInputStream : public google::protobuf::io::ZeroCopyInputStream
+{
+public:
+
+    enum { max_chunk_size = 1 << 30 };
+
+    static bool is_mappable (int fid)
+    {
+        struct stat info;
+        return fstat(fid, & info) == 0 and S_ISREG(info.st_mode);
+    }
+
+    explicit MappedInputStream (int fid) :
+        data_(nullptr),
+        size_(0),
+        pos_(0)
+    {
+        struct stat info;
+        int status = fstat(fid, & info);
+        LOOM_ASSERT(status == 0, "failed to stat input file");
+        size_ = info.st_size;
+        if (size_) {
+            void * data = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fid, 0);
+            LOOM_ASSERT(data != MAP_FAILED, "failed to mmap input file");
+            madvise(data, size_, MADV_SEQUENTIAL);
+            data_ = static_cast<const char *>(data);
+        }
+    }
+
+    ~MappedInputStream ()
+    {
+        if (data_) {
+            munmap(const_cast<char *>(data_), size_);
+        }
+    }
+
+    void seek (uint64_t pos)
+    {
+        LOOM_ASSERT_LE(pos, size_);
+        pos_ = pos;
+    }
+
+    bool try_read_message (RawMessage & message)
+    {
+        if (LOOM_UNLIKELY(pos_ + 4 > size_)) {
+            LOOM_ASSERT(pos_ == size_, "truncated message header");
+            return false;
+        }
+        uint32_t message_size;
+        google::protobuf::io::CodedInputStream::ReadLittleEndian32FromArray(
+            reinterpret_cast<const google::protobuf::uint8 *>(data_ + pos_),
+            & message_size);
+        pos_ += 4;
+        LOOM_ASSERT_LE(pos_ + message_size, size_);
+        message.assign_view(data_ + pos_, message_size);
+        pos_ += message_size;
+        return true;
+    }
+
+    bool Next (const void ** data, int * size)
+    {
+        if (pos_ == size_) {
+            return false;
+        }
+        * data = data_ + pos_;
+        * size = std::min<uint64_t>(size_ - pos_, max_chunk_size);
+        pos_ += * size;
+        return true;
+    }
+
+    void BackUp (int count) { pos_ -= count; }
+
+    bool Skip (int count)
+    {
+        if (pos_ + count > size_) {
+            pos_ = size_;
+            return false;
+        }
+        pos_ += count;
+        return true;
+    }
+
+    google::protobuf::int64 ByteCount () const { return pos_; }
+
+private:
+
+    const char * data_;
+    uint64_t size_;
+    uint64_t pos_;
+};
+
+//----------------------------------------------------------------------------
+// Input File
 
 class InFile : noncopyable
 {
 public:
 
-    InFile (int fid) : fid_(fid)
+    InFile (int fid) : fid_(fid), index_tried_(false)
     {
         _open();
     }
 
-    InFile (const char * filename) : filename_(filename)
+    InFile (const char * filename) : filename_(filename), index_tried_(false)
     {
         LOOM_ASSERT(not filename_.empty(), "empty filename is not supported");
         _open();
@@ -74,9 +210,14 @@ public:
 
     void set_position (uint64_t target)
     {
+        if (const SidecarIndex::Point * point = _find_point(target)) {
+            if (target < position_ or position_ < point->position()) {
+                _reopen(point);
+            }
+        }
+
         if (target < position_) {
-            _close();
-            _open();
+            _reopen();
         }
 
         while (position_ < target) {
@@ -131,13 +272,46 @@ public:
         }
     }
 
+    bool try_read_stream (RawMessage & raw)
+    {
+        if (mapped_) {
+            if (LOOM_LIKELY(mapped_->try_read_message(raw))) {
+                ++position_;
+                return true;
+            } else {
+                return false;
+            }
+        }
+
+        google::protobuf::io::CodedInputStream coded(stream_);
+        uint32_t message_size = 0;
+        if (LOOM_LIKELY(coded.ReadLittleEndian32(& message_size))) {
+            auto old_limit = coded.PushLimit(message_size);
+            char * data = raw.assign_copy(message_size);
+            bool success = coded.ReadRaw(data, message_size);
+            LOOM_ASSERT(success, "failed to parse message from " << filename_);
+            coded.PopLimit(old_limit);
+            ++position_;
+            return true;
+        } else {
+            return false;
+        }
+    }
+
     template<class Message>
     void cyclic_read_stream (Message & message)
     {
         LOOM_ASSERT2(is_file(), "only files support cyclic_read_stream");
+        if (LOOM_UNLIKELY(blocks_ and not blocks_->cyclic())) {
+            blocks_->set_cyclic();
+        }
         if (LOOM_UNLIKELY(not try_read_stream(message))) {
-            _close();
-            _open();
+            if (blocks_) {
+                blocks_->resume();
+                position_ = 0;
+            } else {
+                _reopen();
+            }
             bool success = try_read_stream(message);
             LOOM_ASSERT(success, "stream is empty");
         }
@@ -148,16 +322,28 @@ public:
         bool is_file;
         uint64_t message_count;
         uint32_t max_message_size;
+        uint64_t total_bytes;
     };
 
     static StreamStats stream_stats (const char * filename)
     {
+        SidecarIndex index;
+        if (index.try_load(filename)) {
+            StreamStats stats;
+            stats.is_file = true;
+            stats.message_count = index.header().message_count();
+            stats.max_message_size = index.header().max_message_size();
+            stats.total_bytes = index.header().total_bytes();
+            return stats;
+        }
+
         InFile file(filename);
 
         StreamStats stats;
         stats.is_file = file.is_file();
         stats.message_count = 0;
         stats.max_message_size = 0;
+        stats.total_bytes = 0;
 
         while (true) {
             google::protobuf::io::CodedInputStream coded(file.stream_);
@@ -166,6 +352,7 @@ public:
                 bool success = coded.Skip(message_size);
                 LOOM_ASSERT(success, "failed to count " << filename);
                 ++stats.message_count;
+                stats.total_bytes += sizeof(uint32_t) + message_size;
                 stats.max_message_size =
                     std::max(stats.max_message_size, message_size);
             } else {
@@ -177,8 +364,39 @@ public:
 
 private:
 
-    void _open ()
+    const SidecarIndex::Point * _find_point (uint64_t target)
+    {
+        if (not is_file()) {
+            return nullptr;
+        }
+        if (LOOM_UNLIKELY(not index_tried_)) {
+            index_.try_load(filename_);
+            index_tried_ = true;
+        }
+        return index_.find(target);
+    }
+
+    // mapped files are never unmapped here, so earlier views remain valid
+    void _reopen (const SidecarIndex::Point * point = nullptr)
     {
+        if (mapped_) {
+            mapped_->seek(point ? point->offset() : 0);
+            position_ = point ? point->position() : 0;
+        } else {
+            _close();
+            _open(point);
+        }
+    }
+
+    void _open (const SidecarIndex::Point * point = nullptr)
+    {
+        file_ = nullptr;
+        gzip_ = nullptr;
+        codec_ = nullptr;
+        blocks_ = nullptr;
+        mapped_ = nullptr;
+        position_ = point ? point->position() : 0;
+
         if (filename_.empty()) {
             is_file_ = false;
         } else if (filename_ == "-" or filename_ == "-.gz") {
@@ -188,24 +406,68 @@ private:
             is_file_ = true;
             fid_ = open(filename_.c_str(), O_RDONLY | O_NOATIME);
             LOOM_ASSERT(fid_ != -1, "failed to open input file " << filename_);
+            if (point) {
+                off_t offset = point->offset() - (point->bits() ? 1 : 0);
+                LOOM_ASSERT(
+                    lseek(fid_, offset, SEEK_SET) == offset,
+                    "failed to seek in " << filename_);
+            }
+        }
+
+        if (endswith(filename_.c_str(), ".bgz")) {
+            blocks_ = new BlockInputStream(fid_);
+            stream_ = blocks_;
+            return;
+        }
+
+        const Codec::Type codec = Codec::from_filename(filename_.c_str());
+        if (codec != Codec::NONE) {
+            LOOM_ASSERT(not point, "cannot seek in " << filename_);
+            file_ = new google::protobuf::io::FileInputStream(fid_);
+            codec_ = Codec::new_input_stream(codec, file_);
+            stream_ = codec_;
+            return;
+        }
+
+        if (is_file_ and
+            not endswith(filename_.c_str(), ".gz") and
+            MappedInputStream::is_mappable(fid_))
+        {
+            mapped_ = new MappedInputStream(fid_);
+            if (point) {
+                mapped_->seek(point->offset());
+            }
+            stream_ = mapped_;
+            return;
         }
 
         file_ = new google::protobuf::io::FileInputStream(fid_);
 
         if (endswith(filename_.c_str(), ".gz")) {
-            gzip_ = new google::protobuf::io::GzipInputStream(file_);
+            if (point) {
+                auto * inflate = new InflateInputStream(file_, * point);
+                auto * adaptor =
+                    new google::protobuf::io::CopyingInputStreamAdaptor(
+                        inflate);
+                adaptor->SetOwnsCopyingStream(true);
+                gzip_ = adaptor;
+                bool success = gzip_->Skip(point->skip());
+                LOOM_ASSERT(success, "failed to seek in " << filename_);
+            } else {
+                gzip_ = new google::protobuf::io::GzipInputStream(file_);
+            }
             stream_ = gzip_;
         } else {
-            gzip_ = nullptr;
             stream_ = file_;
         }
-
-        position_ = 0;
     }
 
     void _close ()
     {
+        delete mapped_;
+        delete blocks_;
         delete gzip_;
+        delete codec_;
         delete file_;
         if (is_file()) {
             close(fid_);
@@ -216,17 +478,96 @@ private:
     int fid_;
     bool is_file_;
     google::protobuf::io::FileInputStream * file_;
-    google::protobuf::io::GzipInputStream * gzip_;
+    google::protobuf::io::ZeroCopyInputStream * gzip_;
+    google::protobuf::io::ZeroCopyInputStream * codec_;
+    BlockInputStream * blocks_;
+    MappedInputStream * mapped_;
     google::protobuf::io::ZeroCopyInputStream * stream_;
     uint64_t position_;
+    SidecarIndex index_;
+    bool index_tried_;
 };
 
 
+//----------------------------------------------------------------------------
+// Checksum Output Stream
+//
+// This computes a crc32 of all bytes passing through to an underlying
+// stream.  Bytes are checksummed once committed by BackUp() or Next().
+
+class ChecksumOutputStream : public google::protobuf::io::ZeroCopyOutputStream
+{
+public:
+
+    explicit ChecksumOutputStream (
+            google::protobuf::io::ZeroCopyOutputStream * base) :
+        base_(base),
+        pending_(nullptr),
+        pending_size_(0),
+        checksum_(crc32(0, Z_NULL, 0))
+    {
+    }
+
+    bool Next (void ** data, int * size)
+    {
+        _commit();
+        if (base_->Next(data, size)) {
+            pending_ = static_cast<const Bytef *>(* data);
+            pending_size_ = * size;
+            return true;
+        } else {
+            return false;
+        }
+    }
+
+    void BackUp (int count)
+    {
+        pending_size_ -= count;
+        _commit();
+        base_->BackUp(count);
+    }
+
+    google::protobuf::int64 ByteCount () const { return base_->ByteCount(); }
+
+    // this should only be called between messages
+    uint32_t checksum ()
+    {
+        _commit();
+        return checksum_;
+    }
+
+private:
+
+    void _commit ()
+    {
+        if (pending_size_) {
+            checksum_ = crc32(checksum_, pending_, pending_size_);
+            pending_size_ = 0;
+        }
+    }
+
+    google::protobuf::io::ZeroCopyOutputStream * const base_;
+    const Bytef * pending_;
+    int pending_size_;
+    uint32_t checksum_;
+};
+
+//----------------------------------------------------------------------------
+// Output File
+//
+// With the INDEX flag, an OutFile tracks stream statistics and writes
+// them to a sidecar index on close, so that InFile::stream_stats need not
+// read through the file.  Uncompressed and .bgz streams are also indexed
+// for seeking; .gz streams can be indexed by SidecarIndex::build.
+
 class OutFile : noncopyable
 {
 public:
 
-    enum { APPEND = O_APPEND };
+    enum {
+        APPEND = 1 << 0,
+        INDEX = 1 << 1
+    };
 
     OutFile (int fid) : fid_(fid)
     {
@@ -241,11 +582,25 @@ public:
 
     ~OutFile ()
     {
+        const bool seekable = not gzip_ and not codec_;
+        uint64_t total_bytes = 0;
+        uint32_t checksum = 0;
+        if (checksum_) {
+            total_bytes = checksum_->ByteCount();
+            checksum = checksum_->checksum();
+            delete checksum_;
+        }
+        delete blocks_;
         delete gzip_;
+        delete codec_;
         delete file_;
         if (is_file()) {
             close(fid_);
         }
+        if (index_) {
+            index_->dump(filename_, total_bytes, checksum, seekable);
+            delete index_;
+        }
     }
 
     const char * filename () const { return filename_.c_str(); }
@@ -262,32 +617,88 @@ public:
     template<class Message>
     void write_stream (Message & message)
     {
-        google::protobuf::io::CodedOutputStream coded(stream_);
         LOOM_ASSERT1(message.IsInitialized(), "message not initialized");
         uint32_t message_size = message.ByteSize();
-        coded.WriteLittleEndian32(message_size);
-        message.SerializeWithCachedSizes(& coded);
+        _begin_message();
+        {
+            google::protobuf::io::CodedOutputStream coded(stream_);
+            coded.WriteLittleEndian32(message_size);
+            message.SerializeWithCachedSizes(& coded);
+        }
+        _end_message(message_size);
     }
 
     void write_stream (const std::vector<char> & raw)
     {
-        google::protobuf::io::CodedOutputStream coded(stream_);
-        coded.WriteLittleEndian32(raw.size());
-        coded.WriteRaw(raw.data(), raw.size());
+        _write_raw(raw.data(), raw.size());
+    }
+
+    void write_stream (const RawMessage & raw)
+    {
+        _write_raw(raw.data(), raw.size());
     }
 
     void flush ()
     {
-        if (gzip_) {
-            gzip_->Flush();
+        if (blocks_) {
+            blocks_->flush();
+        } else {
+            if (gzip_) {
+                gzip_->Flush();
+            }
+            if (codec_) {
+                codec_->Flush();
+            }
+            file_->Flush();
         }
-        file_->Flush();
     }
 
 private:
 
+    void _write_raw (const char * data, uint32_t size)
+    {
+        _begin_message();
+        {
+            google::protobuf::io::CodedOutputStream coded(stream_);
+            coded.WriteLittleEndian32(size);
+            coded.WriteRaw(data, size);
+        }
+        _end_message(size);
+    }
+
+    void _begin_message ()
+    {
+        if (index_ and not gzip_ and not codec_ and not blocks_) {
+            const uint64_t offset = checksum_->ByteCount();
+            if (offset >= last_point_offset_ + SidecarIndex::raw_span) {
+                index_->add_point(index_->header().message_count(), offset);
+                last_point_offset_ = offset;
+            }
+        }
+    }
+
+    void _end_message (uint32_t message_size)
+    {
+        if (index_) {
+            index_->add_message(message_size);
+        }
+        if (blocks_ and blocks_->end_message() and index_) {
+            index_->add_point(
+                index_->header().message_count(),
+                blocks_->file_size());
+        }
+    }
+
     void _open (int flags = 0)
     {
+        file_ = nullptr;
+        gzip_ = nullptr;
+        codec_ = nullptr;
+        blocks_ = nullptr;
+        checksum_ = nullptr;
+        index_ = nullptr;
+        last_point_offset_ = 0;
+
         if (filename_.empty()) {
             is_file_ = false;
         } else if (filename_ == "-" or filename_ == "-.gz") {
@@ -297,18 +708,34 @@ private:
             is_file_ = true;
             fid_ = open(
                 filename_.c_str(),
-                O_WRONLY | O_CREAT | O_TRUNC | flags, 0664);
+                O_WRONLY | O_CREAT | O_TRUNC | (flags & APPEND ? O_APPEND : 0),
+                0664);
             LOOM_ASSERT(fid_ != -1, "failed to open output file " << filename_);
+            unlink(SidecarIndex::filename(filename_).c_str());
         }
 
-        file_ = new google::protobuf::io::FileOutputStream(fid_);
-
-        if (endswith(filename_.c_str(), ".gz")) {
-            gzip_ = new google::protobuf::io::GzipOutputStream(file_);
-            stream_ = gzip_;
+        if (endswith(filename_.c_str(), ".bgz")) {
+            blocks_ = new BlockOutputStream(fid_);
+            stream_ = blocks_;
         } else {
-            gzip_ = nullptr;
-            stream_ = file_;
+            file_ = new google::protobuf::io::FileOutputStream(fid_);
+            const Codec::Type codec = Codec::from_filename(filename_.c_str());
+            if (codec != Codec::NONE) {
+                codec_ = Codec::new_output_stream(codec, file_);
+                stream_ = codec_;
+            } else if (endswith(filename_.c_str(), ".gz")) {
+                gzip_ = new google::protobuf::io::GzipOutputStream(file_);
+                stream_ = gzip_;
+            } else {
+                stream_ = file_;
+            }
+        }
+
+        if ((flags & INDEX) and is_file_) {
+            LOOM_ASSERT(not (flags & APPEND), "cannot index appended streams");
+            checksum_ = new ChecksumOutputStream(stream_);
+            stream_ = checksum_;
+            index_ = new SidecarIndex();
         }
     }
 
@@ -317,6 +744,11 @@ private:
     bool is_file_;
     google::protobuf::io::FileOutputStream * file_;
     google::protobuf::io::GzipOutputStream * gzip_;
+    google::protobuf::io::CopyingOutputStreamAdaptor * codec_;
+    BlockOutputStream * blocks_;
+    ChecksumOutputStream * checksum_;
+    SidecarIndex * index_;
+    uint64_t last_point_offset_;
     google::protobuf::io::ZeroCopyOutputStream * stream_;
 };
 
@@ -460,15 +460,10 @@ void QueryServer::call (
     protobuf::Row update_row;
     update_row.set_id(0);
     * update_row.mutable_diff() = request.update_data();
-    
-    
-    //FIXME is there a better way to get the row count?
-    size_t row_count = 0;
-    protobuf::InFile all_rows(rows_in_);
-    while (all_rows.try_read_stream(row)) {
-        row_count++;
-    }
-            
+
+    const size_t row_count =
+        protobuf::InFile::stream_stats(rows_in_).message_count;
+
     for (const auto * cross_cat : cross_cats_) {
         cat_kernels.push_back(
             new CatKernel(
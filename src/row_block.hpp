@@ -0,0 +1,682 @@
+// Copyright (c) 2014, Salesforce.com, Inc.  All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// - Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+// - Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+// - Neither the name of Salesforce.com nor the names of its contributors
+//   may be used to endorse or promote products derived from this
+//   software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+// FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+// COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+// BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+// OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+// TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#pragma once
+
+#include <vector>
+#include <cstring>
+#include <loom/common.hpp>
+#include <loom/protobuf_stream.hpp>
+#include <loom/product_value.hpp>
+#include <loom/flat_value.hpp>
+
+namespace loom
+{
+
+//----------------------------------------------------------------------------
+// Row Blocks
+//
+// A columnar row stream stores blocks of block_size rows (the last block
+// may be shorter), each block as one message of an ordinary stream,
+// so that compression and sidecar indices work unchanged.
+// Each block is a sequence of columns, each prefixed by its uint32 size:
+//
+//   header       magic, block_size, row_count, and schema sizes
+//   ids          uint64 per row
+//   tare_counts  uint32 per row
+//   tares        uint32 per tare
+//   then for each of pos and neg:
+//     observed   bitmap of row_count * total_size bits
+//     booleans   observed booleans, bit-packed
+//     counts     observed counts, varint encoded
+//     reals      observed reals, float32
+//
+// Columnar streams are named *.pbc, optionally followed by a codec suffix.
+
+namespace row_block
+{
+
+enum { MAGIC = 0x42434d4c };  // "LMCB"
+enum { HEADER_SIZE = 6 };
+
+inline bool is_columnar (const char * filename)
+{
+    return protobuf::endswith(filename, ".pbc")
+        or protobuf::endswith(filename, ".pbc.gz")
+        or protobuf::endswith(filename, ".pbc.bgz")
+        or protobuf::endswith(filename, ".pbc.zst")
+        or protobuf::endswith(filename, ".pbc.lz4");
+}
+
+inline bool get_bit (const uint8_t * bits, size_t pos)
+{
+    return (bits[pos >> 3] >> (pos & 7)) & 1;
+}
+
+inline void set_bit (uint8_t * bits, size_t pos)
+{
+    bits[pos >> 3] |= uint8_t(1) << (pos & 7);
+}
+
+} // namespace row_block
+
+//----------------------------------------------------------------------------
+// Row Block Writer
+
+class RowBlockWriter : noncopyable
+{
+public:
+
+    RowBlockWriter (const ValueSchema & schema, size_t block_size) :
+        schema_(schema),
+        block_size_(block_size)
+    {
+        LOOM_ASSERT_LT(0, block_size);
+        clear();
+    }
+
+    size_t size () const { return ids_.size(); }
+    bool empty () const { return ids_.empty(); }
+    bool full () const { return ids_.size() == block_size_; }
+
+    void clear ()
+    {
+        ids_.clear();
+        tare_counts_.clear();
+        tares_.clear();
+        pos_.clear();
+        neg_.clear();
+    }
+
+    void add (const FlatRow & row)
+    {
+        LOOM_ASSERT1(not full(), "row block is full");
+        schema_.validate(row.diff());
+        const size_t row_number = ids_.size();
+        ids_.push_back(row.id());
+        const auto & tares = row.diff().tares();
+        tare_counts_.push_back(tares.size());
+        tares_.insert(tares_.end(), tares.begin(), tares.end());
+        pos_.add(schema_, row_number, row.diff().pos());
+        neg_.add(schema_, row_number, row.diff().neg());
+    }
+
+    void dump (std::vector<char> & message) const
+    {
+        message.clear();
+        const uint32_t header[row_block::HEADER_SIZE] = {
+            row_block::MAGIC,
+            static_cast<uint32_t>(block_size_),
+            static_cast<uint32_t>(ids_.size()),
+            static_cast<uint32_t>(schema_.booleans_size),
+            static_cast<uint32_t>(schema_.counts_size),
+            static_cast<uint32_t>(schema_.reals_size)
+        };
+        _dump_column(message, header, row_block::HEADER_SIZE);
+        _dump_column(message, ids_.data(), ids_.size());
+        _dump_column(message, tare_counts_.data(), tare_counts_.size());
+        _dump_column(message, tares_.data(), tares_.size());
+        pos_.dump(message);
+        neg_.dump(message);
+    }
+
+private:
+
+    struct Part
+    {
+        std::vector<uint8_t> observed;
+        std::vector<uint8_t> booleans;
+        size_t boolean_count;
+        std::vector<uint8_t> counts;
+        std::vector<float> reals;
+
+        void clear ()
+        {
+            observed.clear();
+            booleans.clear();
+            boolean_count = 0;
+            counts.clear();
+            reals.clear();
+        }
+
+        void add (
+                const ValueSchema & schema,
+                size_t row_number,
+                const FlatValue & value)
+        {
+            const size_t begin = row_number * schema.total_size();
+            observed.resize((begin + schema.total_size() + 7) / 8, 0);
+            schema.for_each(value.observed(), [&](size_t i){
+                row_block::set_bit(observed.data(), begin + i);
+            });
+
+            for (auto b : value.booleans()) {
+                if (boolean_count % 8 == 0) {
+                    booleans.push_back(0);
+                }
+                if (b) {
+                    row_block::set_bit(booleans.data(), boolean_count);
+                }
+                ++boolean_count;
+            }
+
+            for (uint32_t c : value.counts()) {
+                while (c >= 0x80) {
+                    counts.push_back(uint8_t(c) | 0x80);
+                    c >>= 7;
+                }
+                counts.push_back(uint8_t(c));
+            }
+
+            reals.insert(reals.end(), value.reals().begin(), value.reals().end());
+        }
+
+        void dump (std::vector<char> & message) const
+        {
+            _dump_column(message, observed.data(), observed.size());
+            _dump_column(message, booleans.data(), booleans.size());
+            _dump_column(message, counts.data(), counts.size());
+            _dump_column(message, reals.data(), reals.size());
+        }
+    };
+
+    template<class T>
+    static void _dump_column (
+            std::vector<char> & message,
+            const T * data,
+            size_t size)
+    {
+        // columns are little-endian, as are supported hosts
+        const uint32_t byte_size = sizeof(T) * size;
+        const char * begin = reinterpret_cast<const char *>(& byte_size);
+        message.insert(message.end(), begin, begin + sizeof(uint32_t));
+        begin = reinterpret_cast<const char *>(data);
+        message.insert(message.end(), begin, begin + byte_size);
+    }
+
+    const ValueSchema schema_;
+    const size_t block_size_;
+    std::vector<uint64_t> ids_;
+    std::vector<uint32_t> tare_counts_;
+    std::vector<uint32_t> tares_;
+    Part pos_;
+    Part neg_;
+};
+
+//----------------------------------------------------------------------------
+// Row Block Reader
+//
+// The reader views a block in place and decodes rows sequentially
+// into FlatRows, with observed sets as ALL, NONE or SPARSE.
+
+class RowBlockReader
+{
+public:
+
+    RowBlockReader () : block_size_(0), row_count_(0), row_number_(0) {}
+
+    size_t block_size () const { return block_size_; }
+    size_t size () const { return row_count_; }
+    bool done () const { return row_number_ == row_count_; }
+
+    void clear ()
+    {
+        row_count_ = 0;
+        row_number_ = 0;
+    }
+
+    void load (const char * data, size_t size)
+    {
+        Column message(data, size);
+        Column header = message.column();
+        uint32_t values[row_block::HEADER_SIZE];
+        LOOM_ASSERT_EQ(header.size, sizeof(values));
+        memcpy(values, header.data, sizeof(values));
+        LOOM_ASSERT(values[0] == row_block::MAGIC, "not a row block");
+        block_size_ = values[1];
+        row_count_ = values[2];
+        row_number_ = 0;
+        schema_.booleans_size = values[3];
+        schema_.counts_size = values[4];
+        schema_.reals_size = values[5];
+        LOOM_ASSERT_LE(row_count_, block_size_);
+
+        ids_ = message.column();
+        tare_counts_ = message.column();
+        tares_ = message.column();
+        LOOM_ASSERT_EQ(ids_.size, sizeof(uint64_t) * row_count_);
+        LOOM_ASSERT_EQ(tare_counts_.size, sizeof(uint32_t) * row_count_);
+        pos_.load(message, schema_, row_count_);
+        neg_.load(message, schema_, row_count_);
+        LOOM_ASSERT_EQ(message.size, 0);
+    }
+
+    void read (FlatRow & row)
+    {
+        LOOM_ASSERT1(not done(), "row block is exhausted");
+        uint64_t id;
+        ids_.pop(id);
+        row.set_id(id);
+
+        FlatDiff & diff = * row.mutable_diff();
+        uint32_t tare_count;
+        tare_counts_.pop(tare_count);
+        auto & tares = * diff.mutable_tares();
+        tares.resize(tare_count);
+        for (auto & tare : tares) {
+            tares_.pop(tare);
+        }
+
+        pos_.read(schema_, row_number_, * diff.mutable_pos());
+        neg_.read(schema_, row_number_, * diff.mutable_neg());
+        ++row_number_;
+    }
+
+private:
+
+    struct Column
+    {
+        const char * data;
+        size_t size;
+
+        Column () : data(nullptr), size(0) {}
+        Column (const char * d, size_t s) : data(d), size(s) {}
+
+        Column column ()
+        {
+            uint32_t column_size;
+            pop(column_size);
+            LOOM_ASSERT_LE(column_size, size);
+            Column result(data, column_size);
+            data += column_size;
+            size -= column_size;
+            return result;
+        }
+
+        template<class T>
+        void pop (T & value)
+        {
+            LOOM_ASSERT(sizeof(T) <= size, "truncated row block");
+            memcpy(& value, data, sizeof(T));
+            data += sizeof(T);
+            size -= sizeof(T);
+        }
+
+        uint32_t pop_varint ()
+        {
+            uint32_t result = 0;
+            for (size_t shift = 0; shift < 35; shift += 7) {
+                LOOM_ASSERT(size, "truncated row block");
+                const uint8_t byte = * data++;
+                --size;
+                result |= uint32_t(byte & 0x7f) << shift;
+                if (LOOM_LIKELY(byte < 0x80)) {
+                    return result;
+                }
+            }
+            LOOM_ERROR("malformed varint in row block");
+        }
+    };
+
+    struct Part
+    {
+        const uint8_t * observed;
+        const uint8_t * booleans;
+        size_t boolean_count;
+        size_t boolean_pos;
+        Column counts;
+        Column reals;
+
+        void load (
+                Column & message,
+                const ValueSchema & schema,
+                size_t row_count)
+        {
+            Column observed_column = message.column();
+            Column booleans_column = message.column();
+            counts = message.column();
+            reals = message.column();
+            const size_t bit_count = row_count * schema.total_size();
+            LOOM_ASSERT_EQ(observed_column.size, (bit_count + 7) / 8);
+            LOOM_ASSERT_EQ(reals.size % sizeof(float), 0);
+            observed = reinterpret_cast<const uint8_t *>(observed_column.data);
+            booleans = reinterpret_cast<const uint8_t *>(booleans_column.data);
+            boolean_count = 8 * booleans_column.size;
+            boolean_pos = 0;
+        }
+
+        void read (
+                const ValueSchema & schema,
+                size_t row_number,
+                FlatValue & value)
+        {
+            const size_t total_size = schema.total_size();
+            const size_t begin = row_number * total_size;
+            auto & observed_value = * value.mutable_observed();
+            auto & sparse = * observed_value.mutable_sparse();
+            observed_value.mutable_dense()->clear();
+            sparse.clear();
+            for (size_t i = 0; i < total_size; ++i) {
+                if (row_block::get_bit(observed, begin + i)) {
+                    sparse.push_back(i);
+                }
+            }
+
+            size_t boolean_size = 0;
+            size_t count_size = 0;
+            for (auto i : sparse) {
+                if (i < schema.booleans_size) {
+                    ++boolean_size;
+                } else if (i < schema.booleans_size + schema.counts_size) {
+                    ++count_size;
+                } else {
+                    break;
+                }
+            }
+            const size_t real_size = sparse.size() - boolean_size - count_size;
+
+            if (sparse.empty()) {
+                observed_value.set_sparsity(ProductValue::Observed::NONE);
+            } else if (sparse.size() == total_size) {
+                observed_value.set_sparsity(ProductValue::Observed::ALL);
+                sparse.clear();
+            } else {
+                observed_value.set_sparsity(ProductValue::Observed::SPARSE);
+            }
+
+            auto & booleans_value = * value.mutable_booleans();
+            LOOM_ASSERT_LE(boolean_pos + boolean_size, boolean_count);
+            booleans_value.resize(boolean_size);
+            for (auto & b : booleans_value) {
+                b = row_block::get_bit(booleans, boolean_pos++);
+            }
+
+            auto & counts_value = * value.mutable_counts();
+            counts_value.resize(count_size);
+            for (auto & c : counts_value) {
+                c = counts.pop_varint();
+            }
+
+            auto & reals_value = * value.mutable_reals();
+            reals_value.resize(real_size);
+            const size_t real_bytes = sizeof(float) * real_size;
+            LOOM_ASSERT_LE(real_bytes, reals.size);
+            memcpy(reals_value.data(), reals.data, real_bytes);
+            reals.data += real_bytes;
+            reals.size -= real_bytes;
+        }
+    };
+
+    ValueSchema schema_;
+    size_t block_size_;
+    size_t row_count_;
+    size_t row_number_;
+    Column ids_;
+    Column tare_counts_;
+    Column tares_;
+    Part pos_;
+    Part neg_;
+};
+
+//----------------------------------------------------------------------------
+// Columnarize
+
+inline void columnarize_stream (
+        const ValueSchema & schema,
+        const char * rows_in,
+        const char * blocks_out,
+        size_t block_size)
+{
+    protobuf::InFile rows(rows_in);
+    protobuf::OutFile blocks(blocks_out, protobuf::OutFile::INDEX);
+    protobuf::RawMessage raw;
+    FlatRow row;
+    RowBlockWriter writer(schema, block_size);
+    std::vector<char> message;
+    const std::vector<char> & const_message = message;
+    while (rows.try_read_stream(raw)) {
+        bool ok = row.ParseFromArray(raw.data(), raw.size());
+        LOOM_ASSERT(ok, "failed to parse row from " << rows_in);
+        writer.add(row);
+        if (writer.full()) {
+            writer.dump(message);
+            blocks.write_stream(const_message);
+            writer.clear();
+        }
+    }
+    if (not writer.empty()) {
+        writer.dump(message);
+        blocks.write_stream(const_message);
+    }
+}
+
+//----------------------------------------------------------------------------
+// Row Input File
+//
+// RowInFile reads rows from either an ordinary row stream or a columnar
+// stream, presenting positions in rows in both cases.
+// Rows can be read as FlatRows, protobuf::Rows or RawMessages;
+// FlatRows are cheapest for columnar streams, and RawMessages
+// are cheapest for ordinary streams.
+
+class RowInFile : noncopyable
+{
+public:
+
+    explicit RowInFile (const char * filename) :
+        file_(filename),
+        columnar_(row_block::is_columnar(filename)),
+        block_size_(0),
+        position_(0)
+    {
+    }
+
+    const char * filename () const { return file_.filename(); }
+    bool is_file () const { return file_.is_file(); }
+    bool is_columnar () const { return columnar_; }
+
+    uint64_t position () const
+    {
+        return columnar_ ? position_ : file_.position();
+    }
+
+    void set_position (uint64_t target)
+    {
+        if (not columnar_) {
+            file_.set_position(target);
+            return;
+        }
+
+        const uint64_t block_size = _block_size();
+        file_.set_position(target / block_size);
+        block_.clear();
+        position_ = target - target % block_size;
+        if (position_ < target) {
+            bool success = _try_read_block();
+            LOOM_ASSERT(success, "failed to set position of " << filename());
+            while (position_ < target) {
+                LOOM_ASSERT(not block_.done(),
+                    "failed to set position of " << filename());
+                _decode(flat_);
+            }
+        }
+    }
+
+    template<class Message>
+    bool try_read_stream (Message & message)
+    {
+        if (columnar_) {
+            if (LOOM_UNLIKELY(block_.done()) and not _try_read_block()) {
+                return false;
+            }
+            _decode(message);
+            return true;
+        } else {
+            return _read_plain(message, false);
+        }
+    }
+
+    template<class Message>
+    void cyclic_read_stream (Message & message)
+    {
+        if (columnar_) {
+            if (LOOM_UNLIKELY(block_.done())) {
+                file_.cyclic_read_stream(raw_);
+                _load_block();
+            }
+            _decode(message);
+        } else {
+            _read_plain(message, true);
+        }
+    }
+
+    static uint64_t row_count (const char * filename)
+    {
+        const uint64_t message_count =
+            protobuf::InFile::stream_stats(filename).message_count;
+        if (not row_block::is_columnar(filename) or message_count == 0) {
+            return message_count;
+        }
+
+        protobuf::InFile file(filename);
+        file.set_position(message_count - 1);
+        protobuf::RawMessage raw;
+        bool success = file.try_read_stream(raw);
+        LOOM_ASSERT(success, "failed to count rows in " << filename);
+        RowBlockReader last;
+        last.load(raw.data(), raw.size());
+        return (message_count - 1) * last.block_size() + last.size();
+    }
+
+    // loads all rows, e.g. to share them among chains
+    static std::vector<protobuf::Row> load_all (const char * filename)
+    {
+        std::vector<protobuf::Row> rows;
+        RowInFile file(filename);
+        protobuf::Row row;
+        while (file.try_read_stream(row)) {
+            rows.push_back(protobuf::Row());
+            rows.back().Swap(& row);
+        }
+        return rows;
+    }
+
+private:
+
+    uint64_t _block_size ()
+    {
+        if (block_size_ == 0) {
+            protobuf::InFile peeker(filename());
+            protobuf::RawMessage raw;
+            if (peeker.try_read_stream(raw)) {
+                RowBlockReader first;
+                first.load(raw.data(), raw.size());
+                block_size_ = first.block_size();
+            } else {
+                return 1;  // the stream is empty
+            }
+        }
+        return block_size_;
+    }
+
+    bool _try_read_block ()
+    {
+        if (file_.try_read_stream(raw_)) {
+            _load_block();
+            return true;
+        } else {
+            return false;
+        }
+    }
+
+    void _load_block ()
+    {
+        block_.load(raw_.data(), raw_.size());
+        LOOM_ASSERT(block_.size(), "empty row block in " << filename());
+        if (block_size_ == 0) {
+            block_size_ = block_.block_size();
+        }
+        LOOM_ASSERT_EQ(block_.block_size(), block_size_);
+        position_ = (file_.position() - 1) * block_size_;
+    }
+
+    void _decode (FlatRow & row)
+    {
+        block_.read(row);
+        ++position_;
+    }
+
+    void _decode (protobuf::Row & row)
+    {
+        _decode(flat_);
+        flat_.dump(row);
+    }
+
+    void _decode (protobuf::RawMessage & raw)
+    {
+        _decode(row_);
+        const size_t size = row_.ByteSize();
+        char * data = raw.assign_copy(size);
+        row_.SerializeWithCachedSizesToArray(
+            reinterpret_cast<google::protobuf::uint8 *>(data));
+    }
+
+    template<class Message>
+    bool _read_plain (Message & message, bool cyclic)
+    {
+        if (cyclic) {
+            file_.cyclic_read_stream(message);
+            return true;
+        } else {
+            return file_.try_read_stream(message);
+        }
+    }
+
+    bool _read_plain (FlatRow & row, bool cyclic)
+    {
+        if (cyclic) {
+            file_.cyclic_read_stream(raw_);
+        } else if (not file_.try_read_stream(raw_)) {
+            return false;
+        }
+        bool ok = row.ParseFromArray(raw_.data(), raw_.size());
+        LOOM_ASSERT(ok, "failed to parse row from " << filename());
+        return true;
+    }
+
+    protobuf::InFile file_;
+    const bool columnar_;
+    uint64_t block_size_;
+    uint64_t position_;
+    protobuf::RawMessage raw_;
+    RowBlockReader block_;
+    FlatRow flat_;
+    protobuf::Row row_;
+};
+
+} // namespace loom
@@ -0,0 +1,156 @@
+// Copyright (c) 2014, Salesforce.com, Inc.  All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// - Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+// - Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+// - Neither the name of Salesforce.com nor the names of its contributors
+//   may be used to endorse or promote products derived from this
+//   software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+// FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+// COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+// BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+// OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+// TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <loom/sampler.hpp>
+#include <loom/float16.hpp>
+
+namespace loom
+{
+namespace simd
+{
+
+namespace
+{
+
+// exp(x) = 2^i * 2^f with i = round(x / log(2)) and |f| <= 1/2,
+// where 2^f is a degree 6 Taylor polynomial. Rounding x / log(2) limits
+// accuracy to ~1e-6 relative above -20 and ~4e-6 relative near -87.
+// Below -87, exp(x) would be denormal or would underflow the exponent
+// bits; the result is flushed to zero instead, as it is negligible next
+// to exp(0) = 1 of the max score.
+inline float exp (float x)
+{
+    const bool tiny = x < -87.f;
+    x = tiny ? -87.f : x;
+    const float t = x * 1.44269504089f + 0.5f;
+    int32_t i = int32_t(t);
+    i -= (float(i) > t);
+    const float f = (t - 0.5f) - float(i);
+    const float g = f * 0.69314718056f;
+    float poly = 1.f / 720;
+    poly = poly * g + 1.f / 120;
+    poly = poly * g + 1.f / 24;
+    poly = poly * g + 1.f / 6;
+    poly = poly * g + 1.f / 2;
+    poly = poly * g + 1.f;
+    poly = poly * g + 1.f;
+    const float result = bits_float(float_bits(poly) + (uint32_t(i) << 23));
+    return tiny ? 0.f : result;
+}
+
+} // anonymous namespace
+
+LOOM_SIMD_CLONES
+float max (const float * __restrict__ scores, size_t size)
+{
+    float result = scores[0];
+    for (size_t i = 1; i < size; ++i) {
+        result = scores[i] > result ? scores[i] : result;
+    }
+    return result;
+}
+
+// flipping the magnitude bits of negative halves orders them as int16_t,
+// so the max needs no conversion; the flip is its own inverse
+inline int16_t half_order (int16_t bits)
+{
+    return bits ^ ((bits >> 15) & 0x7fff);
+}
+
+LOOM_SIMD_CLONES
+float max (const uint16_t * __restrict__ half_scores, size_t size)
+{
+    int16_t result = half_order(half_scores[0]);
+    for (size_t i = 1; i < size; ++i) {
+        const int16_t key = half_order(half_scores[i]);
+        result = key > result ? key : result;
+    }
+    return half_to_float(half_order(result));
+}
+
+LOOM_SIMD_CLONES
+float exp_sum (
+        const float * scores,
+        float shift,
+        size_t size,
+        float * probs)
+{
+    float total = 0;
+    for (size_t i = 0; i < size; ++i) {
+        const float prob = simd::exp(scores[i] - shift);
+        probs[i] = prob;
+        total += prob;
+    }
+    return total;
+}
+
+LOOM_SIMD_CLONES
+float exp_sum (
+        const uint16_t * __restrict__ half_scores,
+        float shift,
+        size_t size,
+        float * __restrict__ probs)
+{
+    float total = 0;
+    for (size_t i = 0; i < size; ++i) {
+        const float prob = simd::exp(half_to_float(half_scores[i]) - shift);
+        probs[i] = prob;
+        total += prob;
+    }
+    return total;
+}
+
+// Skips whole blocks by their vectorized sums, then scans one block.
+LOOM_SIMD_CLONES
+size_t find_cumulative (
+        const float * __restrict__ probs,
+        size_t size,
+        float target)
+{
+    const size_t block_size = 16;
+    size_t i = 0;
+    for (; i + block_size <= size; i += block_size) {
+        float block = 0;
+        for (size_t j = 0; j < block_size; ++j) {
+            block += probs[i + j];
+        }
+        if (target < block) {
+            break;
+        }
+        target -= block;
+    }
+    for (; i < size; ++i) {
+        if (target < probs[i]) {
+            return i;
+        }
+        target -= probs[i];
+    }
+    return size - 1;
+}
+
+} // namespace simd
+} // namespace loom
@@ -0,0 +1,106 @@
+// Copyright (c) 2014, Salesforce.com, Inc.  All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// - Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+// - Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+// - Neither the name of Salesforce.com nor the names of its contributors
+//   may be used to endorse or promote products derived from this
+//   software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+// FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+// COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+// BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+// OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+// TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <random>
+#include <loom/common.hpp>
+
+// Samples an index with probability proportional to exp(scores[i]).
+// With -DLOOM_SIMD_SAMPLER this replaces
+// distributions::sample_from_scores_overwrite in the cat and kind kernels:
+// the max, the fused exp + sum, and the cumulative search are each one
+// vectorized pass (see sampler.cc), and one uniform variate is drawn per
+// sample, as before.
+
+namespace loom
+{
+namespace simd
+{
+
+float max (const float * scores, size_t size);
+
+float max (const uint16_t * half_scores, size_t size);
+
+// probs[i] = exp(scores[i] - shift); returns the sum of probs
+float exp_sum (
+        const float * scores,
+        float shift,
+        size_t size,
+        float * probs);
+
+float exp_sum (
+        const uint16_t * half_scores,
+        float shift,
+        size_t size,
+        float * probs);
+
+// returns the first i such that probs[0] + ... + probs[i] > target
+size_t find_cumulative (
+        const float * probs,
+        size_t size,
+        float target);
+
+inline size_t sample_from_probs (
+        rng_t & rng,
+        const float * probs,
+        size_t size,
+        float total)
+{
+    std::uniform_real_distribution<float> unif01(0.f, 1.f);
+    return find_cumulative(probs, size, total * unif01(rng));
+}
+
+// overwrites scores with unnormalized probabilities
+inline size_t sample_from_scores_overwrite (
+        rng_t & rng,
+        VectorFloat & scores)
+{
+    const size_t size = scores.size();
+    LOOM_ASSERT1(size, "cannot sample from empty scores");
+    float * data = scores.data();
+    const float total = exp_sum(data, max(data, size), size, data);
+    return sample_from_probs(rng, data, size, total);
+}
+
+// samples from float16 scores, using probs as workspace
+inline size_t sample_from_scores (
+        rng_t & rng,
+        const uint16_t * half_scores,
+        size_t size,
+        VectorFloat & probs)
+{
+    LOOM_ASSERT1(size, "cannot sample from empty scores");
+    probs.resize(size);
+    float * data = probs.data();
+    const float shift = max(half_scores, size);
+    const float total = exp_sum(half_scores, shift, size, data);
+    return sample_from_probs(rng, data, size, total);
+}
+
+} // namespace simd
+} // namespace loom
@@ -37,7 +37,11 @@ const char * help_message =
 "\n  TARGET_MEM_BYTES  target memory usage in bytes"
 "\nNotes:"
 "\n  Any filename can end with .gz to indicate gzip compression."
+"\n  Row streams can end with .bgz to indicate block gzip compression."
+"\n  Row streams can end with .zst or .lz4 if loom was built with those codecs."
 "\n  Any filename can be '-' or '-.gz' to indicate stdin/stdout."
+"\n  ROWS_OUT is indexed in a sidecar file ROWS_OUT.index.pbs.gz."
+"\n  Large inputs are scattered to temporary files ROWS_OUT.bucket.*.pbs."
 ;
 
 int main (int argc, char ** argv)
@@ -54,6 +58,7 @@ int main (int argc, char ** argv)
     LOOM_ASSERT_LT(0, target_mem_bytes);
 
     loom::shuffle_stream(rows_in, rows_out, seed, target_mem_bytes);
+    loom::protobuf::SidecarIndex::build(rows_out);
 
     return 0;
 }
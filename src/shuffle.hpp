@@ -28,6 +28,7 @@
 #pragma once
 
 #include <limits>
+#include <thread>
 #include <algorithm>
 #include <loom/common.hpp>
 #include <loom/protobuf_stream.hpp>
@@ -35,13 +36,90 @@
 namespace loom
 {
 
+//----------------------------------------------------------------------------
+// Shuffle Bucket
+//
+// A bucket holds the messages bound for output slots [begin, end),
+// stored in one contiguous buffer and ordered by slot.
+
+class ShuffleBucket : noncopyable
+{
+public:
+
+    // slots[k] is the output slot of the k-th message in the bucket file
+    template<class pos_t>
+    void load (
+            const char * filename,
+            const pos_t * slots,
+            size_t begin,
+            size_t end)
+    {
+        data_.clear();
+        unordered_.clear();
+        {
+            protobuf::InFile file(filename);
+            protobuf::RawMessage message;
+            while (file.try_read_stream(message)) {
+                unordered_.push_back(Message(data_.size(), message.size()));
+                data_.insert(
+                    data_.end(),
+                    message.data(),
+                    message.data() + message.size());
+            }
+        }
+        const size_t size = end - begin;
+        LOOM_ASSERT_EQ(unordered_.size(), size);
+
+        messages_.resize(size);
+        for (size_t k = 0; k < size; ++k) {
+            messages_[slots[k] - begin] = unordered_[k];
+        }
+    }
+
+    void write (protobuf::OutFile & file) const
+    {
+        protobuf::RawMessage message;
+        const protobuf::RawMessage & const_message = message;
+        for (const auto & pair : messages_) {
+            message.assign_view(data_.data() + pair.first, pair.second);
+            file.write_stream(const_message);
+        }
+    }
+
+    void swap (ShuffleBucket & other)
+    {
+        data_.swap(other.data_);
+        unordered_.swap(other.unordered_);
+        messages_.swap(other.messages_);
+    }
+
+private:
+
+    typedef std::pair<size_t, uint32_t> Message;
+
+    std::vector<char> data_;
+    std::vector<Message> unordered_;
+    std::vector<Message> messages_;
+};
+
+//----------------------------------------------------------------------------
+// Shuffle Stream
+//
+// This is a two-pass external shuffle.  The first pass scatters each
+// message to the bucket file covering its output slot; the second pass
+// loads each bucket, orders it by slot, and appends it to the output.
+// The scatter pass also partitions slots by bucket, so that ordering
+// all buckets takes one pass over the slots.
+// Loading the next bucket overlaps writing the current bucket,
+// so two buckets are resident at a time.
+// The result depends only on seed, not on target_mem_bytes.
+
 inline void shuffle_stream (
         const char * messages_in,
         const char * shuffled_out,
         long seed,
         double target_mem_bytes)
 {
-    typedef std::vector<char> Message;
     typedef uint32_t pos_t;
 
     LOOM_ASSERT(
@@ -50,13 +128,23 @@ inline void shuffle_stream (
     const auto stats = protobuf::InFile::stream_stats(messages_in);
     LOOM_ASSERT(stats.is_file, "shuffle input is not a file: " << messages_in);
     const uint64_t max_message_count = std::numeric_limits<pos_t>::max();
-    LOOM_ASSERT(stats.message_count, max_message_count);
+    LOOM_ASSERT_LE(stats.message_count, max_message_count);
     const size_t message_count = stats.message_count;
 
-    double index_bytes = sizeof(pos_t) * message_count;
+    // each bucket file needs a file descriptor
+    const size_t max_bucket_count = 512;
+    // the scatter pass holds both the index and its partition by bucket
+    double index_bytes = 2 * sizeof(pos_t) * message_count;
+    double message_bytes = stats.max_message_size + 32;
     double target_chunk_size = std::max(1.0, std::min(double(message_count),
-        (target_mem_bytes - index_bytes) / stats.max_message_size));
+        (target_mem_bytes - index_bytes) / (2 * message_bytes)));
     size_t chunk_size = static_cast<size_t>(std::round(target_chunk_size));
+    chunk_size = std::max(
+        chunk_size,
+        (message_count + max_bucket_count - 1) / max_bucket_count);
+    const size_t bucket_count = message_count
+                              ? (message_count + chunk_size - 1) / chunk_size
+                              : 1;
 
     std::vector<pos_t> index(message_count);
     for (size_t i = 0; i < message_count; ++i) {
@@ -64,22 +152,72 @@ inline void shuffle_stream (
     }
     std::shuffle(index.begin(), index.end(), loom::rng_t(seed));
 
-    Message message;
-    std::vector<Message> chunk;
-    protobuf::OutFile shuffled(shuffled_out);
-    for (size_t begin = 0; begin < message_count; begin += chunk_size) {
-        size_t end = std::min(begin + chunk_size, message_count);
-        chunk.resize(end - begin);
+    ShuffleBucket current;
+    protobuf::OutFile shuffled(shuffled_out, protobuf::OutFile::INDEX);
+
+    if (bucket_count == 1) {
+        current.load(messages_in, index.data(), 0, message_count);
+        current.write(shuffled);
+        return;
+    }
+
+    // buckets live beside the output, or beside the input if streaming
+    const std::string out = shuffled_out;
+    const bool is_file_out = not (out == "-" or out == "-.gz");
+    const std::string prefix = is_file_out ? out : messages_in;
+    std::vector<std::string> bucket_names;
+    for (size_t b = 0; b < bucket_count; ++b) {
+        bucket_names.push_back(
+            prefix + ".bucket." + std::to_string(b) + ".pbs");
+    }
+
+    // bucket b holds slots [b * chunk_size, (b + 1) * chunk_size),
+    // listed in input order at the same range of slots
+    {
+        std::vector<pos_t> slots(message_count);
+        std::vector<size_t> ends(bucket_count);
+        for (size_t b = 0; b < bucket_count; ++b) {
+            ends[b] = b * chunk_size;
+        }
+        std::vector<protobuf::OutFile *> buckets;
+        for (const auto & name : bucket_names) {
+            buckets.push_back(new protobuf::OutFile(name.c_str()));
+        }
         protobuf::InFile messages(messages_in);
+        protobuf::RawMessage message;
+        const protobuf::RawMessage & const_message = message;
         for (size_t i : index) {
-            messages.try_read_stream(message);
-            if (begin <= i and i < end) {
-                std::swap(message, chunk[i - begin]);
-            }
+            bool success = messages.try_read_stream(message);
+            LOOM_ASSERT(success, "failed to read " << messages_in);
+            const size_t b = i / chunk_size;
+            buckets[b]->write_stream(const_message);
+            slots[ends[b]++] = i;
+        }
+        for (auto * bucket : buckets) {
+            delete bucket;
+        }
+        index.swap(slots);
+    }
+
+    ShuffleBucket next;
+    auto load = [&](ShuffleBucket & bucket, size_t b){
+        const char * name = bucket_names[b].c_str();
+        size_t begin = b * chunk_size;
+        size_t end = std::min(begin + chunk_size, message_count);
+        bucket.load(name, index.data() + begin, begin, end);
+        unlink(name);
+    };
+    load(current, 0);
+    for (size_t b = 0; b < bucket_count; ++b) {
+        std::thread loader;
+        if (b + 1 < bucket_count) {
+            loader = std::thread(load, std::ref(next), b + 1);
         }
-        for (const auto & message : chunk) {
-            shuffled.write_stream(message);
+        current.write(shuffled);
+        if (loader.joinable()) {
+            loader.join();
         }
+        current.swap(next);
     }
 }
 
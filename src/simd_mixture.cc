@@ -0,0 +1,180 @@
+// Copyright (c) 2014, Salesforce.com, Inc.  All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// - Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+// - Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+// - Neither the name of Salesforce.com nor the names of its contributors
+//   may be used to endorse or promote products derived from this
+//   software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+// FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+// COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+// BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+// OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+// TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <cstring>
+#include <loom/simd_mixture.hpp>
+
+// Each kernel is compiled per instruction set via LOOM_SIMD_CLONES.
+// The loops are written so that gcc auto-vectorizes them under
+// -O3 -ffast-math; the math helpers below are branch-free so as not to
+// block vectorization.
+
+namespace loom
+{
+namespace simd
+{
+
+namespace
+{
+
+// cephes logf, accurate to about 1 ulp for normal positive x
+inline float log (float x)
+{
+    uint32_t bits;
+    std::memcpy(& bits, & x, sizeof(bits));
+    float exponent = int32_t(bits >> 23) - 127;
+    bits = (bits & 0x007fffffu) | 0x3f800000u;
+    float mantissa;
+    std::memcpy(& mantissa, & bits, sizeof(bits));
+
+    // shift mantissa from [1, 2) to [sqrt(1/2), sqrt(2))
+    const bool big = mantissa > 1.41421356f;
+    mantissa = big ? 0.5f * mantissa : mantissa;
+    exponent = big ? exponent + 1.f : exponent;
+
+    const float f = mantissa - 1.f;
+    const float f2 = f * f;
+    float poly = 7.0376836292e-2f;
+    poly = poly * f - 1.1514610310e-1f;
+    poly = poly * f + 1.1676998740e-1f;
+    poly = poly * f - 1.2420140846e-1f;
+    poly = poly * f + 1.4249322787e-1f;
+    poly = poly * f - 1.6668057665e-1f;
+    poly = poly * f + 2.0000714765e-1f;
+    poly = poly * f - 2.4999993993e-1f;
+    poly = poly * f + 3.3333331174e-1f;
+    return f + (f * f2 * poly - 0.5f * f2) + 0.693147180560f * exponent;
+}
+
+// Stirling series, after shifting small arguments up by 8
+inline float lgamma (float x)
+{
+    const bool small = x < 8.f;
+    const float y = small ? x : 1.f;
+    const float prod = y * (y + 1.f) * (y + 2.f) * (y + 3.f)
+                     * (y + 4.f) * (y + 5.f) * (y + 6.f) * (y + 7.f);
+    const float z = small ? x + 8.f : x;
+    const float shift = small ? simd::log(prod) : 0.f;
+    const float inv_z = 1.f / z;
+    const float inv_z2 = inv_z * inv_z;
+    const float series =
+        inv_z * (1.f / 12 - inv_z2 * (1.f / 360 - inv_z2 * (1.f / 1260)));
+    return (z - 0.5f) * simd::log(z) - z + 0.918938533205f + series - shift;
+}
+
+// log(1 + x) for x >= 0, by its Taylor series below 1/8
+inline float log1p (float x)
+{
+    const float series =
+        x * (1.f - x * (1.f / 2 - x * (1.f / 3 - x * (1.f / 4
+        - x * (1.f / 5 - x * (1.f / 6 - x * (1.f / 7 - x * (1.f / 8
+        - x * (1.f / 9)))))))));
+    return x < 0.125f ? series : simd::log(1.f + x);
+}
+
+// lgamma(a + x) - lgamma(a) for a >= 8 and x >= 0, as the difference of
+// Stirling series with the large terms cancelled analytically:
+//   (a - 1/2) log(1 + x/a) + x (log(a + x) - 1) + S(a + x) - S(a)
+inline float log_rising (float a, float x)
+{
+    const float z = a + x;
+    const float inv_a = 1.f / a;
+    const float inv_a2 = inv_a * inv_a;
+    const float inv_z = 1.f / z;
+    const float inv_z2 = inv_z * inv_z;
+    const float series_a =
+        inv_a * (1.f / 12 - inv_a2 * (1.f / 360 - inv_a2 * (1.f / 1260)));
+    const float series_z =
+        inv_z * (1.f / 12 - inv_z2 * (1.f / 360 - inv_z2 * (1.f / 1260)));
+    return (a - 0.5f) * simd::log1p(x * inv_a)
+         + x * (simd::log(z) - 1.f)
+         + (series_z - series_a);
+}
+
+} // anonymous namespace
+
+LOOM_SIMD_CLONES
+void add (
+        const float * __restrict__ terms,
+        size_t size,
+        float * __restrict__ scores)
+{
+    for (size_t i = 0; i < size; ++i) {
+        scores[i] += terms[i];
+    }
+}
+
+LOOM_SIMD_CLONES
+void add_difference (
+        const float * __restrict__ numer,
+        const float * __restrict__ denom,
+        size_t size,
+        float * __restrict__ scores)
+{
+    for (size_t i = 0; i < size; ++i) {
+        scores[i] += numer[i] - denom[i];
+    }
+}
+
+LOOM_SIMD_CLONES
+void add_gamma_poisson (
+        const float * __restrict__ shift,
+        const float * __restrict__ alpha,
+        const float * __restrict__ slope,
+        float x,
+        float offset,
+        size_t size,
+        float * __restrict__ scores)
+{
+    for (size_t i = 0; i < size; ++i) {
+        const float a = alpha[i];
+        const float rising = a < gamma_poisson_small_alpha
+                           ? simd::lgamma(a + x)
+                           : simd::log_rising(a, x);
+        scores[i] += shift[i] + rising + slope[i] * x + offset;
+    }
+}
+
+LOOM_SIMD_CLONES
+void add_student_t (
+        const float * __restrict__ shift,
+        const float * __restrict__ coeff,
+        const float * __restrict__ precision,
+        const float * __restrict__ mean,
+        float x,
+        size_t size,
+        float * __restrict__ scores)
+{
+    for (size_t i = 0; i < size; ++i) {
+        const float diff = x - mean[i];
+        scores[i] += shift[i]
+                   + coeff[i] * simd::log1p(precision[i] * diff * diff);
+    }
+}
+
+} // namespace simd
+} // namespace loom
@@ -0,0 +1,505 @@
+// Copyright (c) 2014, Salesforce.com, Inc.  All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// - Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+// - Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+// - Neither the name of Salesforce.com nor the names of its contributors
+//   may be used to endorse or promote products derived from this
+//   software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+// FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+// COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+// BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+// OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+// TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <cmath>
+#include <distributions/models/bb.hpp>
+#include <distributions/models/dd.hpp>
+#include <distributions/models/gp.hpp>
+#include <distributions/models/nich.hpp>
+#include <loom/common.hpp>
+
+// Fast mixtures whose per-group score terms live in structure-of-arrays
+// tables, one padded aligned row per term, so that score_value is a
+// straight loop over groups.  Score kernels are defined in
+// simd_mixture.cc and dispatched at load time to the widest instruction
+// set the cpu supports (AVX-512, AVX2 or the baseline).
+
+namespace loom
+{
+namespace simd
+{
+
+void add (
+        const float * terms,
+        size_t size,
+        float * scores);
+
+void add_difference (
+        const float * numer,
+        const float * denom,
+        size_t size,
+        float * scores);
+
+// alphas below this are scored via lgamma(alpha + x), with -lgamma(alpha)
+// left in shift; above it lgamma(alpha + x) - lgamma(alpha) is computed
+// directly, since both terms grow far beyond the float precision of their
+// difference
+static const float gamma_poisson_small_alpha = 8.f;
+
+// scores[g] += shift[g] + rising(alpha[g], x) + slope[g] * x + offset,
+// where rising(a, x) = lgamma(a + x) for a < gamma_poisson_small_alpha,
+// else lgamma(a + x) - lgamma(a)
+void add_gamma_poisson (
+        const float * shift,
+        const float * alpha,
+        const float * slope,
+        float x,
+        float offset,
+        size_t size,
+        float * scores);
+
+// scores[g] += shift[g] + coeff[g] * log(1 + precision[g] * (x - mean[g])^2)
+void add_student_t (
+        const float * shift,
+        const float * coeff,
+        const float * precision,
+        const float * mean,
+        float x,
+        size_t size,
+        float * scores);
+
+} // namespace simd
+
+// Rows of per-group terms, stored contiguously with a stride padded to a
+// whole number of cache lines.  Groups are removed by moving the last
+// group into the hole, mirroring distributions::Packed_::packed_remove.
+class GroupTable
+{
+public:
+
+    enum { block_size = 16 };
+
+    GroupTable () : row_count_(0), size_(0), stride_(0) {}
+
+    size_t size () const { return size_; }
+
+    float * row (size_t r) { return & data_[r * stride_]; }
+    const float * row (size_t r) const { return & data_[r * stride_]; }
+
+    void init (size_t row_count, size_t size)
+    {
+        row_count_ = row_count;
+        size_ = size;
+        stride_ = padded(size);
+        data_.clear();
+        data_.resize(row_count_ * stride_, 0.f);
+    }
+
+    void add_group ()
+    {
+        if (LOOM_UNLIKELY(size_ == stride_)) {
+            _restride(std::max(size_t(block_size), 2 * stride_));
+        }
+        ++size_;
+    }
+
+    void remove_group (size_t groupid)
+    {
+        LOOM_ASSERT2(groupid < size_, "bad groupid: " << groupid);
+        const size_t last = --size_;
+        for (size_t r = 0; r < row_count_; ++r) {
+            float * terms = row(r);
+            terms[groupid] = terms[last];
+            terms[last] = 0.f;
+        }
+    }
+
+private:
+
+    static size_t padded (size_t size)
+    {
+        return (size + block_size - 1) / block_size * block_size;
+    }
+
+    void _restride (size_t stride)
+    {
+        VectorFloat data(row_count_ * stride, 0.f);
+        for (size_t r = 0; r < row_count_; ++r) {
+            std::copy(row(r), row(r) + size_, & data[r * stride]);
+        }
+        data_.swap(data);
+        stride_ = stride;
+    }
+
+    size_t row_count_;
+    size_t size_;
+    size_t stride_;
+    VectorFloat data_;
+};
+
+// Each Derived class provides the row count, an update (shared, groupid)
+// that recomputes the terms of one group from its sufficient statistics,
+// and a score (value, begin, end, scores) that adds groups [begin, end).
+// Sufficient statistics stay in the distributions SmallMixture base, which
+// also provides score_data, score_value_group and sampling.
+template<class Model, class Derived>
+class SimdMixture : public Model::SmallMixture
+{
+    typedef typename Model::SmallMixture Base;
+
+public:
+
+    typedef typename Model::Shared Shared;
+    typedef typename Model::Value Value;
+
+    void init (const Shared & shared, rng_t & rng)
+    {
+        Base::init(shared, rng);
+        const size_t size = Base::groups().size();
+        derived().init_shared(shared);
+        table_.init(Derived::row_count(shared), size);
+        for (size_t groupid = 0; groupid < size; ++groupid) {
+            derived().update(shared, groupid);
+        }
+    }
+
+    void add_group (const Shared & shared, rng_t & rng)
+    {
+        Base::add_group(shared, rng);
+        table_.add_group();
+        derived().update(shared, table_.size() - 1);
+    }
+
+    void remove_group (const Shared & shared, size_t groupid)
+    {
+        Base::remove_group(shared, groupid);
+        table_.remove_group(groupid);
+    }
+
+    void add_value (
+            const Shared & shared,
+            size_t groupid,
+            const Value & value,
+            rng_t & rng)
+    {
+        Base::add_value(shared, groupid, value, rng);
+        derived().update(shared, groupid);
+    }
+
+    void remove_value (
+            const Shared & shared,
+            size_t groupid,
+            const Value & value,
+            rng_t & rng)
+    {
+        Base::remove_value(shared, groupid, value, rng);
+        derived().update(shared, groupid);
+    }
+
+    void score_value (
+            const Shared & shared,
+            const Value & value,
+            VectorFloat & scores_accum,
+            rng_t & rng) const
+    {
+        const size_t size = table_.size();
+        LOOM_ASSERT1(scores_accum.size() == size, "bad scores size");
+        if (LOOM_DEBUG_LEVEL >= 2) {
+            validate_scores(shared, value, rng);
+        }
+        derived().score(value, 0, size, scores_accum.data());
+    }
+
+    // adds scores of groups [begin, end) only, for tiled scoring
+    void score_value_range (
+            const Shared & shared,
+            const Value & value,
+            size_t begin,
+            size_t end,
+            float * scores_accum,
+            rng_t & rng) const
+    {
+        LOOM_ASSERT1(end <= table_.size(), "bad range end: " << end);
+        if (LOOM_DEBUG_LEVEL >= 2) {
+            validate_scores(shared, value, rng);
+        }
+        derived().score(value, begin, end, scores_accum);
+    }
+
+    void validate_scores (
+            const Shared & shared,
+            const Value & value,
+            rng_t & rng) const
+    {
+        const size_t size = table_.size();
+        LOOM_ASSERT_EQ(size, Base::groups().size());
+        VectorFloat scores(size, 0.f);
+        derived().score(value, 0, size, scores.data());
+        for (size_t groupid = 0; groupid < size; ++groupid) {
+            float expected =
+                derived().reference_score(shared, groupid, value, rng);
+            float actual = scores[groupid];
+            LOOM_ASSERT(
+                std::fabs(actual - expected) <=
+                    1e-3f * (1.f + std::fabs(expected)),
+                "simd score mismatch at group " << groupid << ": "
+                << actual << " vs " << expected);
+        }
+    }
+
+    // the score that validate_scores expects of one group
+    float reference_score (
+            const Shared & shared,
+            size_t groupid,
+            const Value & value,
+            rng_t & rng) const
+    {
+        return Base::score_value_group(shared, groupid, value, rng);
+    }
+
+protected:
+
+    GroupTable table_;
+
+private:
+
+    Derived & derived () { return static_cast<Derived &>(*this); }
+    const Derived & derived () const
+    {
+        return static_cast<const Derived &>(*this);
+    }
+};
+
+//----------------------------------------------------------------------------
+// Models
+
+// row 0: log P(false), row 1: log P(true)
+class SimdBetaBernoulli : public SimdMixture<
+        distributions::BetaBernoulli,
+        SimdBetaBernoulli>
+{
+public:
+
+    static size_t row_count (const Shared &) { return 2; }
+
+    void init_shared (const Shared &) {}
+
+    void update (const Shared & shared, size_t groupid)
+    {
+        const auto & group = groups(groupid);
+        const double heads = shared.alpha + group.heads;
+        const double tails = shared.beta + group.tails;
+        const double log_total = std::log(heads + tails);
+        table_.row(0)[groupid] = std::log(tails) - log_total;
+        table_.row(1)[groupid] = std::log(heads) - log_total;
+    }
+
+    void score (
+            const Value & value,
+            size_t begin,
+            size_t end,
+            float * scores) const
+    {
+        simd::add(
+            table_.row(value ? 1 : 0) + begin,
+            end - begin,
+            scores + begin);
+    }
+};
+
+// rows 0..dim-1: log(alphas[v] + counts[v]), row dim: log(alpha_sum + total)
+template<int max_dim>
+class SimdDirichletDiscrete : public SimdMixture<
+        distributions::DirichletDiscrete<max_dim>,
+        SimdDirichletDiscrete<max_dim>>
+{
+    typedef SimdMixture<
+        distributions::DirichletDiscrete<max_dim>,
+        SimdDirichletDiscrete<max_dim>> Base;
+
+public:
+
+    typedef typename Base::Shared Shared;
+    typedef typename Base::Value Value;
+
+    SimdDirichletDiscrete () : dim_(0), alpha_sum_(0) {}
+
+    static size_t row_count (const Shared & shared) { return shared.dim + 1; }
+
+    void init_shared (const Shared & shared)
+    {
+        dim_ = shared.dim;
+        alpha_sum_ = 0;
+        for (size_t v = 0; v < dim_; ++v) {
+            alpha_sum_ += shared.alphas[v];
+        }
+    }
+
+    void update (const Shared & shared, size_t groupid)
+    {
+        const auto & group = this->groups(groupid);
+        for (size_t v = 0; v < dim_; ++v) {
+            this->table_.row(v)[groupid] =
+                std::log(shared.alphas[v] + group.counts[v]);
+        }
+        this->table_.row(dim_)[groupid] =
+            std::log(alpha_sum_ + group.count_sum);
+    }
+
+    void score (
+            const Value & value,
+            size_t begin,
+            size_t end,
+            float * scores) const
+    {
+        LOOM_ASSERT2(value < dim_, "bad value: " << value);
+        simd::add_difference(
+            this->table_.row(value) + begin,
+            this->table_.row(dim_) + begin,
+            end - begin,
+            scores + begin);
+    }
+
+private:
+
+    size_t dim_;
+    double alpha_sum_;
+};
+
+// Negative binomial posterior predictive, in terms of the posterior shape
+// alpha' = alpha + sum and scale theta' = inv_beta / (1 + count * inv_beta):
+// row 0: -alpha' log(1 + theta'), less lgamma(alpha') for small alpha',
+// row 1: alpha', row 2: log(theta') - log(1 + theta')
+class SimdGammaPoisson : public SimdMixture<
+        distributions::GammaPoisson,
+        SimdGammaPoisson>
+{
+public:
+
+    static size_t row_count (const Shared &) { return 3; }
+
+    void init_shared (const Shared &) {}
+
+    void update (const Shared & shared, size_t groupid)
+    {
+        const auto & group = groups(groupid);
+        const float alpha = shared.alpha + group.sum;
+        const double theta =
+            shared.inv_beta / (1.0 + group.count * shared.inv_beta);
+        const double log1p_theta = std::log1p(theta);
+        const double shift = alpha < simd::gamma_poisson_small_alpha
+                           ? std::lgamma(double(alpha))
+                           : 0.0;
+        table_.row(0)[groupid] = -shift - alpha * log1p_theta;
+        table_.row(1)[groupid] = alpha;
+        table_.row(2)[groupid] = std::log(theta) - log1p_theta;
+    }
+
+    // a float difference of lgammas loses whole nats once alpha' reaches
+    // about 1e5, so large groups are validated against a double score
+    float reference_score (
+            const Shared & shared,
+            size_t groupid,
+            const Value & value,
+            rng_t &) const
+    {
+        const auto & group = groups(groupid);
+        const double alpha = shared.alpha + group.sum;
+        const double theta =
+            shared.inv_beta / (1.0 + group.count * shared.inv_beta);
+        const double log1p_theta = std::log1p(theta);
+        const double x = value;
+        return std::lgamma(alpha + x) - std::lgamma(alpha)
+             - std::lgamma(x + 1.0)
+             + x * (std::log(theta) - log1p_theta)
+             - alpha * log1p_theta;
+    }
+
+    void score (
+            const Value & value,
+            size_t begin,
+            size_t end,
+            float * scores) const
+    {
+        const float x = value;
+        simd::add_gamma_poisson(
+            table_.row(0) + begin,
+            table_.row(1) + begin,
+            table_.row(2) + begin,
+            x,
+            -std::lgamma(x + 1.f),
+            end - begin,
+            scores + begin);
+    }
+};
+
+// Student-t posterior predictive of the normal-inverse-chi-squared model:
+// row 0: log normalizer, row 1: -(nu' + 1) / 2,
+// row 2: kappa' / ((1 + kappa') nu' sigmasq'), row 3: mu'
+class SimdNormalInverseChiSq : public SimdMixture<
+        distributions::NormalInverseChiSq,
+        SimdNormalInverseChiSq>
+{
+public:
+
+    static size_t row_count (const Shared &) { return 4; }
+
+    void init_shared (const Shared &) {}
+
+    void update (const Shared & shared, size_t groupid)
+    {
+        const auto & group = groups(groupid);
+        const double count = group.count;
+        const double kappa = shared.kappa + count;
+        const double nu = shared.nu + count;
+        const double mean_diff = group.mean - shared.mu;
+        const double mu = (shared.kappa * shared.mu + count * group.mean)
+                        / kappa;
+        const double sigmasq = (
+                shared.nu * shared.sigmasq
+                + group.count_times_variance
+                + count * shared.kappa * mean_diff * mean_diff / kappa
+            ) / nu;
+        const double scalesq = sigmasq * (1.0 + kappa) / kappa;
+        table_.row(0)[groupid] =
+            std::lgamma(0.5 * (nu + 1.0)) - std::lgamma(0.5 * nu)
+            - 0.5 * std::log(M_PI * nu * scalesq);
+        table_.row(1)[groupid] = -0.5 * (nu + 1.0);
+        table_.row(2)[groupid] = 1.0 / (nu * scalesq);
+        table_.row(3)[groupid] = mu;
+    }
+
+    void score (
+            const Value & value,
+            size_t begin,
+            size_t end,
+            float * scores) const
+    {
+        simd::add_student_t(
+            table_.row(0) + begin,
+            table_.row(1) + begin,
+            table_.row(2) + begin,
+            table_.row(3) + begin,
+            value,
+            end - begin,
+            scores + begin);
+    }
+};
+
+} // namespace loom
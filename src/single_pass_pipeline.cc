@@ -0,0 +1,150 @@
+// Copyright (c) 2014, Salesforce.com, Inc.  All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// - Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+// - Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+// - Neither the name of Salesforce.com nor the names of its contributors
+//   may be used to endorse or promote products derived from this
+//   software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+// FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+// COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+// BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+// OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+// TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <loom/single_pass_pipeline.hpp>
+
+namespace loom
+{
+
+SinglePassPipeline::SinglePassPipeline (
+        const protobuf::Config::Kernels::Cat & config,
+        CrossCat & cross_cat,
+        RowInFile & rows,
+        protobuf::OutFile * assignments,
+        CatKernel & cat_kernel,
+        rng_t & rng) :
+    batch_size_(std::max<size_t>(1, config.batch_size())),
+    pipeline_(config.row_queue_capacity(), stage_count, config.spin_limit()),
+    scheduler_(),
+    kind_rngs_(),
+    cross_cat_(cross_cat),
+    rows_(rows),
+    assignments_(assignments),
+    cat_kernel_(cat_kernel),
+    rng_(rng)
+{
+    start_threads(config.parser_threads(), config.kind_threads());
+}
+
+void SinglePassPipeline::run ()
+{
+    const bool columnar = rows_.is_columnar();
+    for (bool done = false; not done;) {
+        pipeline_.start([&](Task & task){
+            task.parsed.clear();
+            task.items.clear();
+            while (task.items.size() < batch_size_) {
+                auto & item = task.items.push_back();
+                bool ok = columnar
+                        ? rows_.try_read_stream(item.row)
+                        : rows_.try_read_stream(item.raw);
+                if (LOOM_UNLIKELY(not ok)) {
+                    task.items.pop_back();
+                    done = true;
+                    break;
+                }
+            }
+        });
+    }
+    pipeline_.wait();
+}
+
+void SinglePassPipeline::start_threads (
+        size_t parser_threads,
+        size_t kind_threads)
+{
+    // parse
+    const bool columnar = rows_.is_columnar();
+    const size_t kind_count = cross_cat_.kinds.size();
+    LOOM_ASSERT_LT(0, parser_threads);
+    for (size_t i = 0; i < parser_threads; ++i) {
+        pipeline_.unsafe_add_thread(0, ThreadState(),
+            [this, columnar, kind_count](Task & task, ThreadState &){
+            if (not task.parsed.test_and_set()) {
+                for (auto & item : task.items) {
+                    if (not columnar) {
+                        bool ok = item.row.ParseFromArray(
+                            item.raw.data(),
+                            item.raw.size());
+                        LOOM_ASSERT(ok, "failed to parse row");
+                    }
+                    cross_cat_.splitter.split(
+                        item.row.diff(),
+                        item.partial_diffs);
+                    cross_cat_.simplify(item.partial_diffs);
+                    item.groupids.resize(kind_count);
+                }
+            }
+        });
+    }
+
+    // add
+    LOOM_ASSERT(kind_count, "no kinds");
+    for (size_t i = 0; i < kind_count; ++i) {
+        kind_rngs_.push_back(rng_t(rng_()));
+    }
+    if (kind_threads == 0 or kind_threads > kind_count) {
+        kind_threads = kind_count;
+    }
+    scheduler_.set_thread_count(kind_threads);
+    scheduler_.schedule(cross_cat_);
+    for (size_t t = 0; t < kind_threads; ++t) {
+        pipeline_.unsafe_add_thread(1, ThreadState(),
+            [t, this](Task & task, ThreadState & thread){
+            for (size_t i : scheduler_.kindids(t)) {
+                auto & rng = kind_rngs_[i];
+                for (auto & item : task.items) {
+                    item.groupids[i] = cat_kernel_.add_to_kind(
+                        i,
+                        item.partial_diffs[i],
+                        thread.scores,
+                        rng);
+                }
+            }
+        });
+    }
+
+    // write, in row order
+    pipeline_.unsafe_add_thread(2, ThreadState(),
+        [this](const Task & task, ThreadState & thread){
+        if (assignments_) {
+            auto & assignment = thread.assignment;
+            for (const auto & item : task.items) {
+                assignment.set_rowid(item.row.id());
+                assignment.clear_groupids();
+                for (auto groupid : item.groupids) {
+                    assignment.add_groupids(groupid);
+                }
+                assignments_->write_stream(assignment);
+            }
+        }
+    });
+
+    pipeline_.validate();
+}
+
+} // namespace loom
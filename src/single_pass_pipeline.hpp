@@ -0,0 +1,99 @@
+// Copyright (c) 2014, Salesforce.com, Inc.  All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// - Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+// - Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+// - Neither the name of Salesforce.com nor the names of its contributors
+//   may be used to endorse or promote products derived from this
+//   software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+// FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+// COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+// BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+// OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+// TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <thread>
+#include <loom/common.hpp>
+#include <loom/cross_cat.hpp>
+#include <loom/row_block.hpp>
+#include <loom/cat_kernel.hpp>
+#include <loom/pipeline.hpp>
+#include <loom/kind_scheduler.hpp>
+
+namespace loom
+{
+
+// SinglePassPipeline assigns each row of a stream once, as in
+// Loom::infer_single_pass, but parses and adds rows in parallel.
+// The calling thread inflates rows; then stages parse, add to kinds,
+// and write assignments in the original row order.
+class SinglePassPipeline
+{
+public:
+
+    enum { stage_count = 3 };
+
+    SinglePassPipeline (
+            const protobuf::Config::Kernels::Cat & config,
+            CrossCat & cross_cat,
+            RowInFile & rows,
+            protobuf::OutFile * assignments,
+            CatKernel & cat_kernel,
+            rng_t & rng);
+
+    // returns when all rows have been added and assignments written
+    void run ();
+
+private:
+
+    struct Item
+    {
+        protobuf::RawMessage raw;
+        FlatRow row;
+        std::vector<FlatDiff> partial_diffs;
+        std::vector<uint32_t> groupids;
+    };
+
+    struct Task
+    {
+        std::atomic_flag parsed;
+        PipelineBatch<Item> items;
+
+        Task () : parsed(ATOMIC_FLAG_INIT) {}
+    };
+
+    struct ThreadState
+    {
+        VectorFloat scores;
+        protobuf::Assignment assignment;
+    };
+
+    void start_threads (size_t parser_threads, size_t kind_threads);
+
+    const size_t batch_size_;
+    Pipeline<Task, ThreadState> pipeline_;
+    KindScheduler scheduler_;
+    std::vector<rng_t> kind_rngs_;
+    CrossCat & cross_cat_;
+    RowInFile & rows_;
+    protobuf::OutFile * assignments_;
+    CatKernel & cat_kernel_;
+    rng_t & rng_;
+};
+
+} // namespace loom
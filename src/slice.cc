@@ -0,0 +1,71 @@
+// Copyright (c) 2014, Salesforce.com, Inc.  All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// - Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+// - Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+// - Neither the name of Salesforce.com nor the names of its contributors
+//   may be used to endorse or promote products derived from this
+//   software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+// FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+// COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+// BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+// OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+// TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <loom/args.hpp>
+#include <loom/row_block.hpp>
+
+const char * help_message =
+"Usage: slice ROWS_IN ROWS_OUT BEGIN END"
+"\nArguments:"
+"\n  ROWS_IN   filename of input dataset stream (e.g. rows.pbs.gz)"
+"\n  ROWS_OUT  filename of output dataset stream (e.g. rows_out.pbs.gz)"
+"\n  BEGIN     position of the first row to copy"
+"\n  END       position after the last row to copy"
+"\nNotes:"
+"\n  Any filename can end with .gz to indicate gzip compression."
+"\n  Row streams can end with .bgz to indicate block gzip compression."
+"\n  Row streams can end with .zst or .lz4 if loom was built with those codecs."
+"\n  ROWS_OUT can be '-' or '-.gz' to indicate stdout."
+"\n  ROWS_IN is seeked via its sidecar file ROWS_IN.index.pbs.gz if present."
+;
+
+int main (int argc, char ** argv)
+{
+    GOOGLE_PROTOBUF_VERIFY_VERSION;
+
+    Args args(argc, argv, help_message);
+    const char * rows_in = args.pop();
+    const char * rows_out = args.pop();
+    const int64_t begin = args.pop_default(int64_t(0));
+    const int64_t end = args.pop_default(int64_t(0));
+    args.done();
+
+    LOOM_ASSERT_LE(0, begin);
+    LOOM_ASSERT_LE(begin, end);
+
+    loom::RowInFile rows(rows_in);
+    loom::protobuf::OutFile out(rows_out);
+    loom::protobuf::Row row;
+    rows.set_position(begin);
+    for (int64_t i = begin; i < end; ++i) {
+        bool success = rows.try_read_stream(row);
+        LOOM_ASSERT(success, "stream ended before position " << end);
+        out.write_stream(row);
+    }
+
+    return 0;
+}
@@ -30,15 +30,19 @@
 #include <loom/protobuf_stream.hpp>
 
 const char * help_message =
-"Usage: sparsify SCHEMA_ROW_IN TARES_IN ROWS_IN ROWS_OUT"
+"Usage: sparsify SCHEMA_ROW_IN TARES_IN ROWS_IN ROWS_OUT [THREADS=0]"
 "\nArguments:"
 "\n  SCHEMA_ROW_IN filename of schema row (e.g. schema.pb.gz)"
 "\n  TARES_IN      filename of tare rows (e.g. tares.pbs.gz)"
 "\n  ROWS_IN       filename of input dataset stream (e.g. rows.pbs.gz)"
 "\n  ROWS_OUT      filename of output dataset stream (e.g. diffs.pbs.gz)"
+"\n  THREADS       number of worker threads, or 0 for all cores"
 "\nNotes:"
 "\n  Any filename can end with .gz to indicate gzip compression."
+"\n  Row streams can end with .bgz to indicate block gzip compression."
+"\n  Row streams can end with .zst or .lz4 if loom was built with those codecs."
 "\n  Any filename can be '-' or '-.gz' to indicate stdin/stdout."
+"\n  ROWS_OUT is indexed in a sidecar file ROWS_OUT.index.pbs.gz."
 ;
 
 int main (int argc, char ** argv)
@@ -50,6 +54,7 @@ int main (int argc, char ** argv)
     const char * tares_in = args.pop();
     const char * rows_in = args.pop();
     const char * rows_out = args.pop();
+    const int thread_count = args.pop_default(0);
     args.done();
 
     loom::ProductValue value;
@@ -65,7 +70,8 @@ int main (int argc, char ** argv)
     }
 
     loom::Differ differ(schema, tares[0]);
-    differ.compress_rows(rows_in, rows_out);
+    differ.compress_rows(rows_in, rows_out, thread_count);
+    loom::protobuf::SidecarIndex::build(rows_out);
 
     return 0;
 }
@@ -0,0 +1,632 @@
+// Copyright (c) 2014, Salesforce.com, Inc.  All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// - Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+// - Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+// - Neither the name of Salesforce.com nor the names of its contributors
+//   may be used to endorse or promote products derived from this
+//   software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+// FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+// COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+// BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+// OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+// TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <zlib.h>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/io/zero_copy_stream_impl.h>
+#include <google/protobuf/io/gzip_stream.h>
+#include <loom/common.hpp>
+#include <loom/block_stream.hpp>
+#include <loom/codec_stream.hpp>
+#include <loom/schema.pb.h>
+
+namespace loom
+{
+namespace protobuf
+{
+
+inline bool endswith (const char * filename, const char * suffix)
+{
+    return strlen(filename) >= strlen(suffix) and
+        strcmp(filename + strlen(filename) - strlen(suffix), suffix) == 0;
+}
+
+//----------------------------------------------------------------------------
+// Inflate Stream
+//
+// This resumes decompression of a gzip file at a deflate block boundary,
+// following zlib's examples/zran.c, and continues through later members.
+
+class InflateInputStream : public google::protobuf::io::CopyingInputStream
+{
+public:
+
+    enum { window_size = 32768 };
+
+    InflateInputStream (
+            google::protobuf::io::ZeroCopyInputStream * file,
+            const ::protobuf::loom::StreamIndex::Point & point) :
+        file_(file),
+        raw_(true),
+        trailer_size_(0)
+    {
+        strm_.zalloc = Z_NULL;
+        strm_.zfree = Z_NULL;
+        strm_.opaque = Z_NULL;
+        strm_.avail_in = 0;
+        strm_.next_in = Z_NULL;
+        int status = inflateInit2(& strm_, -15);
+        LOOM_ASSERT(status == Z_OK, "inflateInit2 failed");
+
+        if (point.bits()) {
+            bool success = _fill();
+            LOOM_ASSERT(success, "failed to seek gzip stream");
+            const int byte = * strm_.next_in;
+            ++strm_.next_in;
+            --strm_.avail_in;
+            status = inflatePrime(
+                & strm_,
+                point.bits(),
+                byte >> (8 - point.bits()));
+            LOOM_ASSERT(status == Z_OK, "inflatePrime failed");
+        }
+
+        const auto & window = point.window();
+        status = inflateSetDictionary(
+            & strm_,
+            reinterpret_cast<const Bytef *>(window.data()),
+            window.size());
+        LOOM_ASSERT(status == Z_OK, "inflateSetDictionary failed");
+    }
+
+    ~InflateInputStream ()
+    {
+        inflateEnd(& strm_);
+    }
+
+    int Read (void * buffer, int size)
+    {
+        strm_.next_out = static_cast<Bytef *>(buffer);
+        strm_.avail_out = size;
+        while (strm_.avail_out == static_cast<uInt>(size)) {
+            if (strm_.avail_in == 0 and not _fill()) {
+                break;
+            }
+
+            if (trailer_size_) {
+                uInt skip = std::min<uInt>(trailer_size_, strm_.avail_in);
+                strm_.next_in += skip;
+                strm_.avail_in -= skip;
+                trailer_size_ -= skip;
+                if (trailer_size_ == 0) {
+                    int status = inflateReset2(& strm_, 47);
+                    LOOM_ASSERT(status == Z_OK, "inflateReset2 failed");
+                }
+                continue;
+            }
+
+            int status = inflate(& strm_, Z_NO_FLUSH);
+            if (status == Z_STREAM_END) {
+                // raw inflate stops before the gzip trailer
+                if (raw_) {
+                    raw_ = false;
+                    trailer_size_ = 8;
+                } else {
+                    inflateReset(& strm_);
+                }
+            } else {
+                LOOM_ASSERT(status == Z_OK, "failed to inflate: " << status);
+            }
+        }
+        return size - strm_.avail_out;
+    }
+
+private:
+
+    bool _fill ()
+    {
+        const void * data;
+        int size;
+        if (file_->Next(& data, & size)) {
+            strm_.next_in = static_cast<Bytef *>(const_cast<void *>(data));
+            strm_.avail_in = size;
+            return true;
+        } else {
+            return false;
+        }
+    }
+
+    google::protobuf::io::ZeroCopyInputStream * file_;
+    z_stream strm_;
+    bool raw_;
+    uint32_t trailer_size_;
+};
+
+//----------------------------------------------------------------------------
+// Sidecar Index
+//
+// A sidecar index records stream statistics, i.e. message count, max
+// message size, total bytes and a crc32 of the uncompressed stream,
+// together with points mapping message positions to byte offsets,
+// so that InFile::set_position need not read through the whole stream.
+// For .gz files each point additionally carries a zlib access point;
+// for .bgz files there is a point at the start of each block.
+// .zst and .lz4 files are indexed for statistics only, without points.
+// An index is ignored when its data file has been modified since indexing.
+
+class SidecarIndex
+{
+public:
+
+    typedef ::protobuf::loom::StreamIndex::Header Header;
+    typedef ::protobuf::loom::StreamIndex::Point Point;
+
+    enum {
+        raw_span = 1 << 20,
+        gzip_span = 1 << 22
+    };
+
+    static std::string filename (const std::string & data_filename)
+    {
+        return data_filename + ".index.pbs.gz";
+    }
+
+    static bool is_indexable (const std::string & data_filename)
+    {
+        return not data_filename.empty()
+            and data_filename != "-"
+            and data_filename != "-.gz";
+    }
+
+    SidecarIndex () : loaded_(false)
+    {
+        clear();
+    }
+
+    bool loaded () const { return loaded_; }
+    const Header & header () const { return header_; }
+    const std::vector<Point> & points () const { return points_; }
+
+    const Point * find (uint64_t position) const
+    {
+        auto pos = std::upper_bound(
+            points_.begin(),
+            points_.end(),
+            position,
+            [](uint64_t position, const Point & point){
+                return position < point.position();
+            });
+        return pos == points_.begin() ? nullptr : & * (pos - 1);
+    }
+
+    void clear ()
+    {
+        header_.Clear();
+        header_.set_file_size(0);
+        header_.set_file_mtime_nsec(0);
+        header_.set_message_count(0);
+        header_.set_max_message_size(0);
+        header_.set_point_count(0);
+        header_.set_total_bytes(0);
+        header_.set_checksum(0);
+        header_.set_seekable(false);
+        points_.clear();
+    }
+
+    void add_message (uint32_t message_size)
+    {
+        header_.set_message_count(header_.message_count() + 1);
+        if (message_size > header_.max_message_size()) {
+            header_.set_max_message_size(message_size);
+        }
+    }
+
+    void add_point (uint64_t position, uint64_t offset)
+    {
+        points_.push_back(Point());
+        Point & point = points_.back();
+        point.set_position(position);
+        point.set_offset(offset);
+    }
+
+    // this should be called after the data file is closed
+    void dump (
+            const std::string & data_filename,
+            uint64_t total_bytes,
+            uint32_t checksum,
+            bool seekable)
+    {
+        uint64_t file_size;
+        uint64_t file_mtime_nsec;
+        _stat(data_filename, file_size, file_mtime_nsec);
+        header_.set_file_size(file_size);
+        header_.set_file_mtime_nsec(file_mtime_nsec);
+        header_.set_point_count(points_.size());
+        header_.set_total_bytes(total_bytes);
+        header_.set_checksum(checksum);
+        header_.set_seekable(seekable);
+
+        const std::string final_filename = filename(data_filename);
+        const std::string temp_filename = final_filename + ".temp";
+        int fid = open(
+            temp_filename.c_str(),
+            O_WRONLY | O_CREAT | O_TRUNC, 0664);
+        LOOM_ASSERT(fid != -1, "failed to open output file " << temp_filename);
+        {
+            google::protobuf::io::FileOutputStream file(fid);
+            google::protobuf::io::GzipOutputStream gzip(& file);
+            _write(gzip, header_);
+            for (const auto & point : points_) {
+                _write(gzip, point);
+            }
+            bool success = gzip.Close() and file.Close();
+            LOOM_ASSERT(success, "failed to write " << temp_filename);
+        }
+        int status = rename(temp_filename.c_str(), final_filename.c_str());
+        LOOM_ASSERT(status == 0, "failed to write " << final_filename);
+    }
+
+    bool try_load (const std::string & data_filename)
+    {
+        loaded_ = false;
+        clear();
+        if (not is_indexable(data_filename)) {
+            return false;
+        }
+
+        int fid = open(filename(data_filename).c_str(), O_RDONLY | O_NOATIME);
+        if (fid == -1) {
+            return false;
+        }
+        google::protobuf::io::FileInputStream file(fid);
+        file.SetCloseOnDelete(true);
+        google::protobuf::io::GzipInputStream gzip(& file);
+
+        // unreadable, old or stale indices are ignored
+        if (not _read(gzip, header_) or
+            not header_.has_total_bytes() or
+            not header_.has_checksum() or
+            not header_.has_seekable())
+        {
+            clear();
+            return false;
+        }
+        uint64_t file_size;
+        uint64_t file_mtime_nsec;
+        _stat(data_filename, file_size, file_mtime_nsec);
+        if (header_.file_size() != file_size or
+            header_.file_mtime_nsec() != file_mtime_nsec)
+        {
+            clear();
+            return false;
+        }
+
+        points_.resize(header_.point_count());
+        for (auto & point : points_) {
+            if (not _read(gzip, point)) {
+                clear();
+                return false;
+            }
+        }
+
+        loaded_ = true;
+        return true;
+    }
+
+    // This is a no-op if a seekable index is already present,
+    // e.g. as written by OutFile for uncompressed and .bgz files,
+    // or if any index is present for a .zst or .lz4 file.
+    static void build (const std::string & data_filename)
+    {
+        if (not is_indexable(data_filename)) {
+            return;
+        }
+
+        const Codec::Type codec = Codec::from_filename(data_filename.c_str());
+        SidecarIndex index;
+        if (index.try_load(data_filename) and
+            (index.header().seekable() or codec != Codec::NONE))
+        {
+            return;
+        }
+        index.clear();
+
+        Scanner scanner(index);
+        int fid = open(data_filename.c_str(), O_RDONLY | O_NOATIME);
+        LOOM_ASSERT(fid != -1, "failed to open input file " << data_filename);
+        if (endswith(data_filename.c_str(), ".bgz")) {
+            index._scan_blocks(fid, scanner);
+        } else {
+            google::protobuf::io::FileInputStream file(fid);
+            if (codec != Codec::NONE) {
+                std::unique_ptr<google::protobuf::io::ZeroCopyInputStream>
+                    stream(Codec::new_input_stream(codec, & file));
+                index._scan_raw(* stream, scanner, 0);
+            } else if (endswith(data_filename.c_str(), ".gz")) {
+                index._scan_gzip(file, scanner, gzip_span);
+            } else {
+                index._scan_raw(file, scanner, raw_span);
+            }
+            LOOM_ASSERT(
+                file.GetErrno() == 0,
+                "failed to index " << data_filename);
+        }
+        close(fid);
+        LOOM_ASSERT(scanner.at_boundary(), "truncated message");
+
+        const bool seekable = (codec == Codec::NONE);
+        index.dump(
+            data_filename,
+            scanner.offset(),
+            scanner.checksum(),
+            seekable);
+    }
+
+private:
+
+    // This tracks message boundaries and a checksum of an uncompressed stream.
+    class Scanner
+    {
+    public:
+
+        explicit Scanner (SidecarIndex & index) :
+            index_(index),
+            offset_(0),
+            header_bytes_(0),
+            message_size_(0),
+            body_remaining_(0),
+            checksum_(crc32(0, Z_NULL, 0))
+        {
+        }
+
+        uint64_t offset () const { return offset_; }
+        uint32_t checksum () const { return checksum_; }
+        bool at_boundary () const
+        {
+            return header_bytes_ == 0 and body_remaining_ == 0;
+        }
+
+        // calls on_begin(offset) at the start of each message
+        template<class OnBegin>
+        void scan (const Bytef * data, size_t size, const OnBegin & on_begin)
+        {
+            checksum_ = crc32(checksum_, data, size);
+            for (const Bytef * end = data + size; data != end;) {
+                if (body_remaining_) {
+                    uint64_t skip = std::min<uint64_t>(
+                        body_remaining_,
+                        end - data);
+                    body_remaining_ -= skip;
+                    data += skip;
+                    offset_ += skip;
+                    continue;
+                }
+
+                if (header_bytes_ == 0) {
+                    on_begin(offset_);
+                    message_size_ = 0;
+                }
+                message_size_ |= uint32_t(* data) << (8 * header_bytes_);
+                ++data;
+                ++offset_;
+                if (++header_bytes_ == 4) {
+                    header_bytes_ = 0;
+                    body_remaining_ = message_size_;
+                    index_.add_message(message_size_);
+                }
+            }
+        }
+
+    private:
+
+        SidecarIndex & index_;
+        uint64_t offset_;
+        uint32_t header_bytes_;
+        uint32_t message_size_;
+        uint64_t body_remaining_;
+        uint32_t checksum_;
+    };
+
+    static void _stat (
+            const std::string & data_filename,
+            uint64_t & file_size,
+            uint64_t & file_mtime_nsec)
+    {
+        struct stat info;
+        int status = stat(data_filename.c_str(), & info);
+        LOOM_ASSERT(status == 0, "failed to stat " << data_filename);
+        file_size = info.st_size;
+        file_mtime_nsec = info.st_mtim.tv_sec * 1000000000ULL
+                        + info.st_mtim.tv_nsec;
+    }
+
+    template<class Message>
+    static bool _read (
+            google::protobuf::io::ZeroCopyInputStream & stream,
+            Message & message)
+    {
+        google::protobuf::io::CodedInputStream coded(& stream);
+        uint32_t message_size = 0;
+        if (coded.ReadLittleEndian32(& message_size)) {
+            auto old_limit = coded.PushLimit(message_size);
+            bool success = message.ParseFromCodedStream(& coded);
+            coded.PopLimit(old_limit);
+            return success;
+        } else {
+            return false;
+        }
+    }
+
+    template<class Message>
+    static void _write (
+            google::protobuf::io::ZeroCopyOutputStream & stream,
+            const Message & message)
+    {
+        google::protobuf::io::CodedOutputStream coded(& stream);
+        coded.WriteLittleEndian32(message.ByteSize());
+        message.SerializeWithCachedSizes(& coded);
+    }
+
+    // span = 0 records no points
+    void _scan_raw (
+            google::protobuf::io::ZeroCopyInputStream & file,
+            Scanner & scanner,
+            uint64_t span)
+    {
+        uint64_t last_offset = 0;
+        const void * data;
+        int size;
+        while (file.Next(& data, & size)) {
+            scanner.scan(
+                static_cast<const Bytef *>(data),
+                size,
+                [&](uint64_t offset){
+                    if (span and offset >= last_offset + span) {
+                        add_point(header_.message_count(), offset);
+                        last_offset = offset;
+                    }
+                });
+        }
+    }
+
+    void _scan_blocks (int fid, Scanner & scanner)
+    {
+        std::string block;
+        std::string data;
+        uint64_t offset = 0;
+        while (BlockFormat::read_block(fid, block)) {
+            if (offset) {
+                add_point(header_.message_count(), offset);
+            }
+            offset += block.size();
+
+            BlockFormat::inflate_block(block, data);
+            scanner.scan(
+                reinterpret_cast<const Bytef *>(data.data()),
+                data.size(),
+                [](uint64_t){});
+            LOOM_ASSERT(scanner.at_boundary(), "message spans blocks");
+        }
+    }
+
+    // This follows zlib's examples/zran.c, but tracks message boundaries in
+    // the inflated stream and only records points at message boundaries.
+    void _scan_gzip (
+            google::protobuf::io::FileInputStream & file,
+            Scanner & scanner,
+            uint64_t span)
+    {
+        enum { window_size = InflateInputStream::window_size };
+
+        z_stream strm;
+        strm.zalloc = Z_NULL;
+        strm.zfree = Z_NULL;
+        strm.opaque = Z_NULL;
+        strm.avail_in = 0;
+        strm.next_in = Z_NULL;
+        int status = inflateInit2(& strm, 47);
+        LOOM_ASSERT(status == Z_OK, "inflateInit2 failed");
+
+        std::vector<Bytef> window(window_size, 0);
+        strm.avail_out = 0;
+
+        // the most recent deflate block boundary
+        Point access;
+        uint64_t access_out = 0;
+        bool have_access = false;
+
+        uint64_t total_in = 0;
+        uint64_t last_out = 0;
+        bool stream_end = false;
+        auto on_begin = [&](uint64_t out){
+            if (have_access and out >= last_out + span) {
+                points_.push_back(access);
+                Point & point = points_.back();
+                point.set_position(header_.message_count());
+                point.set_skip(out - access_out);
+                last_out = out;
+            }
+        };
+
+        while (true) {
+            if (strm.avail_in == 0) {
+                const void * data;
+                int size;
+                if (not file.Next(& data, & size)) {
+                    break;
+                }
+                strm.next_in = static_cast<Bytef *>(const_cast<void *>(data));
+                strm.avail_in = size;
+            }
+            if (stream_end) {
+                inflateReset(& strm);
+                stream_end = false;
+            }
+            if (strm.avail_out == 0) {
+                strm.next_out = window.data();
+                strm.avail_out = window_size;
+            }
+
+            const Bytef * out_begin = strm.next_out;
+            total_in += strm.avail_in;
+            status = inflate(& strm, Z_BLOCK);
+            total_in -= strm.avail_in;
+            LOOM_ASSERT(
+                status == Z_OK or status == Z_STREAM_END,
+                "failed to inflate: " << status);
+            stream_end = (status == Z_STREAM_END);
+
+            scanner.scan(out_begin, strm.next_out - out_begin, on_begin);
+
+            if ((strm.data_type & 128) and not (strm.data_type & 64)) {
+                access.set_offset(total_in);
+                access.set_bits(strm.data_type & 7);
+                std::string & dict = * access.mutable_window();
+                dict.resize(window_size);
+                const size_t left = strm.avail_out;
+                if (left) {
+                    memcpy(& dict[0], window.data() + window_size - left, left);
+                }
+                if (left < window_size) {
+                    memcpy(& dict[left], window.data(), window_size - left);
+                }
+                access_out = scanner.offset();
+                have_access = true;
+            }
+        }
+
+        inflateEnd(& strm);
+        LOOM_ASSERT(stream_end, "truncated gzip stream");
+    }
+
+    bool loaded_;
+    Header header_;
+    std::vector<Point> points_;
+};
+
+} // namespace protobuf
+} // namespace loom
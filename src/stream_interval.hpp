@@ -27,25 +27,192 @@
 
 #pragma once
 
+#include <atomic>
+#include <limits>
+#include <mutex>
+#include <memory>
+#include <thread>
+#include <condition_variable>
 #include <loom/common.hpp>
 #include <loom/protobuf.hpp>
 #include <loom/assignments.hpp>
+#include <loom/row_block.hpp>
+#include <loom/task_pool.hpp>
 
 namespace loom
 {
 
+//----------------------------------------------------------------------------
+// Row Readahead
+//
+// A readahead thread decodes rows from both cursors of a StreamInterval
+// into bounded ring buffers, so that inflate and parse overlap scoring in
+// sequential inference.  Rows are consumed in exactly the order they would
+// be read inline.  On destruction, both cursors are rewound to their
+// consumed positions, discarding any rows read ahead.
+
+class RowReadahead : noncopyable
+{
+public:
+
+    RowReadahead (
+            RowInFile & unassigned,
+            RowInFile & assigned,
+            size_t capacity) :
+        unassigned_(unassigned, capacity),
+        assigned_(assigned, capacity),
+        stopping_(false),
+        thread_(& RowReadahead::_run, this)
+    {
+    }
+
+    ~RowReadahead ()
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        freed_.notify_one();
+        thread_.join();
+        unassigned_.rewind();
+        assigned_.rewind();
+    }
+
+    uint64_t unassigned_position () const { return unassigned_.position; }
+    uint64_t assigned_position () const { return assigned_.position; }
+
+    void read_unassigned (protobuf::Row & row) { _read(unassigned_, row); }
+    void read_assigned (protobuf::Row & row) { _read(assigned_, row); }
+
+private:
+
+    struct Ring
+    {
+        RowInFile & file;
+        std::vector<protobuf::Row> rows;
+        std::vector<uint64_t> positions;
+        size_t begin;
+        size_t size;
+        uint64_t position;
+
+        Ring (RowInFile & f, size_t capacity) :
+            file(f),
+            rows(capacity),
+            positions(capacity),
+            begin(0),
+            size(0),
+            position(f.position())
+        {
+            LOOM_ASSERT_LT(0, capacity);
+        }
+
+        bool full () const { return size == rows.size(); }
+
+        void rewind () { file.set_position(position); }
+    };
+
+    void _read (Ring & ring, protobuf::Row & row)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            filled_.wait(lock, [&ring]{ return ring.size; });
+        }
+        row.Swap(& ring.rows[ring.begin]);
+        ring.position = ring.positions[ring.begin];
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            ring.begin = (ring.begin + 1) % ring.rows.size();
+            --ring.size;
+        }
+        freed_.notify_one();
+    }
+
+    void _run ()
+    {
+        while (true) {
+            Ring * ring;
+            size_t end;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                freed_.wait(lock, [this]{
+                    return stopping_
+                        or not unassigned_.full()
+                        or not assigned_.full();
+                });
+                if (stopping_) {
+                    return;
+                }
+                ring = assigned_.size < unassigned_.size
+                     ? & assigned_
+                     : & unassigned_;
+                end = (ring->begin + ring->size) % ring->rows.size();
+            }
+
+            // slot end is invisible to the consumer until size is bumped
+            ring->file.cyclic_read_stream(ring->rows[end]);
+            ring->positions[end] = ring->file.position();
+
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                ++ring->size;
+            }
+            filled_.notify_one();
+        }
+    }
+
+    Ring unassigned_;
+    Ring assigned_;
+    bool stopping_;
+    std::mutex mutex_;
+    std::condition_variable filled_;
+    std::condition_variable freed_;
+    std::thread thread_;
+};
+
+//----------------------------------------------------------------------------
+// Stream Interval
+
 class StreamInterval : noncopyable
 {
 public:
 
+    // Readahead is active for the lifetime of a Readahead object,
+    // during which only protobuf::Rows may be read.
+    class Readahead : noncopyable
+    {
+    public:
+
+        Readahead (StreamInterval & rows, size_t capacity) : rows_(rows)
+        {
+            if (capacity) {
+                rows_.readahead_.reset(new RowReadahead(
+                    rows_.unassigned_,
+                    rows_.assigned_,
+                    capacity));
+            }
+        }
+
+        ~Readahead ()
+        {
+            rows_.readahead_.reset();
+        }
+
+    private:
+
+        StreamInterval & rows_;
+    };
+
     StreamInterval (const char * rows_in) :
         unassigned_(rows_in),
         assigned_(rows_in)
     {
     }
 
+    bool is_columnar () const { return unassigned_.is_columnar(); }
+
     void load (const protobuf::Checkpoint::StreamInterval & rows)
     {
+        LOOM_ASSERT(not readahead_, "cannot seek during readahead");
         #pragma omp parallel sections
         {
             #pragma omp section
@@ -58,72 +225,128 @@ public:
 
     void dump (protobuf::Checkpoint::StreamInterval & rows)
     {
-        rows.set_unassigned_pos(unassigned_.position());
-        rows.set_assigned_pos(assigned_.position());
+        if (readahead_) {
+            rows.set_unassigned_pos(readahead_->unassigned_position());
+            rows.set_assigned_pos(readahead_->assigned_position());
+        } else {
+            rows.set_unassigned_pos(unassigned_.position());
+            rows.set_assigned_pos(assigned_.position());
+        }
     }
 
-    void init_from_assignments (const Assignments & assignments)
+    void init_from_assignments (
+            const Assignments & assignments,
+            uint64_t row_count)
     {
         LOOM_ASSERT(assignments.row_count(), "nothing to initialize");
+        LOOM_ASSERT(not readahead_, "cannot seek during readahead");
         LOOM_ASSERT(assigned_.is_file(), "only files support StreamInterval");
+        LOOM_ASSERT_LT(assignments.row_count(), row_count);
+
+        // assigned rows form a contiguous cyclic interval of the stream
+        const uint64_t assigned_pos = find_first_assigned_row(assignments);
+        uint64_t unassigned_pos = assigned_pos + assignments.row_count();
+        if (unassigned_pos > row_count) {
+            unassigned_pos -= row_count;
+        }
 
         #pragma omp parallel sections
         {
             #pragma omp section
-            seek_first_unassigned_row(assignments);
+            {
+                unassigned_.set_position(unassigned_pos - 1);
+                protobuf::Row row;
+                bool success = unassigned_.try_read_stream(row);
+                LOOM_ASSERT(success, "row.id not found: "
+                    << assignments.rowids().back());
+                LOOM_ASSERT_EQ(row.id(), assignments.rowids().back());
+            }
 
             #pragma omp section
-            seek_first_assigned_row(assignments);
+            assigned_.set_position(assigned_pos);
+        }
+    }
+
+    void read_unassigned (protobuf::Row & row)
+    {
+        if (readahead_) {
+            readahead_->read_unassigned(row);
+        } else {
+            unassigned_.cyclic_read_stream(row);
+        }
+    }
+
+    void read_assigned (protobuf::Row & row)
+    {
+        if (readahead_) {
+            readahead_->read_assigned(row);
+        } else {
+            assigned_.cyclic_read_stream(row);
         }
     }
 
     template<class Message>
     void read_unassigned (Message & message)
     {
+        LOOM_ASSERT1(not readahead_, "readahead only supports protobuf::Row");
         unassigned_.cyclic_read_stream(message);
     }
 
     template<class Message>
     void read_assigned (Message & message)
     {
+        LOOM_ASSERT1(not readahead_, "readahead only supports protobuf::Row");
         assigned_.cyclic_read_stream(message);
     }
 
 private:
 
-    void seek_first_unassigned_row (const Assignments & assignments)
+    // Points of a sidecar index split the stream into segments that are
+    // each reached by one seek and searched in parallel.
+    uint64_t find_first_assigned_row (const Assignments & assignments)
     {
-        const auto last_assigned_rowid = assignments.rowids().back();
-        protobuf::Row row;
-
-        while (true) {
-            bool success = unassigned_.try_read_stream(row);
-            LOOM_ASSERT(success, "row.id not found: " << last_assigned_rowid);
-            if (row.id() == last_assigned_rowid) {
-                break;
+        const auto first_assigned_rowid = assignments.rowids().front();
+        const char * filename = unassigned_.filename();
+        std::vector<uint64_t> begins(1, 0);
+        protobuf::SidecarIndex index;
+        if (not is_columnar() and index.try_load(filename)) {
+            for (const auto & point : index.points()) {
+                begins.push_back(point.position());
             }
         }
-    }
 
-    void seek_first_assigned_row (const Assignments & assignments)
-    {
-        const auto first_assigned_rowid = assignments.rowids().front();
-        protobuf::InFile peeker(unassigned_.filename());
-        protobuf::Row row;
-        std::vector<char> unused;
+        const uint64_t not_found = std::numeric_limits<uint64_t>::max();
+        std::atomic<uint64_t> found(not_found);
+        const size_t segment_count = begins.size();
 
-        while (true) {
-            bool success = peeker.try_read_stream(row);
-            LOOM_ASSERT(success, "row.id not found: " << first_assigned_rowid);
-            if (row.id() == first_assigned_rowid) {
-                break;
+        parallel_for(0, segment_count, [&](size_t i){
+            if (found.load(std::memory_order_relaxed) != not_found) {
+                return;
             }
-            assigned_.try_read_stream(unused);
-        }
+            const uint64_t end =
+                (i + 1 < segment_count) ? begins[i + 1] : not_found;
+            RowInFile peeker(filename);
+            peeker.set_position(begins[i]);
+            FlatRow row;
+            while (peeker.position() < end and
+                   found.load(std::memory_order_relaxed) == not_found and
+                   peeker.try_read_stream(row))
+            {
+                if (row.id() == first_assigned_rowid) {
+                    found = peeker.position() - 1;
+                }
+            }
+        });
+
+        LOOM_ASSERT(
+            found != not_found,
+            "row.id not found: " << first_assigned_rowid);
+        return found;
     }
 
-    protobuf::InFile unassigned_;
-    protobuf::InFile assigned_;
+    RowInFile unassigned_;
+    RowInFile assigned_;
+    std::unique_ptr<RowReadahead> readahead_;
 };
 
 } // namespace loom
@@ -29,11 +29,12 @@
 #include <loom/differ.hpp>
 
 const char * help_message =
-"Usage: tare SCHEMA_ROW_IN ROWS_IN TARES_OUT"
+"Usage: tare SCHEMA_ROW_IN ROWS_IN TARES_OUT [THREADS=0]"
 "\nArguments:"
 "\n  SCHEMA_ROW_IN filename of schema row (e.g. schema.pb.gz)"
 "\n  ROWS_IN       filename of input dataset stream (e.g. rows.pbs.gz)"
 "\n  TARES_OUT     filename of output tare rows (e.g. tares.pbs.gz)"
+"\n  THREADS       number of worker threads, or 0 for all cores"
 "\nNotes:"
 "\n  Any filename can end with .gz to indicate gzip compression."
 "\n  Any filename can be '-' or '-.gz' to indicate stdin/stdout."
@@ -47,6 +48,7 @@ int main (int argc, char ** argv)
     const char * schema_row_in = args.pop();
     const char * rows_in = args.pop();
     const char * tares_out = args.pop();
+    const int thread_count = args.pop_default(0);
     args.done();
 
     loom::ProductValue value;
@@ -55,7 +57,7 @@ int main (int argc, char ** argv)
     schema.load(value);
 
     loom::Differ differ(schema);
-    differ.add_rows(rows_in);
+    differ.add_rows(rows_in, thread_count);
 
     loom::protobuf::OutFile tares(tares_out);
     const auto & tare = differ.get_tare();
@@ -0,0 +1,429 @@
+// Copyright (c) 2014, Salesforce.com, Inc.  All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//
+// - Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+// - Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+// - Neither the name of Salesforce.com nor the names of its contributors
+//   may be used to endorse or promote products derived from this
+//   software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+// FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+// COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+// BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+// OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+// TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <functional>
+#include <initializer_list>
+#include <condition_variable>
+#include <loom/common.hpp>
+
+namespace loom
+{
+
+// A process-wide work-stealing task pool.
+//
+// Each worker owns a deque, running its own tasks newest-first and stealing
+// other workers' tasks oldest-first; threads outside the pool submit to a
+// shared deque. Idle workers sleep on a condition variable, so the pool
+// costs nothing while the pipelines run. Threads blocked in wait_until,
+// e.g. pipeline threads blocked on their queues, run pending tasks and
+// sleep as waiters of the pool; submit wakes an idle worker if there is
+// one and otherwise one waiter, so the pipelines share the pool and no
+// thread polls. A pool may have no workers, in which case waiting threads
+// run all tasks.
+//
+// Threads waiting on a TaskGroup run pending tasks while they wait, so
+// groups may be nested: a task may itself run a parallel_for or wait on
+// its own group, which allows simple task graphs.
+class TaskPool : noncopyable
+{
+public:
+
+    typedef std::function<void()> Task;
+
+    explicit TaskPool (size_t worker_count);
+    ~TaskPool ();
+
+    // The shared pool, with one worker per thread beyond the caller.
+    // The thread count is LOOM_THREADS or else OMP_NUM_THREADS if set,
+    // and otherwise the hardware thread count.
+    static TaskPool & global ()
+    {
+        static TaskPool pool(default_worker_count());
+        return pool;
+    }
+
+    size_t worker_count () const { return workers_.size(); }
+
+    void submit (Task && task);
+
+    // runs one pending task if any, returning whether one was run
+    bool try_run_one ();
+
+    // Runs pending tasks until ready() holds, sleeping on cond_variable
+    // while there are none. Whoever makes ready() true must then notify
+    // cond_variable under mutex.
+    template<class Ready>
+    void wait_until (
+            std::mutex & mutex,
+            std::condition_variable & cond_variable,
+            const Ready & ready);
+
+private:
+
+    struct Waiter
+    {
+        std::mutex * mutex;
+        std::condition_variable * cond_variable;
+    };
+
+    void add_waiter (Waiter * waiter);
+    void remove_waiter (Waiter * waiter);
+    void wake_waiter ();
+
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    static size_t default_worker_count ()
+    {
+        size_t thread_count = std::thread::hardware_concurrency();
+        for (const char * name : {"LOOM_THREADS", "OMP_NUM_THREADS"}) {
+            if (const char * value = getenv(name)) {
+                thread_count = atoi(value);
+                break;
+            }
+        }
+        return thread_count > 1 ? thread_count - 1 : 0;
+    }
+
+    struct Worker
+    {
+        const TaskPool * pool;
+        int id;
+    };
+
+    static Worker & current_worker ()
+    {
+        static thread_local Worker worker = {nullptr, -1};
+        return worker;
+    }
+
+    // a worker of another pool counts as an outside thread
+    int current_workerid () const
+    {
+        const Worker & worker = current_worker();
+        return worker.pool == this ? worker.id : -1;
+    }
+
+    bool try_pop (size_t queueid, Task & task);
+    bool try_steal (size_t queueid, Task & task);
+    void work (size_t workerid);
+
+    // queues_[worker_count()] is shared by threads outside the pool
+    std::vector<std::unique_ptr<Queue>> queues_;
+    std::vector<std::thread> workers_;
+    std::atomic<size_t> queued_count_;
+    std::atomic<size_t> idle_count_;
+    std::atomic<size_t> waiter_count_;
+    std::atomic<bool> stopping_;
+    std::mutex mutex_;
+    std::condition_variable cond_variable_;
+    std::vector<Waiter *> waiters_;
+};
+
+// A fork-join group of tasks in a TaskPool.
+class TaskGroup : noncopyable
+{
+public:
+
+    explicit TaskGroup (TaskPool & pool = TaskPool::global()) :
+        pool_(pool),
+        pending_count_(0)
+    {
+    }
+
+    ~TaskGroup () { wait(); }
+
+    template<class Fun>
+    void run (const Fun & fun)
+    {
+        pending_count_.fetch_add(1, std::memory_order_relaxed);
+        pool_.submit([this, fun](){
+            fun();
+            _finish();
+        });
+    }
+
+    // runs pending tasks of this or any other group until this one is done
+    void wait ()
+    {
+        pool_.wait_until(mutex_, cond_variable_, [this](){
+            return pending_count_.load(std::memory_order_acquire) == 0;
+        });
+
+        // the last task may still hold the mutex after decrementing
+        std::unique_lock<std::mutex> lock(mutex_);
+    }
+
+private:
+
+    void _finish ()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (pending_count_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            cond_variable_.notify_all();
+        }
+    }
+
+    TaskPool & pool_;
+    std::atomic<size_t> pending_count_;
+    std::mutex mutex_;
+    std::condition_variable cond_variable_;
+};
+
+// Calls fun(i) for each i in [begin, end), like
+// #pragma omp parallel for if(parallel) schedule(dynamic, 1).
+// The calling thread takes part, and helpers claim indices one at a time.
+template<class Fun>
+inline void parallel_for (
+        size_t begin,
+        size_t end,
+        const Fun & fun,
+        bool parallel = true,
+        TaskPool & pool = TaskPool::global())
+{
+    if (end <= begin) {
+        return;
+    }
+    const size_t task_count = end - begin;
+    if (not parallel or task_count == 1) {
+        for (size_t i = begin; i < end; ++i) {
+            fun(i);
+        }
+        return;
+    }
+
+    std::atomic<size_t> next(begin);
+    auto loop = [&](){
+        for (size_t i; (i = next.fetch_add(1)) < end;) {
+            fun(i);
+        }
+    };
+    TaskGroup group(pool);
+    const size_t helper_count =
+        std::min(task_count - 1, pool.worker_count());
+    for (size_t h = 0; h < helper_count; ++h) {
+        group.run(loop);
+    }
+    loop();
+    group.wait();
+}
+
+//----------------------------------------------------------------------------
+// TaskPool implementation
+
+inline TaskPool::TaskPool (size_t worker_count) :
+    queues_(),
+    workers_(),
+    queued_count_(0),
+    idle_count_(0),
+    waiter_count_(0),
+    stopping_(false)
+{
+    for (size_t i = 0; i <= worker_count; ++i) {
+        queues_.emplace_back(new Queue());
+    }
+    for (size_t i = 0; i < worker_count; ++i) {
+        workers_.push_back(std::thread([this, i](){ work(i); }));
+    }
+}
+
+inline TaskPool::~TaskPool ()
+{
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        stopping_ = true;
+        cond_variable_.notify_all();
+    }
+    for (auto & worker : workers_) {
+        worker.join();
+    }
+}
+
+inline void TaskPool::submit (Task && task)
+{
+    // Workers count themselves idle and waiters register before
+    // re-checking queued_count_, and all counters are sequentially
+    // consistent, so either the worker or waiter sees this task or this
+    // thread sees the worker or waiter.
+    // The count leads the queue, so it never underflows.
+    queued_count_.fetch_add(1);
+
+    const int workerid = current_workerid();
+    const size_t queueid = workerid >= 0 ? workerid : workers_.size();
+    {
+        Queue & queue = * queues_[queueid];
+        std::unique_lock<std::mutex> lock(queue.mutex);
+        queue.tasks.push_back(std::move(task));
+    }
+
+    if (idle_count_.load()) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cond_variable_.notify_one();
+    } else if (waiter_count_.load()) {
+        wake_waiter();
+    }
+}
+
+// Waiters are added and removed under mutex_, which wake_waiter holds
+// while it notifies, so a waiter outlives any notification of it.
+// Waiters never hold their own mutex while taking mutex_.
+
+inline void TaskPool::add_waiter (Waiter * waiter)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    waiters_.push_back(waiter);
+    waiter_count_.fetch_add(1);
+}
+
+inline void TaskPool::remove_waiter (Waiter * waiter)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    auto pos = std::find(waiters_.begin(), waiters_.end(), waiter);
+    if (pos != waiters_.end()) {
+        waiters_.erase(pos);
+        waiter_count_.fetch_sub(1);
+    }
+}
+
+// Wakes the latest waiter, removing it so that the next task wakes another.
+// Other threads sleeping on the same condition variable, e.g. consumers of
+// one pipeline stage, wake too and go back to sleep if no task is left.
+inline void TaskPool::wake_waiter ()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (not waiters_.empty()) {
+        Waiter * waiter = waiters_.back();
+        waiters_.pop_back();
+        waiter_count_.fetch_sub(1);
+        std::unique_lock<std::mutex> waiter_lock(* waiter->mutex);
+        waiter->cond_variable->notify_all();
+    }
+}
+
+template<class Ready>
+inline void TaskPool::wait_until (
+        std::mutex & mutex,
+        std::condition_variable & cond_variable,
+        const Ready & ready)
+{
+    while (not ready()) {
+        if (try_run_one()) {
+            continue;
+        }
+        Waiter waiter = {& mutex, & cond_variable};
+        add_waiter(& waiter);
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cond_variable.wait(lock, [&](){
+                return ready() or queued_count_.load();
+            });
+        }
+        remove_waiter(& waiter);
+    }
+}
+
+inline bool TaskPool::try_pop (size_t queueid, Task & task)
+{
+    Queue & queue = * queues_[queueid];
+    std::unique_lock<std::mutex> lock(queue.mutex);
+    if (queue.tasks.empty()) {
+        return false;
+    }
+    task = std::move(queue.tasks.back());
+    queue.tasks.pop_back();
+    return true;
+}
+
+inline bool TaskPool::try_steal (size_t queueid, Task & task)
+{
+    Queue & queue = * queues_[queueid];
+    std::unique_lock<std::mutex> lock(queue.mutex);
+    if (queue.tasks.empty()) {
+        return false;
+    }
+    task = std::move(queue.tasks.front());
+    queue.tasks.pop_front();
+    return true;
+}
+
+inline bool TaskPool::try_run_one ()
+{
+    if (queued_count_.load() == 0) {
+        return false;
+    }
+
+    Task task;
+    const int workerid = current_workerid();
+    bool found = workerid >= 0 and try_pop(workerid, task);
+    const size_t queue_count = queues_.size();
+    const size_t start = workerid >= 0 ? workerid + 1 : 0;
+    for (size_t i = 0; not found and i < queue_count; ++i) {
+        found = try_steal((start + i) % queue_count, task);
+    }
+    if (not found) {
+        return false;
+    }
+
+    queued_count_.fetch_sub(1);
+    task();
+    return true;
+}
+
+inline void TaskPool::work (size_t workerid)
+{
+    current_worker().pool = this;
+    current_worker().id = static_cast<int>(workerid);
+    while (true) {
+        if (try_run_one()) {
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(mutex_);
+        idle_count_.fetch_add(1);
+        cond_variable_.wait(lock, [this](){
+            return stopping_ or queued_count_.load();
+        });
+        idle_count_.fetch_sub(1);
+        if (stopping_) {
+            return;
+        }
+    }
+}
+
+} // namespace loom